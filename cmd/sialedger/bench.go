@@ -0,0 +1,253 @@
+package main
+
+import (
+	"crypto/rand"
+	"encoding/json"
+	"fmt"
+	"math"
+	"os"
+	"sort"
+	"strconv"
+	"strings"
+	"time"
+
+	"go.sia.tech/core/types"
+)
+
+// minBenchChunkLen is the smallest packet size that bench will use. The
+// header of the first GET_TXN_HASH packet must fit in a single packet.
+const minBenchChunkLen = 32
+
+// A benchResult summarizes the samples of a single benchmark. Latencies are
+// in microseconds.
+type benchResult struct {
+	Name     string `json:"name"`
+	Samples  int    `json:"samples"`
+	Outputs  int    `json:"outputs,omitempty"`  // siacoin outputs in the transaction
+	TxnBytes int    `json:"txnBytes,omitempty"` // bytes sent per transaction, after any compression
+	ChunkLen int    `json:"chunkLen,omitempty"` // data bytes per APDU
+
+	MinMicros  float64 `json:"minMicros"`
+	MeanMicros float64 `json:"meanMicros"`
+	P50Micros  float64 `json:"p50Micros"`
+	P90Micros  float64 `json:"p90Micros"`
+	P99Micros  float64 `json:"p99Micros"`
+	MaxMicros  float64 `json:"maxMicros"`
+
+	// BytesPerSecond is the mean rate at which transaction data is
+	// streamed, for GET_TXN_HASH.
+	BytesPerSecond float64 `json:"bytesPerSecond,omitempty"`
+}
+
+// A benchReport is the output of bench: the device and connection under
+// test, and the result of each benchmark.
+type benchReport struct {
+	Label        string        `json:"label,omitempty"`
+	Transport    string        `json:"transport"`
+	Time         time.Time     `json:"time"`
+	Version      string        `json:"version"`
+	Capabilities Capabilities  `json:"capabilities"`
+	ZeroRLE      bool          `json:"zeroRLE"`
+	Skipped      []string      `json:"skipped,omitempty"` // benchmarks the device does not support
+	Results      []benchResult `json:"results"`
+}
+
+// benchOptions configure bench.
+type benchOptions struct {
+	Samples   int   // samples per benchmark
+	Outputs   []int // transaction sizes, in siacoin outputs
+	ChunkLens []int // packet sizes
+	SignHash  bool  // benchmark SIGN_HASH, which the user must approve
+}
+
+// parseIntList parses a comma-separated list of integers between min and
+// max.
+func parseIntList(s string, min, max int) ([]int, error) {
+	var list []int
+	for _, f := range strings.Split(s, ",") {
+		i, err := strconv.Atoi(strings.TrimSpace(f))
+		if err != nil {
+			return nil, fmt.Errorf("invalid number %q", f)
+		} else if i < min || i > max {
+			return nil, fmt.Errorf("%v is not between %v and %v", i, min, max)
+		}
+		list = append(list, i)
+	}
+	return list, nil
+}
+
+// summarize computes the statistics of samples, which must not be empty.
+// Percentiles use the nearest-rank method.
+func summarize(name string, samples []time.Duration) benchResult {
+	sorted := append([]time.Duration(nil), samples...)
+	sort.Slice(sorted, func(i, j int) bool { return sorted[i] < sorted[j] })
+	micros := func(d time.Duration) float64 { return float64(d) / float64(time.Microsecond) }
+	percentile := func(p float64) float64 {
+		rank := int(math.Ceil(p / 100 * float64(len(sorted))))
+		return micros(sorted[max(rank, 1)-1])
+	}
+	var total time.Duration
+	for _, d := range sorted {
+		total += d
+	}
+	return benchResult{
+		Name:       name,
+		Samples:    len(sorted),
+		MinMicros:  micros(sorted[0]),
+		MeanMicros: micros(total) / float64(len(sorted)),
+		P50Micros:  percentile(50),
+		P90Micros:  percentile(90),
+		P99Micros:  percentile(99),
+		MaxMicros:  micros(sorted[len(sorted)-1]),
+	}
+}
+
+// sample calls fn once to warm up, then n more times, timing each call.
+func sample(n int, fn func(i int) error) ([]time.Duration, error) {
+	if err := fn(0); err != nil {
+		return nil, err
+	}
+	samples := make([]time.Duration, n)
+	for i := range samples {
+		start := time.Now()
+		if err := fn(i); err != nil {
+			return nil, err
+		}
+		samples[i] = time.Since(start)
+	}
+	return samples, nil
+}
+
+// benchTxn returns a transaction that spends a single input of pk, sending
+// siacoins to the given number of distinct addresses.
+func benchTxn(pk types.PublicKey, outputs int) types.Transaction {
+	txn := types.Transaction{
+		SiacoinInputs: []types.SiacoinInput{{
+			UnlockConditions: types.UnlockConditions{
+				PublicKeys:         []types.UnlockKey{pk.UnlockKey()},
+				SignaturesRequired: 1,
+			},
+		}},
+		MinerFees: []types.Currency{types.NewCurrency64(1e15)},
+		Signatures: []types.TransactionSignature{{
+			CoveredFields: types.CoveredFields{WholeTransaction: true},
+		}},
+	}
+	rand.Read(txn.SiacoinInputs[0].ParentID[:])
+	txn.Signatures[0].ParentID = types.Hash256(txn.SiacoinInputs[0].ParentID)
+	for i := 0; i < outputs; i++ {
+		var addr types.Address
+		rand.Read(addr[:])
+		txn.SiacoinOutputs = append(txn.SiacoinOutputs, types.SiacoinOutput{
+			Address: addr,
+			Value:   types.NewCurrency64(uint64(i+1) * 1e18),
+		})
+	}
+	return txn
+}
+
+// txnBytes returns the number of bytes that streamTxn sends for et.
+func (n *Nano) txnBytes(et encodedTxn) int {
+	if n.zeroRLE {
+		return et.hdrLen + len(zeroRLE(et.data[et.hdrLen:]))
+	}
+	return len(et.data)
+}
+
+// bench measures the latency of the device's commands, and the rate at which
+// it hashes transactions of various sizes, streamed in packets of various
+// sizes. Commands that would display something are only benchmarked if the
+// device can perform them without a review, except for SIGN_HASH, which the
+// user must approve each time.
+func bench(n *Nano, opts benchOptions) (benchReport, error) {
+	caps := n.capabilities()
+	r := benchReport{
+		Time:         time.Now().UTC(),
+		Version:      caps.Version,
+		Capabilities: caps,
+		ZeroRLE:      n.zeroRLE,
+	}
+
+	samples, err := sample(opts.Samples, func(int) error {
+		_, err := n.GetVersion()
+		return err
+	})
+	if err != nil {
+		return benchReport{}, fmt.Errorf("GET_VERSION: %w", err)
+	}
+	r.Results = append(r.Results, summarize("GET_VERSION", samples))
+
+	if !caps.KeyBatch {
+		r.Skipped = append(r.Skipped, "GET_PUBLIC_KEY")
+	} else {
+		// each sample derives a different key
+		samples, err := sample(opts.Samples, func(i int) error {
+			_, err := n.GetPublicKeys(uint32(i), 1)
+			return err
+		})
+		if err != nil {
+			return benchReport{}, fmt.Errorf("GET_PUBLIC_KEY: %w", err)
+		}
+		r.Results = append(r.Results, summarize("GET_PUBLIC_KEY", samples))
+	}
+
+	if !caps.NoReview {
+		r.Skipped = append(r.Skipped, "GET_TXN_HASH")
+	} else {
+		noReview, chunkLen := n.noReview, n.chunkLen
+		defer func() { n.noReview, n.chunkLen = noReview, chunkLen }()
+		n.noReview = true
+		for _, outputs := range opts.Outputs {
+			// the key is not checked when only hashing
+			txn := benchTxn(types.PublicKey{}, outputs)
+			et, err := n.prepareTxn(txn, 0, 0, NoChange, false)
+			if err != nil {
+				return benchReport{}, err
+			}
+			size := n.txnBytes(et)
+			for _, chunk := range opts.ChunkLens {
+				n.chunkLen = chunk
+				samples, err := sample(opts.Samples, func(int) error {
+					_, err := n.streamTxn(p2DisplayHash, et)
+					return err
+				})
+				if err != nil {
+					return benchReport{}, fmt.Errorf("GET_TXN_HASH: %w", err)
+				}
+				res := summarize("GET_TXN_HASH", samples)
+				res.Outputs = outputs
+				res.TxnBytes = size
+				res.ChunkLen = n.maxChunkLen()
+				res.BytesPerSecond = float64(size) / (res.MeanMicros / 1e6)
+				r.Results = append(r.Results, res)
+			}
+		}
+	}
+
+	if opts.SignHash {
+		var hash [32]byte
+		samples, err := sample(opts.Samples, func(int) error {
+			_, err := n.SignHash(hash, 0)
+			return err
+		})
+		if err != nil {
+			return benchReport{}, fmt.Errorf("SIGN_HASH: %w", err)
+		}
+		r.Results = append(r.Results, summarize("SIGN_HASH", samples))
+	}
+	return r, nil
+}
+
+// writeBenchReport writes r to path as JSON, or to stdout if path is empty.
+func writeBenchReport(r benchReport, path string) error {
+	js, err := json.MarshalIndent(r, "", "  ")
+	if err != nil {
+		return err
+	}
+	js = append(js, '\n')
+	if path == "" {
+		_, err = os.Stdout.Write(js)
+		return err
+	}
+	return os.WriteFile(path, js, 0o644)
+}
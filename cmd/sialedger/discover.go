@@ -0,0 +1,188 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io/fs"
+	"net/http"
+	"os"
+	"path/filepath"
+	"strings"
+
+	"go.sia.tech/core/types"
+)
+
+// An addressCache holds the public keys of a wallet's first key indices, so
+// that its addresses can be listed without the device. Keys[0] identifies the
+// device that the keys belong to. Only keys are stored; addresses are always
+// derived from them.
+type addressCache struct {
+	Keys []types.PublicKey `json:"keys"`
+}
+
+func defaultCachePath() string {
+	dir, err := os.UserCacheDir()
+	if err != nil {
+		return "sialedger-keys.json"
+	}
+	return filepath.Join(dir, "sialedger", "keys.json")
+}
+
+// loadAddressCache reads the cache at path. A missing cache is empty.
+func loadAddressCache(path string) (*addressCache, error) {
+	c := new(addressCache)
+	b, err := os.ReadFile(path)
+	if errors.Is(err, fs.ErrNotExist) {
+		return c, nil
+	} else if err != nil {
+		return nil, err
+	}
+	return c, json.Unmarshal(b, c)
+}
+
+// save writes the cache to path. The cache is replaced atomically, so that an
+// interrupted write leaves the previous cache intact.
+func (c *addressCache) save(path string) error {
+	b, err := json.MarshalIndent(c, "", "\t")
+	if err != nil {
+		return err
+	} else if err := os.MkdirAll(filepath.Dir(path), 0o700); err != nil {
+		return err
+	}
+	tmp := path + ".tmp"
+	if err := os.WriteFile(tmp, b, 0o600); err != nil {
+		return err
+	}
+	return os.Rename(tmp, path)
+}
+
+func (c *addressCache) address(index uint32) types.Address {
+	return types.StandardUnlockHash(c.Keys[index])
+}
+
+// A usedFunc reports which of a set of addresses have been used.
+type usedFunc func(addrs []types.Address) ([]bool, error)
+
+// usedChecker returns a usedFunc that consults src, which is either a file
+// listing the used addresses, one per line, or the URL of a service that
+// accepts a JSON array of addresses and returns a JSON array of booleans.
+func usedChecker(src string) (usedFunc, error) {
+	if strings.HasPrefix(src, "http://") || strings.HasPrefix(src, "https://") {
+		return func(addrs []types.Address) ([]bool, error) {
+			js, _ := json.Marshal(addrs)
+			resp, err := http.Post(src, "application/json", bytes.NewReader(js))
+			if err != nil {
+				return nil, err
+			}
+			defer resp.Body.Close()
+			if resp.StatusCode != http.StatusOK {
+				return nil, fmt.Errorf("service returned %v", resp.Status)
+			}
+			var used []bool
+			if err := json.NewDecoder(resp.Body).Decode(&used); err != nil {
+				return nil, err
+			} else if len(used) != len(addrs) {
+				return nil, fmt.Errorf("service returned %v results for %v addresses", len(used), len(addrs))
+			}
+			return used, nil
+		}, nil
+	}
+
+	f, err := os.Open(src)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+	set := make(map[types.Address]bool)
+	s := bufio.NewScanner(f)
+	for s.Scan() {
+		line := strings.TrimSpace(s.Text())
+		if line == "" || strings.HasPrefix(line, "#") {
+			continue
+		}
+		var addr types.Address
+		if err := addr.UnmarshalText([]byte(line)); err != nil {
+			return nil, fmt.Errorf("invalid address %q: %w", line, err)
+		}
+		set[addr] = true
+	}
+	if err := s.Err(); err != nil {
+		return nil, err
+	}
+	return func(addrs []types.Address) ([]bool, error) {
+		used := make([]bool, len(addrs))
+		for i, addr := range addrs {
+			used[i] = set[addr]
+		}
+		return used, nil
+	}, nil
+}
+
+// A discoveryScan is the result of discover.
+type discoveryScan struct {
+	used         []uint32 // key indices whose addresses are used
+	next         uint32   // the key index after the last used one
+	cacheChanged bool
+}
+
+// discover scans the addresses of c's key indices in order, gap at a time,
+// until gap consecutive addresses are unused. Keys missing from c are read
+// from the device returned by open, which is only called if they are needed;
+// before any key is added, the device's key at index 0 is checked against
+// the cache, and if it differs, the cache is discarded and the scan begins
+// again.
+func discover(c *addressCache, used usedFunc, gap int, open func() *Nano) (scan discoveryScan, err error) {
+	verified := false
+	for {
+		scan.used, scan.next = nil, 0
+		unused := 0
+		for i := 0; unused < gap; i += gap {
+			if need := i + gap; need > len(c.Keys) {
+				n := open()
+				if !verified && len(c.Keys) > 0 {
+					key0, err := n.GetPublicKeys(0, 1)
+					if err != nil {
+						return discoveryScan{}, err
+					}
+					verified = true
+					if key0[0] != c.Keys[0] {
+						c.Keys = nil
+						scan.cacheChanged = true
+						break
+					}
+				}
+				keys, err := n.GetPublicKeys(uint32(len(c.Keys)), need-len(c.Keys))
+				if err != nil {
+					return discoveryScan{}, err
+				}
+				verified = true
+				c.Keys = append(c.Keys, keys...)
+				scan.cacheChanged = true
+			}
+
+			addrs := make([]types.Address, gap)
+			for j := range addrs {
+				addrs[j] = c.address(uint32(i + j))
+			}
+			flags, err := used(addrs)
+			if err != nil {
+				return discoveryScan{}, err
+			}
+			for j := 0; j < gap && unused < gap; j++ {
+				if flags[j] {
+					scan.used = append(scan.used, uint32(i+j))
+					scan.next = uint32(i + j + 1)
+					unused = 0
+				} else {
+					unused++
+				}
+			}
+		}
+		if unused >= gap {
+			return scan, nil
+		}
+	}
+}
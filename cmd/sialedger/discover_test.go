@@ -0,0 +1,68 @@
+package main
+
+import (
+	"reflect"
+	"testing"
+
+	"go.sia.tech/core/types"
+)
+
+func TestDiscoverGapLimit(t *testing.T) {
+	n := openTestNano(t)
+	keys, err := n.GetPublicKeys(0, 25)
+	if err != nil {
+		t.Fatal(err)
+	}
+	isUsed := make(map[types.Address]bool)
+	for _, i := range []int{0, 3, 7, 20} {
+		isUsed[types.StandardUnlockHash(keys[i])] = true
+	}
+	used := func(addrs []types.Address) ([]bool, error) {
+		flags := make([]bool, len(addrs))
+		for i, addr := range addrs {
+			flags[i] = isUsed[addr]
+		}
+		return flags, nil
+	}
+	opens := 0
+	open := func() *Nano {
+		opens++
+		return n
+	}
+	c := new(addressCache)
+	// index 20 follows more than 5 unused indices, so it is never reached
+	check := func(desc string, scan discoveryScan, cacheChanged bool) {
+		t.Helper()
+		if !reflect.DeepEqual(scan.used, []uint32{0, 3, 7}) || scan.next != 8 {
+			t.Errorf("%v: found used indices %v and next index %v, want [0 3 7] and 8", desc, scan.used, scan.next)
+		} else if scan.cacheChanged != cacheChanged {
+			t.Errorf("%v: cacheChanged is %v, want %v", desc, scan.cacheChanged, cacheChanged)
+		} else if !reflect.DeepEqual(c.Keys, keys[:15]) {
+			t.Errorf("%v: cache has %v keys, want the first 15", desc, len(c.Keys))
+		}
+	}
+
+	scan, err := discover(c, used, 5, open)
+	if err != nil {
+		t.Fatal(err)
+	}
+	check("empty cache", scan, true)
+
+	// every key needed is cached, so the device is not opened
+	opens = 0
+	scan, err = discover(c, used, 5, open)
+	if err != nil {
+		t.Fatal(err)
+	} else if opens != 0 {
+		t.Error("device was opened although every key was cached")
+	}
+	check("full cache", scan, false)
+
+	// a cache belonging to another device is discarded
+	c.Keys = []types.PublicKey{{1}}
+	scan, err = discover(c, used, 5, open)
+	if err != nil {
+		t.Fatal(err)
+	}
+	check("foreign cache", scan, true)
+}
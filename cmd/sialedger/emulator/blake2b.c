@@ -0,0 +1 @@
+#include "../../../src/blake2b.c"
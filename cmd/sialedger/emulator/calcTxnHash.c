@@ -0,0 +1 @@
+#include "../../../src/calcTxnHash_nbgl.c"
@@ -0,0 +1,125 @@
+// Package emulator runs the Sia app's command handlers in-process, so that
+// the client can be tested and benchmarked without a device or Speculos.
+//
+// The handlers are compiled from the app's own sources (see the .c files in
+// this directory) against minimal stand-ins for the Ledger SDK. Every review
+// is approved as soon as it is displayed, and keys are derived from a
+// software seed using SLIP-10, as on the device.
+package emulator
+
+// #cgo CFLAGS: -I${SRCDIR}/include -I${SRCDIR}/../../../src -DHAVE_NBGL
+// #include "emulator.h"
+import "C"
+
+import (
+	"crypto/ed25519"
+	"crypto/hmac"
+	"crypto/sha512"
+	"encoding/binary"
+	"errors"
+	"sync"
+	"unsafe"
+)
+
+// The app's state is global, so only one command may execute at a time, and
+// only one Device may be open.
+var (
+	mu     sync.Mutex
+	active *Device
+)
+
+// A Device is an emulated Ledger device running the Sia app.
+type Device struct {
+	seed []byte
+}
+
+// Open returns a Device whose keys are derived from seed. Any previously
+// opened Device is closed, and all command state is reset.
+func Open(seed []byte) *Device {
+	mu.Lock()
+	defer mu.Unlock()
+	active = &Device{
+		seed: append([]byte(nil), seed...),
+	}
+	C.emu_reset()
+	return active
+}
+
+// Exchange executes an encoded APDU command and returns the response,
+// including the trailing status word.
+func (d *Device) Exchange(apdu []byte) ([]byte, error) {
+	mu.Lock()
+	defer mu.Unlock()
+	if d != active {
+		return nil, errors.New("emulator: device is closed")
+	} else if len(apdu) == 0 {
+		return nil, errors.New("emulator: empty command")
+	}
+	var resp [C.EMU_MAX_RESPONSE]byte
+	n := C.emu_exchange((*C.uint8_t)(unsafe.Pointer(&apdu[0])), C.size_t(len(apdu)), (*C.uint8_t)(unsafe.Pointer(&resp[0])))
+	return append([]byte(nil), resp[:n]...), nil
+}
+
+// deriveNode derives the SLIP-10 ed25519 node at path, returning its key
+// followed by its chain code. Only hardened derivation is defined for ed25519.
+func (d *Device) deriveNode(path []uint32) ([]byte, bool) {
+	h := hmac.New(sha512.New, []byte("ed25519 seed"))
+	h.Write(d.seed)
+	node := h.Sum(nil)
+	for _, index := range path {
+		if index&0x80000000 == 0 {
+			return nil, false
+		}
+		h := hmac.New(sha512.New, node[32:])
+		h.Write([]byte{0})
+		h.Write(node[:32])
+		h.Write(binary.BigEndian.AppendUint32(nil, index))
+		node = h.Sum(node[:0])
+	}
+	return node, true
+}
+
+func cBytes(p *C.uint8_t, n int) []byte {
+	return unsafe.Slice((*byte)(unsafe.Pointer(p)), n)
+}
+
+//export emuDeriveNode
+func emuDeriveNode(path *C.uint32_t, n C.size_t, key, chainCode *C.uint8_t) C.int {
+	node, ok := active.deriveNode(unsafe.Slice((*uint32)(unsafe.Pointer(path)), int(n)))
+	if !ok {
+		return -1
+	}
+	copy(cBytes(key, 32), node[:32])
+	copy(cBytes(chainCode, 32), node[32:])
+	return 0
+}
+
+//export emuHMACSHA512
+func emuHMACSHA512(key *C.uint8_t, keyLen C.size_t, in *C.uint8_t, inLen C.size_t, mac *C.uint8_t) {
+	h := hmac.New(sha512.New, cBytes(key, int(keyLen)))
+	h.Write(cBytes(in, int(inLen)))
+	copy(cBytes(mac, 64), h.Sum(nil))
+}
+
+//export emuPublicKey
+func emuPublicKey(privateKey, out *C.uint8_t) {
+	// The device returns an uncompressed point, with big-endian coordinates;
+	// the app only uses y and the parity of x, which is all that the ed25519
+	// encoding (little-endian y, with the parity of x in the top bit) holds.
+	key := ed25519.NewKeyFromSeed(cBytes(privateKey, 32))
+	pk := key.Public().(ed25519.PublicKey)
+	raw := cBytes(out, 65)
+	clear(raw)
+	raw[0] = 0x04
+	raw[32] = pk[31] >> 7
+	for i := 0; i < 32; i++ {
+		raw[64-i] = pk[i]
+	}
+	raw[33] &= 0x7f
+}
+
+//export emuSign
+func emuSign(privateKey, hash *C.uint8_t, hashLen C.size_t, sig *C.uint8_t) {
+	key := ed25519.NewKeyFromSeed(cBytes(privateKey, 32))
+	copy(cBytes(sig, 64), ed25519.Sign(key, cBytes(hash, int(hashLen))))
+}
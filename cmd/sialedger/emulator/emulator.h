@@ -0,0 +1,18 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// EMU_MAX_RESPONSE is the size of the largest response, including the status
+// word.
+#define EMU_MAX_RESPONSE 260
+
+// emu_reset clears all command state, as if the app had just been opened.
+void emu_reset(void);
+
+// emu_exchange executes a single APDU command, writing the response and
+// status word to resp. It returns the length of the response.
+size_t emu_exchange(const uint8_t *apdu, size_t apdu_len, uint8_t resp[static EMU_MAX_RESPONSE]);
+
+#endif /* EMULATOR_H */
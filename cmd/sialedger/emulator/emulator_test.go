@@ -0,0 +1,160 @@
+package emulator
+
+import (
+	"bytes"
+	"encoding/base64"
+	"encoding/binary"
+	"encoding/hex"
+	"testing"
+)
+
+// speculosSeed is the seed of the default Speculos mnemonic, so that the
+// signatures below match those expected by the ragger tests.
+const speculosSeed = "b11997faff420a331bb4a4ffdc8bdc8ba7c01732a99a30d83dbbebd469666c84b47d09d3f5f472b3b9384ac634beba2a440ba36ec7661144132f35e206873564"
+
+// testTxn is test_transaction from tests/test_sign_txn_cmd.py: one siacoin
+// input, two siacoin outputs, two siafund outputs, and a signature covering
+// the whole transaction.
+const testTxn = "01000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000006564323535313900000000000000000020000000000000004dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f49000000000000000002000000000000000d00000000000000010c90c55e861d3c59cd0000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450c00000000000000a619d0a11bec7c940f0000006f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df0000000000000000000000000000000000000000000000000000000000000000002000000000000000d00000000000000010c90c55e861d3c59cd0000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d624500000000000000000c00000000000000a619d0a11bec7c940f0000006f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df00000000000000000000000000000000000000000000000000100000000000000784a77549f25083a69a388a1661e0a6b2ac8c7fc98e2b69edde6bd45d155ad03000000000000000000000000000000000100000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000006000000000000000f7ad756faeb777b7f6e1edf9e1be5e6fd6bcd9cdba71fe7ce7977de7c69dd76eb5edb79ef3d73dd1a737f36d7d69d6fbe9cef86bdef5d376b469be1e73df756f4d76d35e39776dda69aeb8ef5db4f5ddf9e36d3de37efb6b87bdeb6dbb7fbd1b"
+
+// partialTxn is test_partial_transaction from tests/test_sign_txn_cmd.py:
+// two siacoin outputs and a miner fee, with a signature covering only the
+// first siacoin output and the miner fee.
+const partialTxn = "01000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000006564323535313900000000000000000020000000000000004dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f49000000000000000002000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450b0000000000000001a784379d99db420000006f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df00000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000000a00000000000000d3c21bcecceda100000000000000000000000100000000000000784a77549f25083a69a388a1661e0a6b2ac8c7fc98e2b69edde6bd45d155ad030000000000000000000000000000000000000000000000000001000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000100000000000000000000000000000000000000000000000000000000000000400000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+
+func mustDecodeHex(s string) []byte {
+	b, err := hex.DecodeString(s)
+	if err != nil {
+		panic(err)
+	}
+	return b
+}
+
+// streamTxn sends a GET_TXN_HASH header and transaction in 255-byte packets,
+// and returns the final response and its status word.
+func streamTxn(t *testing.T, d *Device, p2 byte, hdr, txn []byte) ([]byte, uint16) {
+	t.Helper()
+	data := append(append([]byte(nil), hdr...), txn...)
+	var resp []byte
+	for p1 := byte(0x00); len(data) > 0; p1 = 0x80 {
+		n := min(len(data), 255)
+		apdu := append([]byte{0xe0, 0x08, p1, p2, byte(n)}, data[:n]...)
+		var err error
+		resp, err = d.Exchange(apdu)
+		if err != nil {
+			t.Fatal(err)
+		}
+		sw := binary.BigEndian.Uint16(resp[len(resp)-2:])
+		if sw != 0x9000 {
+			return resp[:len(resp)-2], sw
+		}
+		data = data[n:]
+	}
+	return resp[:len(resp)-2], 0x9000
+}
+
+// txnHeader encodes the header of the first GET_TXN_HASH packet, without
+// change outputs.
+func txnHeader(keyIndex uint32, sigIndex uint16) []byte {
+	hdr := binary.LittleEndian.AppendUint32(nil, keyIndex)
+	hdr = binary.LittleEndian.AppendUint16(hdr, sigIndex)
+	return binary.LittleEndian.AppendUint32(hdr, 0xFFFFFFFF)
+}
+
+func TestTxnHash(t *testing.T) {
+	d := Open(mustDecodeHex(speculosSeed))
+	txn := mustDecodeHex(testTxn)
+	hash := mustDecodeHex("593a3f87598ef76c9a7d0f7119c01f0a2328761402283dd5ea9f85fc61fb5b55")
+	id := mustDecodeHex("de4a5169ed38e82e99ba5623335f4cf7e0c3dfc4cb9a624a916c28aaf8ffebf0")
+
+	for _, test := range []struct {
+		desc string
+		p2   byte
+		want []byte
+	}{
+		{"review", 0x00, hash},
+		{"no review", 0x40, hash},
+		{"with ID", 0x08, append(hash, id...)},
+		{"no review with ID", 0x48, append(hash, id...)},
+	} {
+		resp, sw := streamTxn(t, d, test.p2, txnHeader(0, 0), txn)
+		if sw != 0x9000 {
+			t.Errorf("%v: status %#x", test.desc, sw)
+		} else if !bytes.Equal(resp, test.want) {
+			t.Errorf("%v: got %x, want %x", test.desc, resp, test.want)
+		}
+	}
+}
+
+func TestSignTxn(t *testing.T) {
+	d := Open(mustDecodeHex(speculosSeed))
+	resp, sw := streamTxn(t, d, 0x01, txnHeader(0, 0), mustDecodeHex(testTxn))
+	want, _ := base64.StdEncoding.DecodeString("mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg==")
+	if sw != 0x9000 {
+		t.Fatalf("status %#x", sw)
+	} else if !bytes.Equal(resp, want) {
+		t.Fatalf("got %x, want %x", resp, want)
+	}
+
+	// the signature must not depend on how the transaction is encoded
+	resp, sw = streamTxn(t, d, 0x03, txnHeader(0, 0), zeroRLE(mustDecodeHex(testTxn)))
+	if sw != 0x9000 {
+		t.Fatalf("zero-run encoded: status %#x", sw)
+	} else if !bytes.Equal(resp, want) {
+		t.Fatalf("zero-run encoded: got %x, want %x", resp, want)
+	}
+}
+
+// zeroRLE replaces each run of zero bytes with a zero byte followed by the
+// length of the run. The runs are short enough that no packet splits one.
+func zeroRLE(data []byte) []byte {
+	var out []byte
+	for i := 0; i < len(data); {
+		if data[i] != 0 {
+			out = append(out, data[i])
+			i++
+			continue
+		}
+		var run byte
+		for i < len(data) && data[i] == 0 && run < 255 {
+			run++
+			i++
+		}
+		out = append(out, 0, run)
+	}
+	return out
+}
+
+func TestPartialTxnHash(t *testing.T) {
+	d := Open(mustDecodeHex(speculosSeed))
+	txn := mustDecodeHex(partialTxn)
+	// siacoin output 0 and miner fee 0
+	covered := []byte{2, 0x00, 0x10, 0x00, 0x70}
+	resp, sw := streamTxn(t, d, 0x04, append(txnHeader(0, 0), covered...), txn)
+	want := mustDecodeHex("7dd09c818122bc254976224fcbefaebe9c2d4c0e37c1ce83e36d0cd55423e55b")
+	if sw != 0x9000 {
+		t.Fatalf("status %#x", sw)
+	} else if !bytes.Equal(resp, want) {
+		t.Fatalf("got %x, want %x", resp, want)
+	}
+}
+
+func TestRejectTxn(t *testing.T) {
+	d := Open(mustDecodeHex(speculosSeed))
+	for _, test := range []struct {
+		desc string
+		p2   byte
+		hdr  []byte
+		txn  string
+	}{
+		{"missing signature", 0x00, txnHeader(0, 1), testTxn},
+		{"partial signature declared as whole", 0x00, txnHeader(0, 0), partialTxn},
+		{"covered elements differ", 0x04, append(txnHeader(0, 0), 1, 0x00, 0x10), partialTxn},
+		{"signing without review", 0x41, txnHeader(0, 0), testTxn},
+		{"short header", 0x04, []byte{0, 0, 0, 0, 0, 0}, ""},
+	} {
+		if _, sw := streamTxn(t, d, test.p2, test.hdr, mustDecodeHex(test.txn)); sw != 0x6b01 {
+			t.Errorf("%v: status %#x, want 0x6b01", test.desc, sw)
+		}
+	}
+}
@@ -0,0 +1 @@
+#include "../../../src/getPublicKey.c"
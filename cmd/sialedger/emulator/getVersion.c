@@ -0,0 +1,4 @@
+// keep in sync with APPVERSION in the Makefile
+#define APPVERSION "1.0.0"
+
+#include "../../../src/getVersion.c"
@@ -0,0 +1,535 @@
+// This file provides the host side of the emulator: the SDK functions called
+// by the app's command handlers, and the APDU dispatch normally performed by
+// app_main. Reviews are approved as soon as they are displayed, and keys are
+// derived by the Go code in emulator.go.
+
+#include <cx.h>
+#include <io.h>
+#include <os.h>
+#include <os_seed.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "_cgo_export.h"
+#include "emulator.h"
+#include "sia.h"
+#include "sia_ux.h"
+
+commandContext global;
+bool uiBusy;
+// On the device, N_storage_real is placed in flash and written by nvm_write;
+// here it must be writable memory.
+#ifdef __APPLE__
+__attribute__((section("__DATA,__nvram")))
+#else
+__attribute__((section(".data.nvram")))
+#endif
+const internalStorage_t N_storage_real = {.blindSign = true, .initialized = true};
+const nbgl_icon_details_t C_stax_app_sia_big;
+try_context_t *G_try_last;
+
+// response to the current command; the first response sent wins, as on the
+// device
+static uint8_t *resp_buf;
+static size_t resp_len;
+static bool resp_sent;
+
+// BLAKE2b, as specified in RFC 7693
+
+static const uint64_t blake2b_iv[8] = {
+    0x6A09E667F3BCC908,
+    0xBB67AE8584CAA73B,
+    0x3C6EF372FE94F82B,
+    0xA54FF53A5F1D36F1,
+    0x510E527FADE682D1,
+    0x9B05688C2B3E6C1F,
+    0x1F83D9ABFB41BD6B,
+    0x5BE0CD19137E2179,
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+};
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define B2B_G(a, b, c, d, x, y)         \
+    do {                                \
+        v[a] = v[a] + v[b] + (x);       \
+        v[d] = ROTR64(v[d] ^ v[a], 32); \
+        v[c] = v[c] + v[d];             \
+        v[b] = ROTR64(v[b] ^ v[c], 24); \
+        v[a] = v[a] + v[b] + (y);       \
+        v[d] = ROTR64(v[d] ^ v[a], 16); \
+        v[c] = v[c] + v[d];             \
+        v[b] = ROTR64(v[b] ^ v[c], 63); \
+    } while (0)
+
+static void blake2b_compress(cx_blake2b_t *S, bool last) {
+    uint64_t v[16], m[16];
+    for (int i = 0; i < 8; i++) {
+        v[i] = S->h[i];
+        v[i + 8] = blake2b_iv[i];
+    }
+    v[12] ^= S->t[0];
+    v[13] ^= S->t[1];
+    if (last) {
+        v[14] = ~v[14];
+    }
+    for (int i = 0; i < 16; i++) {
+        m[i] = 0;
+        for (int j = 7; j >= 0; j--) {
+            m[i] = (m[i] << 8) | S->b[8 * i + j];
+        }
+    }
+    for (int i = 0; i < 12; i++) {
+        const uint8_t *s = blake2b_sigma[i];
+        B2B_G(0, 4, 8, 12, m[s[0]], m[s[1]]);
+        B2B_G(1, 5, 9, 13, m[s[2]], m[s[3]]);
+        B2B_G(2, 6, 10, 14, m[s[4]], m[s[5]]);
+        B2B_G(3, 7, 11, 15, m[s[6]], m[s[7]]);
+        B2B_G(0, 5, 10, 15, m[s[8]], m[s[9]]);
+        B2B_G(1, 6, 11, 12, m[s[10]], m[s[11]]);
+        B2B_G(2, 7, 8, 13, m[s[12]], m[s[13]]);
+        B2B_G(3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        S->h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+cx_err_t cx_blake2b_init_no_throw(cx_blake2b_t *S, size_t size) {
+    memset(S, 0, sizeof(cx_blake2b_t));
+    S->outlen = size / 8;
+    for (int i = 0; i < 8; i++) {
+        S->h[i] = blake2b_iv[i];
+    }
+    S->h[0] ^= 0x01010000 ^ S->outlen;
+    return CX_OK;
+}
+
+cx_err_t cx_hash_no_throw(cx_hash_t *hash,
+                          uint32_t mode,
+                          const uint8_t *in,
+                          size_t len,
+                          uint8_t *out,
+                          size_t out_len) {
+    cx_blake2b_t *S = (cx_blake2b_t *) hash;
+    for (size_t i = 0; i < len; i++) {
+        if (S->c == sizeof(S->b)) {
+            S->t[0] += S->c;
+            S->t[1] += (S->t[0] < S->c);
+            blake2b_compress(S, false);
+            S->c = 0;
+        }
+        S->b[S->c++] = in[i];
+    }
+    if (mode & CX_LAST) {
+        if (out_len < S->outlen) {
+            return -1;
+        }
+        S->t[0] += S->c;
+        S->t[1] += (S->t[0] < S->c);
+        memset(S->b + S->c, 0, sizeof(S->b) - S->c);
+        blake2b_compress(S, true);
+        for (size_t i = 0; i < S->outlen; i++) {
+            out[i] = (S->h[i / 8] >> (8 * (i % 8))) & 0xFF;
+        }
+    }
+    return CX_OK;
+}
+
+uint32_t cx_rng_u32(void) {
+    return (uint32_t) rand();
+}
+
+// keys are derived and used by the Go code in emulator.go
+
+cx_err_t os_derive_bip32_with_seed_no_throw(unsigned int derivation_mode,
+                                            int curve,
+                                            const uint32_t *path,
+                                            size_t path_len,
+                                            uint8_t raw_privkey[static 64],
+                                            uint8_t *chain_code,
+                                            unsigned char *seed,
+                                            size_t seed_len) {
+    UNUSED(derivation_mode);
+    UNUSED(curve);
+    UNUSED(seed);
+    UNUSED(seed_len);
+    memset(raw_privkey, 0, 64);
+    return emuDeriveNode((uint32_t *) path, path_len, raw_privkey, chain_code);
+}
+
+cx_err_t cx_hmac_sha512(const uint8_t *key,
+                        size_t key_len,
+                        const uint8_t *in,
+                        size_t len,
+                        uint8_t *mac,
+                        size_t mac_len) {
+    if (mac_len < 64) {
+        return -1;
+    }
+    emuHMACSHA512((uint8_t *) key, key_len, (uint8_t *) in, len, mac);
+    return CX_OK;
+}
+
+cx_err_t cx_ecfp_init_private_key_no_throw(int curve,
+                                           const uint8_t *raw_key,
+                                           size_t key_len,
+                                           cx_ecfp_private_key_t *pvkey) {
+    if (key_len != sizeof(pvkey->d)) {
+        return -1;
+    }
+    pvkey->curve = curve;
+    pvkey->d_len = key_len;
+    memmove(pvkey->d, raw_key, key_len);
+    return CX_OK;
+}
+
+cx_err_t cx_ecfp_generate_pair_no_throw(int curve,
+                                        cx_ecfp_public_key_t *pubkey,
+                                        cx_ecfp_private_key_t *privkey,
+                                        bool keepprivate) {
+    UNUSED(keepprivate);
+    pubkey->curve = curve;
+    pubkey->W_len = sizeof(pubkey->W);
+    emuPublicKey(privkey->d, pubkey->W);
+    return CX_OK;
+}
+
+cx_err_t cx_eddsa_sign_no_throw(const cx_ecfp_private_key_t *pvkey,
+                                int hashID,
+                                const uint8_t *hash,
+                                size_t hash_len,
+                                uint8_t *sig,
+                                size_t sig_len) {
+    UNUSED(hashID);
+    if (sig_len < 64) {
+        return -1;
+    }
+    emuSign((uint8_t *) pvkey->d, (uint8_t *) hash, hash_len, sig);
+    return CX_OK;
+}
+
+void U2BE_ENCODE(uint8_t *buf, size_t off, uint16_t value) {
+    buf[off + 0] = value >> 8;
+    buf[off + 1] = value;
+}
+
+void U4BE_ENCODE(uint8_t *buf, size_t off, uint32_t value) {
+    buf[off + 0] = value >> 24;
+    buf[off + 1] = value >> 16;
+    buf[off + 2] = value >> 8;
+    buf[off + 3] = value;
+}
+
+void U4LE_ENCODE(uint8_t *buf, size_t off, uint32_t value) {
+    buf[off + 0] = value;
+    buf[off + 1] = value >> 8;
+    buf[off + 2] = value >> 16;
+    buf[off + 3] = value >> 24;
+}
+
+void *emu_pic(const void *addr) {
+    return (void *) addr;
+}
+
+void nvm_write(void *dst, void *src, unsigned int len) {
+    memmove(dst, src, len);
+}
+
+void os_sched_exit(int code) {
+    exit(code);
+}
+
+// io
+
+int io_send_response_buffers(const buffer_t *rdatalist, size_t count, uint16_t sw) {
+    if (resp_sent) {
+        return -1;
+    }
+    resp_sent = true;
+    resp_len = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t n = rdatalist[i].size - rdatalist[i].offset;
+        if (resp_len + n > EMU_MAX_RESPONSE - 2) {
+            n = EMU_MAX_RESPONSE - 2 - resp_len;
+        }
+        memmove(resp_buf + resp_len, rdatalist[i].ptr + rdatalist[i].offset, n);
+        resp_len += n;
+    }
+    U2BE_ENCODE(resp_buf, resp_len, sw);
+    resp_len += 2;
+    return 0;
+}
+
+int io_send_response_pointer(const uint8_t *ptr, size_t size, uint16_t sw) {
+    const buffer_t buf = {.ptr = ptr, .size = size, .offset = 0};
+    return io_send_response_buffers(&buf, 1, sw);
+}
+
+int io_send_sw(uint16_t sw) {
+    return io_send_response_buffers(NULL, 0, sw);
+}
+
+// ui
+
+void ui_idle(void) {
+    uiBusy = false;
+}
+
+void ui_menu_about(void) {
+}
+
+unsigned int io_reject(void) {
+    io_send_sw(SW_USER_REJECTED);
+    ui_idle();
+    return 0;
+}
+
+void nbgl_useCaseStatus(const char *message, bool isSuccess, nbgl_callback_t quitCallback) {
+    UNUSED(message);
+    UNUSED(isSuccess);
+    UNUSED(quitCallback);
+}
+
+void nbgl_useCaseReviewStatus(nbgl_reviewStatusType_t reviewStatusType,
+                              nbgl_callback_t quitCallback) {
+    UNUSED(reviewStatusType);
+    UNUSED(quitCallback);
+}
+
+void nbgl_useCaseReviewStart(const nbgl_icon_details_t *icon,
+                             const char *reviewTitle,
+                             const char *reviewSubTitle,
+                             const char *rejectText,
+                             nbgl_callback_t continueCallback,
+                             nbgl_callback_t rejectCallback) {
+    UNUSED(icon);
+    UNUSED(reviewTitle);
+    UNUSED(reviewSubTitle);
+    UNUSED(rejectText);
+    UNUSED(rejectCallback);
+    continueCallback();
+}
+
+void nbgl_useCaseRegularReview(uint8_t initPage,
+                               uint8_t nbPages,
+                               const char *rejectText,
+                               nbgl_layoutTouchCallback_t buttonCallback,
+                               nbgl_navCallback_t navCallback,
+                               nbgl_choiceCallback_t choiceCallback) {
+    UNUSED(rejectText);
+    UNUSED(buttonCallback);
+    // visit every page, so that formatting is exercised as it would be on
+    // the device
+    nbgl_pageContent_t content = {0};
+    for (uint8_t page = initPage; page < nbPages; page++) {
+        memset(&content, 0, sizeof(content));
+        if (!navCallback(page, &content)) {
+            choiceCallback(false);
+            return;
+        }
+    }
+    // A review that is still receiving its elements cannot be approved yet;
+    // the app redraws it once they arrive.
+    if (content.type == INFO_LONG_PRESS) {
+        choiceCallback(true);
+    }
+}
+
+void nbgl_useCaseReview(nbgl_operationType_t operationType,
+                        const nbgl_layoutTagValueList_t *tagValueList,
+                        const nbgl_icon_details_t *icon,
+                        const char *reviewTitle,
+                        const char *reviewSubTitle,
+                        const char *finishTitle,
+                        nbgl_choiceCallback_t choiceCallback) {
+    UNUSED(operationType);
+    UNUSED(tagValueList);
+    UNUSED(icon);
+    UNUSED(reviewTitle);
+    UNUSED(reviewSubTitle);
+    UNUSED(finishTitle);
+    choiceCallback(true);
+}
+
+void nbgl_useCaseAddressReview(const char *address,
+                               const nbgl_layoutTagValueList_t *additionalTagValueList,
+                               const nbgl_icon_details_t *icon,
+                               const char *reviewTitle,
+                               const char *reviewSubTitle,
+                               nbgl_choiceCallback_t choiceCallback) {
+    UNUSED(address);
+    UNUSED(additionalTagValueList);
+    UNUSED(icon);
+    UNUSED(reviewTitle);
+    UNUSED(reviewSubTitle);
+    choiceCallback(true);
+}
+
+void nbgl_useCaseChoice(const nbgl_icon_details_t *icon,
+                        const char *message,
+                        const char *subMessage,
+                        const char *confirmText,
+                        const char *rejectString,
+                        nbgl_choiceCallback_t callback) {
+    UNUSED(icon);
+    UNUSED(message);
+    UNUSED(subMessage);
+    UNUSED(confirmText);
+    UNUSED(rejectString);
+    callback(true);
+}
+
+// dispatch
+
+// These must match the instruction codes in app_main.c.
+#define INS_GET_VERSION     0x01
+#define INS_GET_PUBLIC_KEY  0x02
+#define INS_SIGN_HASH       0x04
+#define INS_GET_TXN_HASH    0x08
+#define INS_SIGN_TXN_BATCH  0x10
+#define INS_SIGN_MESSAGE    0x12
+#define INS_SET_POLICY      0x13
+#define INS_ADD_TRUSTED     0x14
+#define INS_CLEAR_TEMPLATES 0x15
+
+typedef uint16_t handler_fn_t(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t dataLength);
+
+handler_fn_t handleGetVersion;
+handler_fn_t handleGetPublicKey;
+handler_fn_t handleSignHash;
+handler_fn_t handleCalcTxnHash;
+handler_fn_t handleSignTxnBatch;
+handler_fn_t handleSignMessage;
+handler_fn_t handleSetPolicy;
+handler_fn_t handleAddTrusted;
+handler_fn_t handleClearTemplates;
+
+static handler_fn_t *lookupHandler(uint8_t ins) {
+    switch (ins) {
+        case INS_GET_VERSION:
+            return handleGetVersion;
+        case INS_GET_PUBLIC_KEY:
+            return handleGetPublicKey;
+        case INS_SIGN_HASH:
+            return handleSignHash;
+        case INS_GET_TXN_HASH:
+            return handleCalcTxnHash;
+        case INS_SIGN_TXN_BATCH:
+            return handleSignTxnBatch;
+        case INS_SIGN_MESSAGE:
+            return handleSignMessage;
+        case INS_SET_POLICY:
+            return handleSetPolicy;
+        case INS_ADD_TRUSTED:
+            return handleAddTrusted;
+        case INS_CLEAR_TEMPLATES:
+            return handleClearTemplates;
+        default:
+            return NULL;
+    }
+}
+
+// contextIns is the INS of the command whose state is held in global.
+static uint8_t contextIns;
+
+// usesContext and claimContext guard global as in app_main.c.
+static bool usesContext(uint8_t ins) {
+    return ins != INS_GET_VERSION && ins != INS_CLEAR_TEMPLATES;
+}
+
+static uint16_t claimContext(uint8_t ins, uint8_t p1) {
+    if (!usesContext(ins)) {
+        return 0;
+    } else if (uiBusy) {
+        if (ins != contextIns || (p1 != P1_MORE && p1 != P1_RESUME)) {
+            return SW_IMPROPER_INIT;
+        }
+        return 0;
+    }
+    if (ins != contextIns) {
+        explicit_bzero(&global, sizeof(global));
+        contextIns = ins;
+    }
+    return 0;
+}
+
+// send_error_code converts e to a status word, as in app_main.c.
+static void send_error_code(uint16_t e) {
+    switch (e & 0xF000) {
+        case 0x6000:
+        case 0x9000:
+            io_send_sw(e);
+            break;
+        default:
+            io_send_sw(0x6800 | (e & 0x7FF));
+            break;
+    }
+}
+
+void emu_reset(void) {
+    explicit_bzero(&global, sizeof(global));
+    contextIns = 0;
+    uiBusy = false;
+    clearKeyCache();
+}
+
+size_t emu_exchange(const uint8_t *apdu, size_t apdu_len, uint8_t resp[static EMU_MAX_RESPONSE]) {
+    // handlers may modify their input, so give them a copy, as the device
+    // does with G_io_apdu_buffer
+    uint8_t data[255];
+
+    resp_buf = resp;
+    resp_len = 0;
+    resp_sent = false;
+
+    if (apdu_len < 5 || apdu_len != 5 + (size_t) apdu[4]) {
+        io_send_sw(SW_INVALID_PARAM);
+        return resp_len;
+    }
+    memmove(data, apdu + 5, apdu[4]);
+
+    handler_fn_t *handlerFn = lookupHandler(apdu[1]);
+    if (!handlerFn) {
+        send_error_code(SW_INS_NOT_SUPPORTED);
+        return resp_len;
+    }
+    const uint16_t claimErr = claimContext(apdu[1], apdu[2]);
+    if (claimErr != 0) {
+        send_error_code(claimErr);
+        return resp_len;
+    }
+    const uint16_t e = handlerFn(apdu[2], apdu[3], data, apdu[4]);
+    if (e != 0) {
+        if (e != SW_OK) {
+            clearKeyCache();
+            if (uiBusy && usesContext(apdu[1])) {
+                explicit_bzero(&global, sizeof(global));
+                ui_idle();
+            }
+        }
+        send_error_code(e);
+    }
+    if (!resp_sent) {
+        // every review completes immediately, so a handler that returns
+        // without responding has a bug
+        send_error_code(SW_DEVELOPER_ERR);
+    }
+    return resp_len;
+}
@@ -0,0 +1,13 @@
+#ifndef EMU_BUFFER_H
+#define EMU_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const uint8_t *ptr;
+    size_t size;
+    size_t offset;
+} buffer_t;
+
+#endif /* EMU_BUFFER_H */
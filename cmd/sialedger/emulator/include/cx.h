@@ -0,0 +1,72 @@
+#ifndef EMU_CX_H
+#define EMU_CX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int cx_err_t;
+#define CX_OK   0
+#define CX_LAST 1
+
+#define CX_SHA512          5
+#define CX_CURVE_Ed25519   0x71
+#define HDW_ED25519_SLIP10 1
+
+typedef struct {
+    int algo;
+} cx_hash_t;
+
+typedef struct {
+    cx_hash_t header;
+    uint8_t b[128];
+    uint64_t h[8];
+    uint64_t t[2];
+    size_t c;
+    size_t outlen;
+} cx_blake2b_t;
+
+cx_err_t cx_blake2b_init_no_throw(cx_blake2b_t *hash, size_t size);
+cx_err_t cx_hash_no_throw(cx_hash_t *hash,
+                          uint32_t mode,
+                          const uint8_t *in,
+                          size_t len,
+                          uint8_t *out,
+                          size_t out_len);
+uint32_t cx_rng_u32(void);
+
+cx_err_t cx_hmac_sha512(const uint8_t *key,
+                        size_t key_len,
+                        const uint8_t *in,
+                        size_t len,
+                        uint8_t *mac,
+                        size_t mac_len);
+
+typedef struct {
+    int curve;
+    size_t d_len;
+    uint8_t d[32];
+} cx_ecfp_private_key_t;
+
+typedef struct {
+    int curve;
+    size_t W_len;
+    uint8_t W[65];
+} cx_ecfp_public_key_t;
+
+cx_err_t cx_ecfp_init_private_key_no_throw(int curve,
+                                           const uint8_t *raw_key,
+                                           size_t key_len,
+                                           cx_ecfp_private_key_t *pvkey);
+cx_err_t cx_ecfp_generate_pair_no_throw(int curve,
+                                        cx_ecfp_public_key_t *pubkey,
+                                        cx_ecfp_private_key_t *privkey,
+                                        bool keepprivate);
+cx_err_t cx_eddsa_sign_no_throw(const cx_ecfp_private_key_t *pvkey,
+                                int hashID,
+                                const uint8_t *hash,
+                                size_t hash_len,
+                                uint8_t *sig,
+                                size_t sig_len);
+
+#endif /* EMU_CX_H */
@@ -0,0 +1,8 @@
+#ifndef EMU_GLYPHS_H
+#define EMU_GLYPHS_H
+
+#include "nbgl_use_case.h"
+
+extern const nbgl_icon_details_t C_stax_app_sia_big;
+
+#endif /* EMU_GLYPHS_H */
@@ -0,0 +1,13 @@
+#ifndef EMU_IO_H
+#define EMU_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "buffer.h"
+
+int io_send_response_buffers(const buffer_t *rdatalist, size_t count, uint16_t sw);
+int io_send_response_pointer(const uint8_t *ptr, size_t size, uint16_t sw);
+int io_send_sw(uint16_t sw);
+
+#endif /* EMU_IO_H */
@@ -0,0 +1,13 @@
+#ifndef EMU_LEDGER_ASSERT_H
+#define EMU_LEDGER_ASSERT_H
+
+#include <stdlib.h>
+
+#define LEDGER_ASSERT(test, msg) \
+    do {                         \
+        if (!(test)) {           \
+            abort();             \
+        }                        \
+    } while (0)
+
+#endif /* EMU_LEDGER_ASSERT_H */
@@ -0,0 +1,128 @@
+// Host stand-ins for the NBGL use cases. The emulator's implementations
+// approve every review immediately, so the handlers run to completion within
+// a single command.
+
+#ifndef EMU_NBGL_USE_CASE_H
+#define EMU_NBGL_USE_CASE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+} nbgl_icon_details_t;
+
+typedef struct {
+    const char *item;
+    const char *value;
+} nbgl_layoutTagValue_t;
+
+typedef struct {
+    nbgl_layoutTagValue_t *pairs;
+    void *callback;
+    uint8_t nbPairs;
+    uint8_t startIndex;
+    uint8_t nbMaxLinesForValue;
+    bool smallCaseForValue;
+    bool wrapping;
+} nbgl_layoutTagValueList_t;
+
+typedef struct {
+    const nbgl_icon_details_t *icon;
+    const char *text;
+    const char *longPressText;
+} nbgl_contentInfoLongPress_t;
+
+typedef enum {
+    LARGE_CASE_INFO,
+} nbgl_contentCenteredInfoStyle_t;
+
+typedef struct {
+    const char *text1;
+    const char *text2;
+    const nbgl_icon_details_t *icon;
+    nbgl_contentCenteredInfoStyle_t style;
+} nbgl_contentCenteredInfo_t;
+
+typedef struct {
+    const char *text;
+    const nbgl_icon_details_t *icon;
+    const char *buttonText;
+    uint8_t buttonToken;
+} nbgl_contentInfoButton_t;
+
+typedef enum {
+    TAG_VALUE_LIST,
+    INFO_LONG_PRESS,
+    CENTERED_INFO,
+    INFO_BUTTON,
+} nbgl_contentType_t;
+
+typedef struct {
+    const char *title;
+    nbgl_contentType_t type;
+    union {
+        nbgl_layoutTagValueList_t tagValueList;
+        nbgl_contentInfoLongPress_t infoLongPress;
+        nbgl_contentCenteredInfo_t centeredInfo;
+        nbgl_contentInfoButton_t infoButton;
+    };
+} nbgl_pageContent_t;
+
+typedef enum {
+    STATUS_TYPE_TRANSACTION_SIGNED,
+    STATUS_TYPE_TRANSACTION_REJECTED,
+    STATUS_TYPE_ADDRESS_VERIFIED,
+    STATUS_TYPE_ADDRESS_REJECTED,
+} nbgl_reviewStatusType_t;
+
+typedef enum {
+    TYPE_TRANSACTION,
+    TYPE_MESSAGE,
+} nbgl_operationType_t;
+
+// tokens below this value are reserved for the use cases
+#define FIRST_USER_TOKEN 20
+
+typedef void (*nbgl_callback_t)(void);
+typedef void (*nbgl_layoutTouchCallback_t)(int token, uint8_t index);
+typedef void (*nbgl_choiceCallback_t)(bool confirm);
+typedef bool (*nbgl_navCallback_t)(uint8_t page, nbgl_pageContent_t *content);
+
+void nbgl_useCaseStatus(const char *message, bool isSuccess, nbgl_callback_t quitCallback);
+void nbgl_useCaseReviewStatus(nbgl_reviewStatusType_t reviewStatusType,
+                              nbgl_callback_t quitCallback);
+void nbgl_useCaseReviewStart(const nbgl_icon_details_t *icon,
+                             const char *reviewTitle,
+                             const char *reviewSubTitle,
+                             const char *rejectText,
+                             nbgl_callback_t continueCallback,
+                             nbgl_callback_t rejectCallback);
+void nbgl_useCaseRegularReview(uint8_t initPage,
+                               uint8_t nbPages,
+                               const char *rejectText,
+                               nbgl_layoutTouchCallback_t buttonCallback,
+                               nbgl_navCallback_t navCallback,
+                               nbgl_choiceCallback_t choiceCallback);
+void nbgl_useCaseReview(nbgl_operationType_t operationType,
+                        const nbgl_layoutTagValueList_t *tagValueList,
+                        const nbgl_icon_details_t *icon,
+                        const char *reviewTitle,
+                        const char *reviewSubTitle,
+                        const char *finishTitle,
+                        nbgl_choiceCallback_t choiceCallback);
+void nbgl_useCaseAddressReview(const char *address,
+                               const nbgl_layoutTagValueList_t *additionalTagValueList,
+                               const nbgl_icon_details_t *icon,
+                               const char *reviewTitle,
+                               const char *reviewSubTitle,
+                               nbgl_choiceCallback_t choiceCallback);
+void nbgl_useCaseChoice(const nbgl_icon_details_t *icon,
+                        const char *message,
+                        const char *subMessage,
+                        const char *confirmText,
+                        const char *rejectString,
+                        nbgl_choiceCallback_t callback);
+
+#endif /* EMU_NBGL_USE_CASE_H */
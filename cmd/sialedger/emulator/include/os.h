@@ -0,0 +1,70 @@
+// Host stand-ins for the parts of the Ledger SDK used by the Sia app. These
+// are just enough to build the command handlers into the Go client's
+// emulator; they are not a general replacement for the SDK.
+
+#ifndef EMU_OS_H
+#define EMU_OS_H
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// PIC is a function rather than a no-op, so that the compiler cannot assume
+// that N_storage still holds its initial value after nvm_write.
+void *emu_pic(const void *addr);
+#define PIC(x)      emu_pic((const void *) (x))
+#define UNUSED(x)   (void) (x)
+#define PRINTF(...) ((void) 0)
+
+#define U2LE(buf, off) ((uint16_t) ((buf)[off] | ((buf)[(off) + 1] << 8)))
+#define U4LE(buf, off)                                                          \
+    ((uint32_t) (buf)[off] | ((uint32_t) (buf)[(off) + 1] << 8) |               \
+     ((uint32_t) (buf)[(off) + 2] << 16) | ((uint32_t) (buf)[(off) + 3] << 24))
+#define U2BE(buf, off) ((uint16_t) (((buf)[off] << 8) | (buf)[(off) + 1]))
+#define U4BE(buf, off)                                                    \
+    (((uint32_t) (buf)[off] << 24) | ((uint32_t) (buf)[(off) + 1] << 16) | \
+     ((uint32_t) (buf)[(off) + 2] << 8) | (uint32_t) (buf)[(off) + 3])
+
+void U2BE_ENCODE(uint8_t *buf, size_t off, uint16_t value);
+void U4BE_ENCODE(uint8_t *buf, size_t off, uint32_t value);
+void U4LE_ENCODE(uint8_t *buf, size_t off, uint32_t value);
+
+// Exceptions are implemented with setjmp, as on the device.
+typedef unsigned short exception_t;
+typedef struct try_context_s {
+    jmp_buf jmp_buf;
+    struct try_context_s *previous;
+    exception_t ex;
+} try_context_t;
+extern try_context_t *G_try_last;
+
+#define THROW(x)                         \
+    do {                                 \
+        G_try_last->ex = (x);            \
+        longjmp(G_try_last->jmp_buf, 1); \
+    } while (0)
+#define BEGIN_TRY                       \
+    {                                   \
+        try_context_t __try;            \
+        __try.ex = 0;                   \
+        __try.previous = G_try_last;    \
+        G_try_last = &__try;
+#define TRY if (setjmp(__try.jmp_buf) == 0)
+#define CATCH_OTHER(e)                                                             \
+    else for (exception_t e = __try.ex, __once = (G_try_last = __try.previous, 1); \
+              __once;                                                              \
+              __once = 0)
+#define FINALLY G_try_last = __try.previous;
+#define END_TRY                      \
+    G_try_last = __try.previous;     \
+    }
+
+#define explicit_bzero(s, n) memset((s), 0, (n))
+
+void nvm_write(void *dst, void *src, unsigned int len);
+void os_sched_exit(int code);
+
+#endif /* EMU_OS_H */
@@ -0,0 +1,18 @@
+#ifndef EMU_OS_SEED_H
+#define EMU_OS_SEED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cx.h"
+
+cx_err_t os_derive_bip32_with_seed_no_throw(unsigned int derivation_mode,
+                                            int curve,
+                                            const uint32_t *path,
+                                            size_t path_len,
+                                            uint8_t raw_privkey[static 64],
+                                            uint8_t *chain_code,
+                                            unsigned char *seed,
+                                            size_t seed_len);
+
+#endif /* EMU_OS_SEED_H */
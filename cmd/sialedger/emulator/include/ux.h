@@ -0,0 +1,6 @@
+#ifndef EMU_UX_H
+#define EMU_UX_H
+
+#include "nbgl_use_case.h"
+
+#endif /* EMU_UX_H */
@@ -0,0 +1 @@
+#include "../../../src/policy.c"
@@ -0,0 +1 @@
+#include "../../../src/sia.c"
@@ -0,0 +1 @@
+#include "../../../src/signHash.c"
@@ -0,0 +1 @@
+#include "../../../src/signMessage.c"
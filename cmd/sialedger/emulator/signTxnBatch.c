@@ -0,0 +1 @@
+#include "../../../src/signTxnBatch.c"
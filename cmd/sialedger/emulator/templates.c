@@ -0,0 +1 @@
+#include "../../../src/templates.c"
@@ -0,0 +1 @@
+#include "../../../src/trusted.c"
@@ -0,0 +1 @@
+#include "../../../src/txn.c"
@@ -0,0 +1,23 @@
+//go:build emulator
+
+package main
+
+import "sialedger/cmd/sialedger/emulator"
+
+type emulatorExchanger struct {
+	dev *emulator.Device
+}
+
+func (e emulatorExchanger) Exchange(apdu APDU) ([]byte, error) {
+	if len(apdu.Payload) > 255 {
+		panic("APDU payload cannot exceed 255 bytes")
+	}
+	return e.dev.Exchange(apdu.Encode())
+}
+
+// OpenEmulator returns a Nano backed by an in-process emulator of the Sia
+// app, whose keys are derived from seed. Every request is approved
+// automatically.
+func OpenEmulator(seed []byte) (*Nano, error) {
+	return &Nano{ex: emulatorExchanger{emulator.Open(seed)}}, nil
+}
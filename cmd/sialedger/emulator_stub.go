@@ -0,0 +1,10 @@
+//go:build !emulator
+
+package main
+
+import "errors"
+
+// OpenEmulator is only available when built with the emulator tag.
+func OpenEmulator(seed []byte) (*Nano, error) {
+	return nil, errors.New("sialedger was built without emulator support (rebuild with -tags emulator)")
+}
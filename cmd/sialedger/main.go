@@ -2,6 +2,7 @@ package main
 
 import (
 	"bytes"
+	"context"
 	"encoding/base64"
 	"encoding/binary"
 	"encoding/hex"
@@ -13,7 +14,10 @@ import (
 	"math"
 	"net"
 	"os"
+	"os/signal"
 	"strconv"
+	"syscall"
+	"time"
 
 	"github.com/bearsh/hid"
 	"go.sia.tech/core/types"
@@ -156,6 +160,27 @@ func (e *tcpExchanger) Exchange(apdu APDU) ([]byte, error) {
 
 type Nano struct {
 	ex apduExchanger
+	// reopen, if set, reconnects to the device after a transport failure.
+	reopen func() (apduExchanger, error)
+	// zeroRLE enables zero-run encoding of transaction data.
+	zeroRLE bool
+	// summary requests that transactions be reviewed by destination, if the
+	// device supports it.
+	summary bool
+	// noReview requests that transaction hashes be returned without a
+	// review. Signatures are always reviewed.
+	noReview bool
+	// template, if set, is the label under which the outputs of signed
+	// transactions are saved as a payout template once the user approves
+	// them.
+	template string
+	// chunkLen, if nonzero, limits the data bytes sent per APDU to less than
+	// the device accepts.
+	chunkLen int
+	// caps, if set, are the capabilities reported by the device.
+	caps *Capabilities
+	// metrics, if set, records every exchange with the device.
+	metrics *Metrics
 }
 
 type ErrCode uint16
@@ -171,14 +196,32 @@ const codeInvalidParam = 0x6b01
 var errUserRejected = errors.New("user denied request")
 var errInvalidParam = errors.New("invalid request parameters")
 
+// isTransportError reports whether err was caused by the connection to the
+// device, rather than being a status code sent by the device.
+func isTransportError(err error) bool {
+	var code ErrCode
+	return !errors.As(err, &code) && err != errUserRejected && err != errInvalidParam
+}
+
 func (n *Nano) Exchange(cmd byte, p1, p2 byte, data []byte) (resp []byte, err error) {
-	resp, err = n.ex.Exchange(APDU{
+	return n.exchange(phaseResponse, cmd, p1, p2, data)
+}
+
+// exchange is like Exchange, but records the exchange as part of the
+// specified phase of the command.
+func (n *Nano) exchange(phase string, cmd byte, p1, p2 byte, data []byte) (resp []byte, err error) {
+	apdu := APDU{
 		CLA:     0xe0,
 		INS:     cmd,
 		P1:      p1,
 		P2:      p2,
 		Payload: data,
-	})
+	}
+	start := time.Now()
+	defer func() {
+		n.metrics.recordExchange(apdu, phase, start, time.Since(start), len(resp), err)
+	}()
+	resp, err = n.ex.Exchange(apdu)
 	if err != nil {
 		return nil, err
 	} else if len(resp) < 2 {
@@ -204,14 +247,60 @@ const (
 	cmdGetPublicKey = 0x02
 	cmdSignHash     = 0x04
 	cmdCalcTxnHash  = 0x08
+	cmdSignTxnBatch = 0x10
+	cmdStackUsage   = 0x11
+	cmdSignMessage  = 0x12
+	cmdSetPolicy    = 0x13
+	cmdAddTrusted   = 0x14
+	cmdClearTmpls   = 0x15
+
+	p1First  = 0x00
+	p1More   = 0x80
+	p1Resume = 0x40
+
+	p1BatchReview = 0x01
+	p1BatchSig    = 0x02
+
+	p1StackReset = 0x01
+
+	p1Capabilities = 0x01
+
+	p1NoDisplay = 0x01
+
+	capZeroRLE      = 1 << 0
+	capResume       = 1 << 1
+	capPartialCover = 1 << 2
+	capTxnID        = 1 << 3
+	capBatch        = 1 << 4
+	capSignMessage  = 1 << 5
+	capPolicy       = 1 << 6
+	capStackProfile = 1 << 7
+	capChangeRange  = 1 << 8
+	capTrusted      = 1 << 9
+	capSummary      = 1 << 10
+	capNoReview     = 1 << 11
+	capKeyBatch     = 1 << 12
+	capTemplates    = 1 << 13
 
-	p1First = 0x00
-	p1More  = 0x80
+	p1PolicyReview = 0x01
+	p1PolicyClear  = 0x02
+
+	policyFlagConfirm = 0x01
+
+	p1TrustedReview = 0x01
+	p1TrustedClear  = 0x02
 
 	p2DisplayAddress = 0x00
 	p2DisplayPubkey  = 0x01
 	p2DisplayHash    = 0x00
 	p2SignHash       = 0x01
+	p2ZeroRLE        = 0x02
+	p2PartialCover   = 0x04
+	p2TxnID          = 0x08
+	p2ChangeRange    = 0x10
+	p2Summary        = 0x20
+	p2NoReview       = 0x40
+	p2SaveTemplate   = 0x80
 )
 
 func (n *Nano) GetVersion() (version string, err error) {
@@ -224,11 +313,166 @@ func (n *Nano) GetVersion() (version string, err error) {
 	return fmt.Sprintf("v%d.%d.%d", resp[0], resp[1], resp[2]), nil
 }
 
+// Capabilities are the protocol features and limits supported by the app.
+type Capabilities struct {
+	Version         string
+	ZeroRLE         bool   // GET_TXN_HASH accepts zero-run encoded data
+	Resume          bool   // GET_TXN_HASH transfers can be resumed
+	PartialCover    bool   // GET_TXN_HASH accepts partial signatures
+	TxnID           bool   // GET_TXN_HASH can return the transaction ID
+	Batch           bool   // SIGN_TXN_BATCH is supported
+	SignMessage     bool   // SIGN_MESSAGE is supported
+	Policy          bool   // SET_POLICY is supported
+	StackProfile    bool   // GET_STACK_USAGE is supported
+	ChangeRange     bool   // GET_TXN_HASH accepts a range of change indices
+	Trusted         bool   // ADD_TRUSTED is supported
+	Summary         bool   // GET_TXN_HASH can review totals per destination
+	NoReview        bool   // GET_TXN_HASH can return the hash without a review
+	KeyBatch        bool   // GET_PUBLIC_KEY can return keys without display
+	Templates       bool   // GET_TXN_HASH can save and match payout templates
+	MaxChunkLen     int    // maximum data bytes per APDU
+	MaxElems        int    // maximum displayed elements per transaction
+	ElemTypes       uint16 // element types accepted by GET_TXN_HASH, as bits
+	MaxCoveredElems int
+	MaxBatchTxns    int
+	MaxBatchDests   int
+	MaxPolicyDests  int
+	MaxChangeAddrs  int
+	MaxTrustedAdds  int // maximum trusted addresses added per review
+	MaxKeyBatch     int // maximum public keys returned without display
+	MaxTemplates    int // maximum payout templates stored
+}
+
+// GetCapabilities returns the capabilities of the app. Versions of the app
+// that predate capability reporting only return their version; for these,
+// only the features that every version supports are reported.
+func (n *Nano) GetCapabilities() (Capabilities, error) {
+	resp, err := n.Exchange(cmdGetVersion, p1Capabilities, 0, nil)
+	if err != nil {
+		return Capabilities{}, err
+	} else if len(resp) == 3 {
+		return Capabilities{
+			Version:     fmt.Sprintf("v%d.%d.%d", resp[0], resp[1], resp[2]),
+			MaxChunkLen: 255,
+			MaxElems:    20, // the Nano S limit
+			// inputs, outputs, miner fees, and signatures
+			ElemTypes: 1<<0 | 1<<1 | 1<<5 | 1<<6 | 1<<7 | 1<<9,
+		}, nil
+	} else if len(resp) < 17 {
+		return Capabilities{}, errors.New("capabilities have wrong length")
+	}
+	flags := binary.LittleEndian.Uint32(resp[3:])
+	caps := Capabilities{
+		Version:         fmt.Sprintf("v%d.%d.%d", resp[0], resp[1], resp[2]),
+		ZeroRLE:         flags&capZeroRLE != 0,
+		Resume:          flags&capResume != 0,
+		PartialCover:    flags&capPartialCover != 0,
+		TxnID:           flags&capTxnID != 0,
+		Batch:           flags&capBatch != 0,
+		SignMessage:     flags&capSignMessage != 0,
+		Policy:          flags&capPolicy != 0,
+		StackProfile:    flags&capStackProfile != 0,
+		ChangeRange:     flags&capChangeRange != 0,
+		Trusted:         flags&capTrusted != 0,
+		Summary:         flags&capSummary != 0,
+		NoReview:        flags&capNoReview != 0,
+		KeyBatch:        flags&capKeyBatch != 0,
+		Templates:       flags&capTemplates != 0,
+		MaxChunkLen:     int(binary.LittleEndian.Uint16(resp[7:])),
+		MaxElems:        int(binary.LittleEndian.Uint16(resp[9:])),
+		ElemTypes:       binary.LittleEndian.Uint16(resp[11:]),
+		MaxCoveredElems: int(resp[13]),
+		MaxBatchTxns:    int(resp[14]),
+		MaxBatchDests:   int(resp[15]),
+		MaxPolicyDests:  int(resp[16]),
+	}
+	// limits added in later versions
+	if len(resp) >= 18 {
+		caps.MaxChangeAddrs = int(resp[17])
+	}
+	if len(resp) >= 19 {
+		caps.MaxTrustedAdds = int(resp[18])
+	}
+	if len(resp) >= 20 {
+		caps.MaxKeyBatch = int(resp[19])
+	}
+	if len(resp) >= 21 {
+		caps.MaxTemplates = int(resp[20])
+	}
+	return caps, nil
+}
+
+// Negotiate queries the capabilities of the app and configures n to use the
+// fastest protocol they allow.
+func (n *Nano) Negotiate() error {
+	caps, err := n.GetCapabilities()
+	if err != nil {
+		return err
+	}
+	n.caps = &caps
+	n.zeroRLE = caps.ZeroRLE
+	return nil
+}
+
+// capabilities returns the capabilities reported by the device, or the zero
+// value if they have not been negotiated.
+func (n *Nano) capabilities() Capabilities {
+	if n.caps == nil {
+		return Capabilities{}
+	}
+	return *n.caps
+}
+
+// maxChunkLen returns the number of data bytes to send per APDU.
+func (n *Nano) maxChunkLen() int {
+	max := 255
+	if n.caps != nil && n.caps.MaxChunkLen > 0 && n.caps.MaxChunkLen < 255 {
+		max = n.caps.MaxChunkLen
+	}
+	if n.chunkLen > 0 && n.chunkLen < max {
+		return n.chunkLen
+	}
+	return max
+}
+
+// StackUsage is the deepest stack use measured for a command, in bytes, by
+// an app built with STACK_PROFILE=1.
+type StackUsage struct {
+	INS     byte
+	Handler uint16 // in the command handler
+	UX      uint16 // in UX callbacks, after the handler returned
+}
+
+// GetStackUsage returns the size of the stack and the deepest stack use
+// measured for each command so far. If reset is true, the measurements are
+// then cleared.
+func (n *Nano) GetStackUsage(reset bool) (size uint16, usage []StackUsage, err error) {
+	var p1 byte
+	if reset {
+		p1 = p1StackReset
+	}
+	resp, err := n.Exchange(cmdStackUsage, p1, 0, nil)
+	if err != nil {
+		return 0, nil, err
+	} else if len(resp) < 2 || (len(resp)-2)%5 != 0 {
+		return 0, nil, errors.New("stack usage has wrong length")
+	}
+	size = binary.LittleEndian.Uint16(resp)
+	for b := resp[2:]; len(b) > 0; b = b[5:] {
+		usage = append(usage, StackUsage{
+			INS:     b[0],
+			Handler: binary.LittleEndian.Uint16(b[1:]),
+			UX:      binary.LittleEndian.Uint16(b[3:]),
+		})
+	}
+	return size, usage, nil
+}
+
 func (n *Nano) GetPublicKey(index uint32) (pubkey [32]byte, err error) {
 	encIndex := make([]byte, 4)
 	binary.LittleEndian.PutUint32(encIndex, index)
 
-	resp, err := n.Exchange(cmdGetPublicKey, 0, p2DisplayPubkey, encIndex)
+	resp, err := n.exchange(phaseAwaitUser, cmdGetPublicKey, 0, p2DisplayPubkey, encIndex)
 	if err != nil {
 		return [32]byte{}, err
 	}
@@ -242,7 +486,7 @@ func (n *Nano) GetAddress(index uint32) (addr types.Address, err error) {
 	encIndex := make([]byte, 4)
 	binary.LittleEndian.PutUint32(encIndex, index)
 
-	resp, err := n.Exchange(cmdGetPublicKey, 0, p2DisplayAddress, encIndex)
+	resp, err := n.exchange(phaseAwaitUser, cmdGetPublicKey, 0, p2DisplayAddress, encIndex)
 	if err != nil {
 		return types.Address{}, err
 	}
@@ -250,11 +494,40 @@ func (n *Nano) GetAddress(index uint32) (addr types.Address, err error) {
 	return
 }
 
+// GetPublicKeys returns the public keys of count consecutive key indices,
+// starting at index, without displaying them. As many keys are requested per
+// exchange as the device allows.
+func (n *Nano) GetPublicKeys(index uint32, count int) ([]types.PublicKey, error) {
+	caps := n.capabilities()
+	if !caps.KeyBatch {
+		return nil, errors.New("device cannot return public keys without display")
+	} else if uint64(index)+uint64(count) > math.MaxUint32+1 {
+		return nil, errors.New("key index out of range")
+	}
+	perExchange := max(caps.MaxKeyBatch, 1)
+	pubkeys := make([]types.PublicKey, 0, count)
+	for len(pubkeys) < count {
+		batch := min(count-len(pubkeys), perExchange)
+		req := binary.LittleEndian.AppendUint32(nil, index+uint32(len(pubkeys)))
+		req = append(req, byte(batch))
+		resp, err := n.Exchange(cmdGetPublicKey, p1NoDisplay, p2DisplayPubkey, req)
+		if err != nil {
+			return nil, err
+		} else if len(resp) != 32*batch {
+			return nil, errors.New("pubkeys have wrong length")
+		}
+		for i := 0; i < batch; i++ {
+			pubkeys = append(pubkeys, types.PublicKey(resp[32*i:32*(i+1)]))
+		}
+	}
+	return pubkeys, nil
+}
+
 func (n *Nano) SignHash(hash [32]byte, keyIndex uint32) (sig [64]byte, err error) {
 	encIndex := make([]byte, 4)
 	binary.LittleEndian.PutUint32(encIndex, keyIndex)
 
-	resp, err := n.Exchange(cmdSignHash, 0, 0, append(encIndex, hash[:]...))
+	resp, err := n.exchange(phaseAwaitUser, cmdSignHash, 0, 0, append(encIndex, hash[:]...))
 	if err != nil {
 		return [64]byte{}, err
 	}
@@ -264,63 +537,582 @@ func (n *Nano) SignHash(hash [32]byte, keyIndex uint32) (sig [64]byte, err error
 	return
 }
 
-func (n *Nano) CalcTxnHash(txn types.Transaction, sigIndex uint16, changeIndex uint32) (hash [32]byte, err error) {
-	buf := bytes.NewBuffer(nil)
-	binary.Write(buf, binary.LittleEndian, uint32(0)) // keyIndex; ignored since we are not signing
-	binary.Write(buf, binary.LittleEndian, sigIndex)
-	binary.Write(buf, binary.LittleEndian, changeIndex)
-	enc := types.NewEncoder(buf)
-	txn.EncodeTo(enc)
-	if err := enc.Flush(); err != nil {
-		return [32]byte{}, fmt.Errorf("couldn't encode transaction: %w", err)
+// SignMessage streams msg to the device, which hashes it and asks the user to
+// approve signing the hash with the specified key.
+func (n *Nano) SignMessage(msg []byte, keyIndex uint32) (sig [64]byte, err error) {
+	if uint64(len(msg)) > math.MaxUint32 {
+		return [64]byte{}, errors.New("message is too long")
 	}
+	buf := bytes.NewBuffer(nil)
+	binary.Write(buf, binary.LittleEndian, keyIndex)
+	binary.Write(buf, binary.LittleEndian, uint32(len(msg)))
+	buf.Write(msg)
 
 	var resp []byte
-	for buf.Len() > 0 {
-		var p1 byte = p1More
-		if resp == nil {
-			p1 = p1First
+	for p1 := byte(p1First); ; p1 = p1More {
+		phase := phaseStream
+		if buf.Len() <= n.maxChunkLen() {
+			phase = phaseAwaitUser
 		}
-		resp, err = n.Exchange(cmdCalcTxnHash, p1, p2DisplayHash, buf.Next(255))
+		resp, err = n.exchange(phase, cmdSignMessage, p1, 0, buf.Next(n.maxChunkLen()))
 		if err != nil {
-			return [32]byte{}, err
+			return [64]byte{}, err
+		} else if buf.Len() == 0 {
+			break
 		}
 	}
-	if copy(hash[:], resp) != len(hash) {
-		return [32]byte{}, errors.New("hash has wrong length")
+	if copy(sig[:], resp) != len(sig) {
+		return [64]byte{}, errors.New("signature has wrong length")
 	}
 	return
 }
 
-func (n *Nano) SignTxn(txn types.Transaction, sigIndex uint16, keyIndex, changeIndex uint32) (sig [64]byte, err error) {
+// A Policy allows transactions to be signed with a single confirmation, or
+// none, instead of a full review, provided that they only send siacoins to
+// the listed destinations, within the specified limits. The session limit
+// applies to the total signed under the policy since the app was opened.
+type Policy struct {
+	KeyIndex      uint32          `json:"keyIndex"`
+	Confirm       bool            `json:"confirm"`
+	MaxPerTxn     types.Currency  `json:"maxPerTxn"`
+	MaxPerSession types.Currency  `json:"maxPerSession"`
+	MaxFee        types.Currency  `json:"maxFee"`
+	Destinations  []types.Address `json:"destinations"`
+}
+
+// encodeCurrency encodes c as the device expects: a length byte followed by
+// the big-endian value, without leading zeros.
+func encodeCurrency(c types.Currency) []byte {
+	var b [16]byte
+	binary.BigEndian.PutUint64(b[:8], c.Hi)
+	binary.BigEndian.PutUint64(b[8:], c.Lo)
+	v := bytes.TrimLeft(b[:], "\x00")
+	return append([]byte{byte(len(v))}, v...)
+}
+
+// SetPolicy sends p to the device, which displays it for approval. If the
+// user approves, it replaces any existing policy.
+func (n *Nano) SetPolicy(p Policy) error {
+	if len(p.Destinations) == 0 {
+		return errors.New("policy must allow at least one destination")
+	}
+	var flags byte
+	if p.Confirm {
+		flags |= policyFlagConfirm
+	}
+	buf := bytes.NewBuffer(nil)
+	binary.Write(buf, binary.LittleEndian, p.KeyIndex)
+	buf.WriteByte(flags)
+	buf.Write(encodeCurrency(p.MaxPerTxn))
+	buf.Write(encodeCurrency(p.MaxPerSession))
+	buf.Write(encodeCurrency(p.MaxFee))
+
+	// destinations may not be split across packets
+	dests := p.Destinations
+	for len(dests) > 0 && buf.Len()+32 <= n.maxChunkLen() {
+		buf.Write(dests[0][:])
+		dests = dests[1:]
+	}
+	if _, err := n.exchange(phaseStream, cmdSetPolicy, p1First, 0, buf.Bytes()); err != nil {
+		return err
+	}
+	for len(dests) > 0 {
+		buf.Reset()
+		for len(dests) > 0 && buf.Len()+32 <= n.maxChunkLen() {
+			buf.Write(dests[0][:])
+			dests = dests[1:]
+		}
+		if _, err := n.exchange(phaseStream, cmdSetPolicy, p1More, 0, buf.Bytes()); err != nil {
+			return err
+		}
+	}
+	_, err := n.exchange(phaseAwaitUser, cmdSetPolicy, p1PolicyReview, 0, nil)
+	return err
+}
+
+// ClearPolicy removes the policy stored on the device, if any. No review is
+// required.
+func (n *Nano) ClearPolicy() error {
+	_, err := n.Exchange(cmdSetPolicy, p1PolicyClear, 0, nil)
+	return err
+}
+
+// A TrustedAddress is an address that the device displays by its label
+// instead of in full. Labels are 1 to 15 printable ASCII characters.
+type TrustedAddress struct {
+	Address types.Address `json:"address"`
+	Label   string        `json:"label"`
+}
+
+// maxLabelLen is the maximum length of the label of a trusted address or a
+// payout template.
+const maxLabelLen = 15
+
+// checkLabel returns an error if the device cannot display label.
+func checkLabel(label string) error {
+	if len(label) == 0 || len(label) > maxLabelLen {
+		return fmt.Errorf("label %q must be 1 to %v characters", label, maxLabelLen)
+	}
+	for _, c := range []byte(label) {
+		if c < 0x20 || c > 0x7E {
+			return fmt.Errorf("label %q must be printable ASCII", label)
+		}
+	}
+	return nil
+}
+
+// AddTrusted sends addrs to the device, which displays them for approval a
+// few at a time. If the user approves, they are added to the trusted
+// addresses; an address that is already trusted is given the new label. If
+// the user rejects a review, the addresses of earlier reviews remain trusted.
+func (n *Nano) AddTrusted(addrs []TrustedAddress) error {
+	for _, ta := range addrs {
+		if err := checkLabel(ta.Label); err != nil {
+			return err
+		}
+	}
+	perReview := n.capabilities().MaxTrustedAdds
+	if perReview == 0 {
+		perReview = 4 // the Nano S limit
+	}
+	for len(addrs) > 0 {
+		review := addrs[:min(perReview, len(addrs))]
+		addrs = addrs[len(review):]
+
+		// addresses may not be split across packets
+		p1 := byte(p1First)
+		buf := bytes.NewBuffer(nil)
+		for i, ta := range review {
+			buf.Write(ta.Address[:])
+			buf.WriteByte(byte(len(ta.Label)))
+			buf.WriteString(ta.Label)
+			next := 0
+			if i+1 < len(review) {
+				next = 32 + 1 + len(review[i+1].Label)
+			}
+			if next == 0 || buf.Len()+next > n.maxChunkLen() {
+				if _, err := n.exchange(phaseStream, cmdAddTrusted, p1, 0, buf.Bytes()); err != nil {
+					return err
+				}
+				p1 = p1More
+				buf.Reset()
+			}
+		}
+		if _, err := n.exchange(phaseAwaitUser, cmdAddTrusted, p1TrustedReview, 0, nil); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// ClearTrusted removes every trusted address from the device. No review is
+// required.
+func (n *Nano) ClearTrusted() error {
+	_, err := n.Exchange(cmdAddTrusted, p1TrustedClear, 0, nil)
+	return err
+}
+
+// A ChangeRange is the Count consecutive key indices, starting at First, whose
+// addresses receive a transaction's change. Siacoin outputs sent to them are
+// not displayed for review. A Count of 0 is treated as 1.
+type ChangeRange struct {
+	First uint32
+	Count uint8
+}
+
+// NoChange indicates that a transaction has no change outputs.
+var NoChange = ChangeRange{First: math.MaxUint32}
+
+// SingleChange returns the range containing only index. If index is
+// math.MaxUint32, the transaction has no change outputs.
+func SingleChange(index uint32) ChangeRange {
+	return ChangeRange{First: index, Count: 1}
+}
+
+// encodedTxn is a transaction encoded for GET_TXN_HASH.
+type encodedTxn struct {
+	data   []byte // the header of the first packet, then the transaction
+	hdrLen int
+	p2     byte // the P2 flags that describe the header
+}
+
+// encodeTxn encodes the header of the first GET_TXN_HASH packet, followed by
+// the transaction itself. If the change range has more than one index, the
+// header includes its length. If the signature at sigIndex does not cover the
+// whole transaction, the header includes the list of covered elements.
+func encodeTxn(txn types.Transaction, keyIndex uint32, sigIndex uint16, change ChangeRange) (encodedTxn, error) {
+	var p2 byte
 	buf := bytes.NewBuffer(nil)
 	binary.Write(buf, binary.LittleEndian, keyIndex)
 	binary.Write(buf, binary.LittleEndian, sigIndex)
-	binary.Write(buf, binary.LittleEndian, changeIndex)
+	binary.Write(buf, binary.LittleEndian, change.First)
+	if change.Count > 1 {
+		p2 |= p2ChangeRange
+		buf.WriteByte(change.Count)
+	}
+	if int(sigIndex) < len(txn.Signatures) && !txn.Signatures[sigIndex].CoveredFields.WholeTransaction {
+		covered, err := encodeCoveredFields(txn.Signatures[sigIndex].CoveredFields)
+		if err != nil {
+			return encodedTxn{}, err
+		}
+		p2 |= p2PartialCover
+		buf.Write(covered)
+	}
+	hdrLen := buf.Len()
 	enc := types.NewEncoder(buf)
 	txn.EncodeTo(enc)
 	if err := enc.Flush(); err != nil {
-		return [64]byte{}, fmt.Errorf("couldn't encode transaction: %w", err)
+		return encodedTxn{}, fmt.Errorf("couldn't encode transaction: %w", err)
 	}
+	return encodedTxn{buf.Bytes(), hdrLen, p2}, nil
+}
 
-	var resp []byte
-	for buf.Len() > 0 {
-		var p1 byte = p1More
-		if resp == nil {
-			p1 = p1First
+// prepareTxn checks that the device will accept txn, so that a doomed
+// transaction is rejected before anything is sent, and then encodes it as
+// encodeTxn does. sign reports whether the transaction will be signed.
+func (n *Nano) prepareTxn(txn types.Transaction, keyIndex uint32, sigIndex uint16, change ChangeRange, sign bool) (encodedTxn, error) {
+	caps := n.capabilities()
+	if n.noReview && !sign {
+		// nothing is displayed, so the number of elements is not limited
+		caps.MaxElems = 0
+	}
+	if err := ValidateTxn(txn, sigIndex, change, caps); err != nil {
+		return encodedTxn{}, fmt.Errorf("device would reject transaction: %w", err)
+	}
+	et, err := encodeTxn(txn, keyIndex, sigIndex, change)
+	if err != nil || !sign || n.template == "" {
+		return et, err
+	} else if !caps.Templates {
+		return encodedTxn{}, errors.New("device cannot save payout templates")
+	} else if err := checkLabel(n.template); err != nil {
+		return encodedTxn{}, err
+	} else if et.p2&p2PartialCover != 0 {
+		return encodedTxn{}, errors.New("a partially-covered transaction cannot be saved as a template")
+	}
+	// the template's label ends the header
+	data := append(et.data[:et.hdrLen:et.hdrLen], byte(len(n.template)))
+	data = append(data, n.template...)
+	et.data = append(data, et.data[et.hdrLen:]...)
+	et.hdrLen = len(data)
+	et.p2 |= p2SaveTemplate
+	return et, nil
+}
+
+// ClearTemplates removes every payout template from the device. No review is
+// required.
+func (n *Nano) ClearTemplates() error {
+	_, err := n.Exchange(cmdClearTmpls, 0, 0, nil)
+	return err
+}
+
+// encodeCoveredFields encodes the elements covered by a partial signature as
+// a count, followed by each element's type and index, packed into a uint16.
+func encodeCoveredFields(cf types.CoveredFields) ([]byte, error) {
+	const (
+		maxCoveredElems = 8
+		maxCoveredIndex = 0x0FFF
+	)
+	// in the order that the elements appear in the transaction
+	lists := [][]uint64{
+		cf.SiacoinInputs,
+		cf.SiacoinOutputs,
+		cf.FileContracts,
+		cf.FileContractRevisions,
+		cf.StorageProofs,
+		cf.SiafundInputs,
+		cf.SiafundOutputs,
+		cf.MinerFees,
+		cf.ArbitraryData,
+		cf.Signatures,
+	}
+	out := []byte{0}
+	for elemType, indices := range lists {
+		for i, index := range indices {
+			if index > maxCoveredIndex {
+				return nil, fmt.Errorf("covered element index %v is too large", index)
+			} else if i > 0 && index <= indices[i-1] {
+				return nil, errors.New("covered element indices must be sorted and unique")
+			}
+			out = binary.LittleEndian.AppendUint16(out, uint16(elemType)<<12|uint16(index))
+		}
+	}
+	n := (len(out) - 1) / 2
+	if n == 0 {
+		return nil, errors.New("signature covers no elements")
+	} else if n > maxCoveredElems {
+		return nil, fmt.Errorf("signature covers %v elements; at most %v are supported", n, maxCoveredElems)
+	}
+	out[0] = byte(n)
+	return out, nil
+}
+
+const (
+	txnAckLen        = 8 // session token and acknowledged byte count
+	maxResumeRetries = 3
+)
+
+// resume reconnects to the device and asks it for the state of the
+// interrupted GET_TXN_HASH session identified by token.
+func (n *Nano) resume(p2 byte, token []byte) ([]byte, error) {
+	ex, err := n.reopen()
+	if err != nil {
+		return nil, err
+	}
+	n.ex = ex
+	n.metrics.recordRetry(cmdCalcTxnHash)
+	return n.exchange(phaseStream, cmdCalcTxnHash, p1Resume, p2, token)
+}
+
+// zeroRLE replaces each run of zero bytes in data with a zero byte followed
+// by the length of the run. Sia-encoded transactions are mostly zeros, so
+// this typically shrinks them considerably.
+func zeroRLE(data []byte) []byte {
+	out := make([]byte, 0, len(data))
+	for i := 0; i < len(data); {
+		if data[i] != 0 {
+			out = append(out, data[i])
+			i++
+			continue
+		}
+		var run byte
+		for i < len(data) && data[i] == 0 && run < 255 {
+			run++
+			i++
+		}
+		out = append(out, 0, run)
+	}
+	return out
+}
+
+// nextChunk returns the next packet of data, starting at off. Zero-run
+// encoded data is split so that no run straddles two packets.
+func nextChunk(data []byte, off, maxLen int, zeroRLE bool) []byte {
+	end := off + maxLen
+	if end > len(data) {
+		end = len(data)
+	}
+	if !zeroRLE {
+		return data[off:end]
+	}
+	i := off
+	for i < end {
+		if data[i] != 0 {
+			i++
+		} else if i+1 < end {
+			i += 2
+		} else {
+			break
+		}
+	}
+	return data[off:i]
+}
+
+// streamTxn sends the output of encodeTxn to the device in 255-byte packets
+// and returns the final response. If the connection fails partway through, it
+// reconnects and resumes from the last packet the device acknowledged, rather
+// than starting over.
+func (n *Nano) streamTxn(p2 byte, et encodedTxn) ([]byte, error) {
+	p2 |= et.p2
+	if n.noReview && p2&p2SignHash == 0 {
+		p2 |= p2NoReview
+	} else if n.summary && n.capabilities().Summary && p2&(p2SaveTemplate|p2PartialCover) == 0 {
+		p2 |= p2Summary
+	}
+	data, hdrLen := et.data, et.hdrLen
+	if n.zeroRLE {
+		// the header is never compressed
+		p2 |= p2ZeroRLE
+		data = append(data[:hdrLen:hdrLen], zeroRLE(data[hdrLen:])...)
+	}
+
+	var token []byte
+	var retries int
+	for off, p1 := 0, byte(p1First); ; p1 = p1More {
+		chunk := nextChunk(data, off, n.maxChunkLen(), n.zeroRLE)
+		phase := phaseStream
+		if off+len(chunk) == len(data) && p2&p2NoReview != 0 {
+			phase = phaseResponse
+		} else if off+len(chunk) == len(data) {
+			phase = phaseAwaitUser
+		}
+		resp, err := n.exchange(phase, cmdCalcTxnHash, p1, p2, chunk)
+		if err != nil && token != nil && n.reopen != nil && isTransportError(err) && retries < maxResumeRetries {
+			retries++
+			resp, err = n.resume(p2, token)
+			if err == nil && len(resp) != txnAckLen {
+				// the device had already received the whole transaction,
+				// so this is the final response
+				return resp, nil
+			} else if err == nil {
+				off = hdrLen + int(binary.LittleEndian.Uint32(resp[4:]))
+				continue
+			}
 		}
-		resp, err = n.Exchange(cmdCalcTxnHash, p1, p2SignHash, buf.Next(255))
 		if err != nil {
-			return [64]byte{}, err
+			return nil, err
+		}
+		off += len(chunk)
+		if off == len(data) {
+			return resp, nil
+		} else if len(resp) == txnAckLen {
+			token = resp[:4]
 		}
 	}
+}
+
+func (n *Nano) CalcTxnHash(txn types.Transaction, sigIndex uint16, change ChangeRange) (hash [32]byte, err error) {
+	// keyIndex is ignored since we are not signing
+	et, err := n.prepareTxn(txn, 0, sigIndex, change, false)
+	if err != nil {
+		return [32]byte{}, err
+	}
+	resp, err := n.streamTxn(p2DisplayHash, et)
+	if err != nil {
+		return [32]byte{}, err
+	}
+	if copy(hash[:], resp) != len(hash) {
+		return [32]byte{}, errors.New("hash has wrong length")
+	}
+	return
+}
+
+// CalcTxnHashAndID is like CalcTxnHash, but the device also returns the ID of
+// the transaction, computed in the same pass.
+func (n *Nano) CalcTxnHashAndID(txn types.Transaction, sigIndex uint16, change ChangeRange) (hash [32]byte, id types.TransactionID, err error) {
+	if !n.capabilities().TxnID {
+		return [32]byte{}, types.TransactionID{}, errors.New("device cannot compute transaction IDs")
+	}
+	et, err := n.prepareTxn(txn, 0, sigIndex, change, false)
+	if err != nil {
+		return [32]byte{}, types.TransactionID{}, err
+	}
+	resp, err := n.streamTxn(p2DisplayHash|p2TxnID, et)
+	if err != nil {
+		return [32]byte{}, types.TransactionID{}, err
+	} else if len(resp) != len(hash)+len(id) {
+		return [32]byte{}, types.TransactionID{}, errors.New("hash and ID have wrong length")
+	}
+	copy(hash[:], resp)
+	copy(id[:], resp[len(hash):])
+	return
+}
+
+func (n *Nano) SignTxn(txn types.Transaction, sigIndex uint16, keyIndex uint32, change ChangeRange) (sig [64]byte, err error) {
+	et, err := n.prepareTxn(txn, keyIndex, sigIndex, change, true)
+	if err != nil {
+		return [64]byte{}, err
+	}
+	resp, err := n.streamTxn(p2SignHash, et)
+	if err != nil {
+		return [64]byte{}, err
+	}
 	if copy(sig[:], resp) != len(sig) {
 		return [64]byte{}, errors.New("signature has wrong length")
 	}
 	return
 }
 
-func OpenNanoHID() (*Nano, error) {
+// SignTxnAndID is like SignTxn, but the device also returns the ID of the
+// transaction, computed in the same pass.
+func (n *Nano) SignTxnAndID(txn types.Transaction, sigIndex uint16, keyIndex uint32, change ChangeRange) (sig [64]byte, id types.TransactionID, err error) {
+	if !n.capabilities().TxnID {
+		return [64]byte{}, types.TransactionID{}, errors.New("device cannot compute transaction IDs")
+	}
+	et, err := n.prepareTxn(txn, keyIndex, sigIndex, change, true)
+	if err != nil {
+		return [64]byte{}, types.TransactionID{}, err
+	}
+	resp, err := n.streamTxn(p2SignHash|p2TxnID, et)
+	if err != nil {
+		return [64]byte{}, types.TransactionID{}, err
+	} else if len(resp) != len(sig)+len(id) {
+		return [64]byte{}, types.TransactionID{}, errors.New("signature and ID have wrong length")
+	}
+	copy(sig[:], resp)
+	copy(id[:], resp[len(sig):])
+	return
+}
+
+// A BatchTxn is a transaction to be signed as part of a batch.
+type BatchTxn struct {
+	Transaction types.Transaction
+	SigIndex    uint16
+	KeyIndex    uint32
+	ChangeIndex uint32
+}
+
+// SignTxnBatch streams each transaction to the device, then asks the user to
+// approve the combined totals of the batch. If they do, it returns the
+// signature of each transaction, in order.
+//
+// If the device reports a smaller batch limit than len(txns), the
+// transactions are split into several batches, each reviewed separately.
+func (n *Nano) SignTxnBatch(txns []BatchTxn) ([][64]byte, error) {
+	caps := n.capabilities()
+	batches := [][]BatchTxn{txns}
+	if caps.MaxBatchTxns > 0 && len(txns) > caps.MaxBatchTxns {
+		batches = nil
+		for i := 0; i < len(txns); i += caps.MaxBatchTxns {
+			batches = append(batches, txns[i:min(i+caps.MaxBatchTxns, len(txns))])
+		}
+	}
+	// check every batch before any is sent
+	for _, batch := range batches {
+		if err := ValidateBatch(batch, caps); err != nil {
+			return nil, fmt.Errorf("device would reject batch: %w", err)
+		}
+	}
+
+	sigs := make([][64]byte, 0, len(txns))
+	for _, batch := range batches {
+		batchSigs, err := n.signBatch(batch)
+		if err != nil {
+			return nil, err
+		}
+		sigs = append(sigs, batchSigs...)
+	}
+	return sigs, nil
+}
+
+// signBatch signs txns as a single batch.
+func (n *Nano) signBatch(txns []BatchTxn) ([][64]byte, error) {
+	for _, bt := range txns {
+		et, err := encodeTxn(bt.Transaction, bt.KeyIndex, bt.SigIndex, SingleChange(bt.ChangeIndex))
+		if err != nil {
+			return nil, err
+		} else if et.p2&p2PartialCover != 0 {
+			return nil, errors.New("batched transactions must be signed with whole-transaction signatures")
+		}
+		buf := bytes.NewBuffer(et.data)
+		for p1 := byte(p1First); buf.Len() > 0; p1 = p1More {
+			if _, err := n.exchange(phaseStream, cmdSignTxnBatch, p1, 0, buf.Next(n.maxChunkLen())); err != nil {
+				return nil, err
+			}
+		}
+	}
+
+	resp, err := n.exchange(phaseAwaitUser, cmdSignTxnBatch, p1BatchReview, 0, nil)
+	if err != nil {
+		return nil, err
+	} else if len(resp) != 1 || int(resp[0]) != len(txns) {
+		return nil, errors.New("device reported wrong batch size")
+	}
+
+	sigs := make([][64]byte, len(txns))
+	for i := range sigs {
+		resp, err := n.Exchange(cmdSignTxnBatch, p1BatchSig, 0, []byte{byte(i)})
+		if err != nil {
+			return nil, err
+		}
+		if copy(sigs[i][:], resp) != len(sigs[i]) {
+			return nil, errors.New("signature has wrong length")
+		}
+	}
+	return sigs, nil
+}
+
+// openHIDDevice opens the Ledger device connected over USB.
+func openHIDDevice() (*hid.Device, error) {
 	const (
 		ledgerVendorID       = 0x2c97
 		ledgerNanoSProductID = 0x0001
@@ -349,17 +1141,37 @@ func OpenNanoHID() (*Nano, error) {
 	} else if len(staxDevices) > 0 {
 		device, err = staxDevices[0].Open()
 	}
+	return device, err
+}
 
+// hidExchanger wraps raw device I/O in HID+APDU protocols.
+func hidExchanger(device *hid.Device) apduExchanger {
+	return &apduFramer{
+		hf: &hidFramer{
+			rw: device,
+		},
+	}
+}
+
+func OpenNanoHID() (*Nano, error) {
+	device, err := openHIDDevice()
 	if err != nil {
 		return nil, err
 	}
-
-	// wrap raw device I/O in HID+APDU protocols
 	return &Nano{
-		ex: &apduFramer{
-			hf: &hidFramer{
-				rw: device,
-			},
+		ex: hidExchanger(device),
+		reopen: func() (apduExchanger, error) {
+			// release the old handle first, since the device may not be
+			// opened twice
+			if device != nil {
+				device.Close()
+			}
+			var err error
+			device, err = openHIDDevice()
+			if err != nil {
+				return nil, err
+			}
+			return hidExchanger(device), nil
 		},
 	}, nil
 }
@@ -377,15 +1189,44 @@ func OpenNano(apduTcpServer string) (*Nano, error) {
 		ex: &tcpExchanger{
 			conn: conn,
 		},
+		reopen: func() (apduExchanger, error) {
+			if conn != nil {
+				conn.Close()
+			}
+			var err error
+			conn, err = net.Dial("tcp", apduTcpServer)
+			if err != nil {
+				return nil, err
+			}
+			return &tcpExchanger{conn: conn}, nil
+		},
 	}, nil
 }
 
+// atExit, if set, is called before the program exits, even if it exits
+// because of an error.
+var atExit func()
+
+func fatalln(v ...any) {
+	if atExit != nil {
+		atExit()
+	}
+	log.Fatalln(v...)
+}
+
+func fatalf(format string, v ...any) {
+	if atExit != nil {
+		atExit()
+	}
+	log.Fatalf(format, v...)
+}
+
 func parseIndex(s string) uint32 {
 	index, err := strconv.ParseUint(s, 10, 32)
 	if err != nil {
-		log.Fatalln("Couldn't parse index:", err)
+		fatalln("Couldn't parse index:", err)
 	} else if index > math.MaxUint32 {
-		log.Fatalf("Index too large (max %v)", math.MaxUint32)
+		fatalf("Index too large (max %v)", math.MaxUint32)
 	}
 	return uint32(index)
 }
@@ -396,14 +1237,27 @@ const (
 
 Actions:
     addr            generate an address
+    discover        list the used addresses of a wallet
     pubkey          generate a pubkey
     hash            sign a trusted hash
     txn             sign a transaction
+    message         sign a message
+    batch           sign several transactions with a single review
+    policy          set the policy for signing without a full review
+    trust           display outputs to the specified addresses by name
+    templates       remove the saved payout templates
+    serve           keep the device open and serve signing requests
+    bench           measure the latency and throughput of the device
 `
 	debugUsage = `print raw APDU exchanges`
 
 	tcpUsage = `instead of communicating over USB HID, communicate with specified host:port over TCP`
 
+	compressUsage = `compress transaction data sent to the device even if it does not report support for compression (otherwise, compression is used whenever the device supports it)`
+	emulatorUsage = `instead of communicating with a device, use an in-process emulator with the specified hex-encoded seed (requires building with -tags emulator)`
+	metricsUsage  = `write the latency, throughput, and errors of every exchange with the device to the specified file as JSON`
+	traceUsage    = `write a timeline of every exchange with the device to the specified file, in the Chrome trace event format`
+
 	versionUsage = `Usage:
 	sialedger version
 
@@ -414,6 +1268,21 @@ the Sia Ledger Nano S app (if available).
 	sialedger addr [key index]
 
 Generates an address using the public key with the specified index.
+`
+	discoverUsage = `Usage:
+	sialedger discover [flags] [used]
+
+Lists the used addresses of the wallet, followed by the next unused address.
+Addresses are scanned in order of key index until -gap consecutive addresses
+are unused. [used] is either a file listing the used addresses, one per line,
+or the URL of a service, to which the addresses are POSTed as a JSON array and
+which responds with a JSON array of booleans, true for each that is used.
+
+The public keys are read from the device without displaying them, and are
+cached, along with the key at index 0 that identifies the device. Later
+scans only contact the device if the cache does not cover them, and discard
+the cache if it belongs to a different device. Addresses are always derived
+from the cached keys.
 `
 	pubkeyUsage = `Usage:
 	sialedger pubkey [key index]
@@ -433,11 +1302,150 @@ to calculate a hash in a trusted manner.
 	sialedger txn [flags] [txn.json] [sig index] [key index]
 
 Calculates and signs the hash of a transaction using the private key with the
-specified key index. The CoveredFields of the specified TransactionSignature
-must set WholeTransaction = true.
+specified key index. If the CoveredFields of the specified
+TransactionSignature do not set WholeTransaction = true, they may cover at
+most 8 elements.
+
+With -sighash -noreview, the device returns the hash without displaying the
+transaction, which is useful for checking an encoder against the device.
+
+With -summary, the device shows the total sent to each destination instead of
+each output, and each output only on request. Transactions with file
+contracts are always reviewed in full.
+
+With -template, the transaction is reviewed in full, and once approved, its
+outputs are saved on the device as a payout template with the given label.
+Later transactions that send exactly the same amounts to the same addresses,
+in the same order, are signed after a single confirmation showing only the
+label and the miner fee. Change outputs and miner fees may differ.
+`
+	batchUsage = `Usage:
+	sialedger batch [batch.json]
+
+Signs several transactions, reviewing them on the device as a single batch.
+The file must contain a JSON array of objects of the form:
+
+	{"transaction": {...}, "sigIndex": 0, "keyIndex": 0, "changeIndex": 0}
+
+If changeIndex is omitted, no change address is used. The CoveredFields of
+each specified TransactionSignature must set WholeTransaction = true. The
+signatures are printed in order, one per line.
+`
+	messageUsage = `Usage:
+	sialedger message [file] [key index]
+
+Signs the contents of a file using the private key with the specified index.
+The device displays the start of the message, its length, and its hash for
+review.
+`
+	policyUsage = `Usage:
+	sialedger policy [policy.json]
+	sialedger policy -clear
+
+Sets the policy for signing transactions without a full review. The device
+displays the policy for approval. The file must contain a JSON object of the
+form:
+
+	{"keyIndex": 0, "confirm": true, "maxPerTxn": "1000000000000000000000000",
+	 "maxPerSession": "10000000000000000000000000", "maxFee": "10000000000000000000000",
+	 "destinations": ["addr:..."]}
+
+Amounts are in Hastings. A transaction signed with keyIndex may then be signed
+without reviewing its elements, provided that it only sends siacoins to the
+listed destinations, within the limits. If confirm is true, the device still
+asks for a single confirmation. The session limit applies to the total signed
+since the app was opened.
+`
+	trustUsage = `Usage:
+	sialedger trust [addresses.json]
+	sialedger trust -clear
+
+Adds trusted addresses to the device. The device displays each address with
+its label for approval, a few at a time. Once approved, siacoin outputs sent
+to a trusted address are displayed by its label instead of in full. The file
+must contain a JSON array of the form:
+
+	[{"address": "addr:...", "label": "Exchange"}]
+
+Labels are 1 to 15 printable ASCII characters. Adding an address that is
+already trusted replaces its label.
+`
+	templatesUsage = `Usage:
+	sialedger templates -clear
+
+Removes every payout template saved with txn -template from the device.
+Later transactions are reviewed in full.
 `
+	stackUsage = `Usage:
+	sialedger stack [flags]
+
+Prints the deepest stack use measured for each command so far. This is only
+supported by apps built with STACK_PROFILE=1.
+`
+	serveUsage = `Usage:
+	sialedger serve [flags]
+
+Keeps the connection to the device open and serves requests over HTTP,
+avoiding the cost of reconnecting for every signature. Requests are executed
+one at a time, in the order they arrive. The API is:
+
+	GET  /address/[key index]   generate an address
+	POST /sign/hash             sign {"hash": "...", "keyIndex": 0}
+	POST /sign/txn              sign {"transaction": {...}, "sigIndex": 0,
+	                                  "keyIndex": 0, "changeIndex": 0,
+	                                  "changeCount": 1}
+	POST /sign/txns             sign one transaction per line, as for
+	                            /sign/txn, writing one result per line
+	                            followed by a throughput summary
+	GET  /metrics               report latency and throughput, as -metrics
+
+If changeIndex is omitted, no change address is used. If changeCount is
+greater than 1, the addresses of that many consecutive key indices, starting
+at changeIndex, are all treated as change. Transaction signatures
+are base64-encoded, and are returned with the transaction ID if the device
+can compute it.
+Over TCP, every request must include the header "Authorization: Bearer
+[token]", where the token is given by -token, or generated and printed at
+startup. The Host header must be localhost or an IP address, and POST
+bodies must be sent as application/json. A Unix socket is only accessible
+to the current user, so no token is required.
+`
+	benchUsage = `Usage:
+	sialedger bench [flags]
+
+Measures the round-trip latency of GET_VERSION, of deriving a public key, and
+of hashing transactions of several sizes streamed in packets of several
+sizes, and prints the percentiles of each as JSON. Nothing is displayed on the
+device: keys are derived in a batch and transactions are hashed without a
+review, so either is skipped if the device does not support it. SIGN_HASH is
+only measured with -signhash, since the user must approve each signature and
+blind signing must be enabled; its latency includes the time the user takes.
+
+To measure the emulator, run the app in Speculos and pass -tcp with its APDU
+port.
+`
+	policyClearUsage    = `remove the policy instead of setting one`
+	trustClearUsage     = `remove every trusted address instead of adding any`
+	stackResetUsage     = `clear the measurements after printing them`
 	txnHashUsage        = `calculate the transaction hash, but do not sign it`
 	txnChangeIndexUsage = `key index of the transaction's change address`
+	txnChangeCountUsage = "number of consecutive key indices, starting at -changeIndex, whose addresses receive change"
+	txnIDUsage          = `also print the transaction ID, as computed by the device, if it supports it`
+	txnSummaryUsage     = `review the total sent to each destination instead of each output, if the device supports it`
+	txnNoReviewUsage    = `with -sighash, return the hash without displaying the transaction`
+	txnTemplateUsage    = `save the outputs as a payout template with this label once approved`
+	templatesClearUsage = `remove every payout template`
+	serveAddrUsage      = `TCP address to listen on`
+	discoverGapUsage    = `number of consecutive unused addresses that ends the scan`
+	discoverCacheUsage  = `file in which to cache the wallet's public keys`
+	serveUnixUsage      = `listen on the specified Unix socket instead of a TCP address`
+	serveTokenUsage     = `bearer token required over TCP (default: a random token, printed at startup)`
+	benchSamplesUsage   = `number of timed samples of each measurement`
+	benchOutputsUsage   = `comma-separated transaction sizes to hash, in siacoin outputs`
+	benchChunksUsage    = `comma-separated numbers of data bytes to send per APDU`
+	benchSignHashUsage  = `also measure SIGN_HASH, approving each signature on the device`
+	benchLabelUsage     = `label to include in the report, such as the device model`
+	benchOutUsage       = `write the report to the specified file instead of stdout`
 )
 
 func main() {
@@ -448,34 +1456,111 @@ func main() {
 	rootCmd.Usage = flagg.SimpleUsage(rootCmd, rootUsage)
 	rootCmd.BoolVar(&DEBUG, "apdu", false, debugUsage)
 	rootCmd.StringVar(&apduTcpServer, "tcp", "", tcpUsage)
+	compress := rootCmd.Bool("compress", false, compressUsage)
+	emulatorSeed := rootCmd.String("emulator", "", emulatorUsage)
+	metricsPath := rootCmd.String("metrics", "", metricsUsage)
+	tracePath := rootCmd.String("trace", "", traceUsage)
 
 	versionCmd := flagg.New("version", versionUsage)
 	addrCmd := flagg.New("addr", addrUsage)
+	discoverCmd := flagg.New("discover", discoverUsage)
+	discoverGap := discoverCmd.Int("gap", 20, discoverGapUsage)
+	discoverCache := discoverCmd.String("cache", defaultCachePath(), discoverCacheUsage)
 	pubkeyCmd := flagg.New("pubkey", pubkeyUsage)
 	hashCmd := flagg.New("hash", hashUsage)
 	txnCmd := flagg.New("txn", txnUsage)
 	txnHash := txnCmd.Bool("sighash", false, txnHashUsage)
 	txnChangeIndex := txnCmd.Uint64("changeIndex", math.MaxUint32, txnChangeIndexUsage)
+	txnChangeCount := txnCmd.Uint64("changeCount", 1, txnChangeCountUsage)
+	txnID := txnCmd.Bool("id", false, txnIDUsage)
+	txnSummary := txnCmd.Bool("summary", false, txnSummaryUsage)
+	txnNoReview := txnCmd.Bool("noreview", false, txnNoReviewUsage)
+	txnTemplate := txnCmd.String("template", "", txnTemplateUsage)
+	batchCmd := flagg.New("batch", batchUsage)
+	messageCmd := flagg.New("message", messageUsage)
+	policyCmd := flagg.New("policy", policyUsage)
+	policyClear := policyCmd.Bool("clear", false, policyClearUsage)
+	trustCmd := flagg.New("trust", trustUsage)
+	trustClear := trustCmd.Bool("clear", false, trustClearUsage)
+	templatesCmd := flagg.New("templates", templatesUsage)
+	templatesClear := templatesCmd.Bool("clear", false, templatesClearUsage)
+	stackCmd := flagg.New("stack", stackUsage)
+	stackReset := stackCmd.Bool("reset", false, stackResetUsage)
+	serveCmd := flagg.New("serve", serveUsage)
+	serveAddr := serveCmd.String("addr", "localhost:9880", serveAddrUsage)
+	serveUnix := serveCmd.String("unix", "", serveUnixUsage)
+	serveToken := serveCmd.String("token", "", serveTokenUsage)
+	serveSummary := serveCmd.Bool("summary", false, txnSummaryUsage)
+	benchCmd := flagg.New("bench", benchUsage)
+	benchSamples := benchCmd.Int("n", 20, benchSamplesUsage)
+	benchOutputs := benchCmd.String("outputs", "1,10,100", benchOutputsUsage)
+	benchChunks := benchCmd.String("chunks", "64,128,255", benchChunksUsage)
+	benchSignHash := benchCmd.Bool("signhash", false, benchSignHashUsage)
+	benchLabel := benchCmd.String("label", "", benchLabelUsage)
+	benchOut := benchCmd.String("o", "", benchOutUsage)
 
 	cmd := flagg.Parse(flagg.Tree{
 		Cmd: rootCmd,
 		Sub: []flagg.Tree{
 			{Cmd: versionCmd},
 			{Cmd: addrCmd},
+			{Cmd: discoverCmd},
 			{Cmd: pubkeyCmd},
 			{Cmd: hashCmd},
 			{Cmd: txnCmd},
+			{Cmd: batchCmd},
+			{Cmd: messageCmd},
+			{Cmd: policyCmd},
+			{Cmd: trustCmd},
+			{Cmd: templatesCmd},
+			{Cmd: stackCmd},
+			{Cmd: serveCmd},
+			{Cmd: benchCmd},
 		},
 	})
 	args := cmd.Args()
 
-	var nano *Nano
-	if cmd != rootCmd && cmd != versionCmd {
+	var metrics *Metrics
+	if *metricsPath != "" || *tracePath != "" {
+		metrics = NewMetrics(*tracePath != "")
+		start := time.Now()
+		atExit = func() {
+			metrics.Span(cmd.Name(), start)
+			if err := writeMetrics(metrics, *metricsPath, *tracePath); err != nil {
+				log.Println("Couldn't write metrics:", err)
+			}
+		}
+		defer atExit()
+	}
+
+	openNano := func() *Nano {
+		var nano *Nano
 		var err error
-		nano, err = OpenNano(apduTcpServer)
+		if *emulatorSeed != "" {
+			var seed []byte
+			if seed, err = hex.DecodeString(*emulatorSeed); err == nil {
+				nano, err = OpenEmulator(seed)
+			}
+		} else {
+			nano, err = OpenNano(apduTcpServer)
+		}
 		if err != nil {
-			log.Fatalln("Couldn't open device:", err)
+			fatalln("Couldn't open device:", err)
 		}
+		nano.metrics = metrics
+		if err := nano.Negotiate(); err != nil {
+			fatalln("Couldn't read device capabilities:", err)
+		}
+		if *compress {
+			nano.zeroRLE = true
+		}
+		return nano
+	}
+
+	// discover opens the device only if its cache is insufficient
+	var nano *Nano
+	if cmd != rootCmd && cmd != versionCmd && cmd != discoverCmd {
+		nano = openNano()
 	}
 
 	switch cmd {
@@ -488,15 +1573,21 @@ func main() {
 	case versionCmd:
 		// try to get Nano S app version
 		var appVersion string
+		var caps Capabilities
 		nano, err := OpenNano(apduTcpServer)
 		if err != nil {
 			appVersion = "(could not connect to Nano S or X)"
-		} else if appVersion, err = nano.GetVersion(); err != nil {
+		} else if caps, err = nano.GetCapabilities(); err != nil {
 			appVersion = "(could not read version from Nano: " + err.Error() + ")"
+		} else {
+			appVersion = caps.Version
 		}
 
 		fmt.Printf("%s v0.1.0\n", os.Args[0])
 		fmt.Println("Nano app version:", appVersion)
+		if caps.MaxChunkLen != 0 {
+			fmt.Printf("Nano app capabilities: %+v\n", caps)
+		}
 
 	case addrCmd:
 		if len(args) != 1 {
@@ -505,10 +1596,42 @@ func main() {
 		}
 		addr, err := nano.GetAddress(parseIndex(args[0]))
 		if err != nil {
-			log.Fatalln("Couldn't get address:", err)
+			fatalln("Couldn't get address:", err)
 		}
 		fmt.Println(addr)
 
+	case discoverCmd:
+		if len(args) != 1 || *discoverGap < 1 {
+			discoverCmd.Usage()
+			return
+		}
+		used, err := usedChecker(args[0])
+		if err != nil {
+			fatalln("Couldn't read used addresses:", err)
+		}
+		cache, err := loadAddressCache(*discoverCache)
+		if err != nil {
+			fatalln("Couldn't read cache:", err)
+		}
+		scan, err := discover(cache, used, *discoverGap, func() *Nano {
+			if nano == nil {
+				nano = openNano()
+			}
+			return nano
+		})
+		if err != nil {
+			fatalln("Couldn't discover addresses:", err)
+		}
+		if scan.cacheChanged {
+			if err := cache.save(*discoverCache); err != nil {
+				fatalln("Couldn't write cache:", err)
+			}
+		}
+		for _, i := range scan.used {
+			fmt.Println(i, cache.address(i))
+		}
+		fmt.Println("Next unused:", scan.next, cache.address(scan.next))
+
 	case pubkeyCmd:
 		if len(args) != 1 {
 			pubkeyCmd.Usage()
@@ -516,7 +1639,7 @@ func main() {
 		}
 		pubkey, err := nano.GetPublicKey(parseIndex(args[0]))
 		if err != nil {
-			log.Fatalln("Couldn't get public key:", err)
+			fatalln("Couldn't get public key:", err)
 		}
 		pk := types.PublicKey(pubkey)
 		fmt.Println(pk.String())
@@ -529,45 +1652,252 @@ func main() {
 		var hash [32]byte
 		hashBytes, err := hex.DecodeString(args[0])
 		if err != nil {
-			log.Fatalln("Couldn't read hash:", err)
+			fatalln("Couldn't read hash:", err)
 		} else if len(hashBytes) != 32 {
-			log.Fatalf("Wrong hex hash length (%v, wanted 32)", len(hashBytes))
+			fatalf("Wrong hex hash length (%v, wanted 32)", len(hashBytes))
 		}
 		copy(hash[:], hashBytes)
 
 		sig, err := nano.SignHash(hash, parseIndex(args[1]))
 		if err != nil {
-			log.Fatalln("Couldn't get signature:", err)
+			fatalln("Couldn't get signature:", err)
 		}
 		fmt.Println(types.Signature(sig).String())
 
 	case txnCmd:
-		if (*txnHash && len(args) != 2) || (!*txnHash && len(args) != 3) {
+		if (*txnHash && len(args) != 2) || (!*txnHash && len(args) != 3) || (*txnNoReview && !*txnHash) ||
+			(*txnTemplate != "" && *txnHash) {
 			txnCmd.Usage()
 			return
+		} else if *txnNoReview && !nano.capabilities().NoReview {
+			fatalln("The device cannot compute a hash without a review")
 		}
 		txnBytes, err := os.ReadFile(args[0])
 		if err != nil {
-			log.Fatalln("Couldn't read transaction:", err)
+			fatalln("Couldn't read transaction:", err)
 		}
 		var txn types.Transaction
 		if err := json.Unmarshal(txnBytes, &txn); err != nil {
-			log.Fatalln("Couldn't decode transaction:", err)
+			fatalln("Couldn't decode transaction:", err)
 		}
 		sigIndex := uint16(parseIndex(args[1]))
-
-		if *txnHash {
-			sighash, err := nano.CalcTxnHash(txn, sigIndex, uint32(*txnChangeIndex))
+		if *txnChangeCount > math.MaxUint8 {
+			fatalf("Change count too large (max %v)", math.MaxUint8)
+		}
+		change := ChangeRange{First: uint32(*txnChangeIndex), Count: uint8(*txnChangeCount)}
+		nano.summary = *txnSummary
+		nano.noReview = *txnNoReview
+		nano.template = *txnTemplate
+
+		switch {
+		case *txnHash && *txnID:
+			sighash, id, err := nano.CalcTxnHashAndID(txn, sigIndex, change)
 			if err != nil {
-				log.Fatalln("Couldn't get hash:", err)
+				fatalln("Couldn't get hash:", err)
 			}
 			fmt.Println(hex.EncodeToString(sighash[:]))
-		} else {
-			sig, err := nano.SignTxn(txn, sigIndex, parseIndex(args[2]), uint32(*txnChangeIndex))
+			fmt.Println(id)
+		case *txnHash:
+			sighash, err := nano.CalcTxnHash(txn, sigIndex, change)
 			if err != nil {
-				log.Fatalln("Couldn't get signature:", err)
+				fatalln("Couldn't get hash:", err)
+			}
+			fmt.Println(hex.EncodeToString(sighash[:]))
+		case *txnID:
+			sig, id, err := nano.SignTxnAndID(txn, sigIndex, parseIndex(args[2]), change)
+			if err != nil {
+				fatalln("Couldn't get signature:", err)
+			}
+			fmt.Println(base64.StdEncoding.EncodeToString(sig[:]))
+			fmt.Println(id)
+		default:
+			sig, err := nano.SignTxn(txn, sigIndex, parseIndex(args[2]), change)
+			if err != nil {
+				fatalln("Couldn't get signature:", err)
 			}
 			fmt.Println(base64.StdEncoding.EncodeToString(sig[:]))
 		}
+
+	case batchCmd:
+		if len(args) != 1 {
+			batchCmd.Usage()
+			return
+		}
+		batchBytes, err := os.ReadFile(args[0])
+		if err != nil {
+			fatalln("Couldn't read batch:", err)
+		}
+		var entries []struct {
+			Transaction types.Transaction `json:"transaction"`
+			SigIndex    uint16            `json:"sigIndex"`
+			KeyIndex    uint32            `json:"keyIndex"`
+			ChangeIndex *uint32           `json:"changeIndex"`
+		}
+		if err := json.Unmarshal(batchBytes, &entries); err != nil {
+			fatalln("Couldn't decode batch:", err)
+		}
+		txns := make([]BatchTxn, len(entries))
+		for i, e := range entries {
+			txns[i] = BatchTxn{
+				Transaction: e.Transaction,
+				SigIndex:    e.SigIndex,
+				KeyIndex:    e.KeyIndex,
+				ChangeIndex: math.MaxUint32,
+			}
+			if e.ChangeIndex != nil {
+				txns[i].ChangeIndex = *e.ChangeIndex
+			}
+		}
+
+		sigs, err := nano.SignTxnBatch(txns)
+		if err != nil {
+			fatalln("Couldn't get signatures:", err)
+		}
+		for _, sig := range sigs {
+			fmt.Println(base64.StdEncoding.EncodeToString(sig[:]))
+		}
+
+	case messageCmd:
+		if len(args) != 2 {
+			messageCmd.Usage()
+			return
+		}
+		msg, err := os.ReadFile(args[0])
+		if err != nil {
+			fatalln("Couldn't read message:", err)
+		}
+		sig, err := nano.SignMessage(msg, parseIndex(args[1]))
+		if err != nil {
+			fatalln("Couldn't get signature:", err)
+		}
+		fmt.Println(types.Signature(sig).String())
+
+	case policyCmd:
+		if (*policyClear && len(args) != 0) || (!*policyClear && len(args) != 1) {
+			policyCmd.Usage()
+			return
+		}
+		if *policyClear {
+			if err := nano.ClearPolicy(); err != nil {
+				fatalln("Couldn't clear policy:", err)
+			}
+			return
+		}
+		policyBytes, err := os.ReadFile(args[0])
+		if err != nil {
+			fatalln("Couldn't read policy:", err)
+		}
+		var p Policy
+		if err := json.Unmarshal(policyBytes, &p); err != nil {
+			fatalln("Couldn't decode policy:", err)
+		}
+		if err := nano.SetPolicy(p); err != nil {
+			fatalln("Couldn't set policy:", err)
+		}
+
+	case trustCmd:
+		if (*trustClear && len(args) != 0) || (!*trustClear && len(args) != 1) {
+			trustCmd.Usage()
+			return
+		}
+		if *trustClear {
+			if err := nano.ClearTrusted(); err != nil {
+				fatalln("Couldn't clear trusted addresses:", err)
+			}
+			return
+		}
+		addrsBytes, err := os.ReadFile(args[0])
+		if err != nil {
+			fatalln("Couldn't read addresses:", err)
+		}
+		var addrs []TrustedAddress
+		if err := json.Unmarshal(addrsBytes, &addrs); err != nil {
+			fatalln("Couldn't decode addresses:", err)
+		}
+		if err := nano.AddTrusted(addrs); err != nil {
+			fatalln("Couldn't add trusted addresses:", err)
+		}
+
+	case templatesCmd:
+		if !*templatesClear || len(args) != 0 {
+			templatesCmd.Usage()
+			return
+		}
+		if err := nano.ClearTemplates(); err != nil {
+			fatalln("Couldn't clear payout templates:", err)
+		}
+
+	case stackCmd:
+		if len(args) != 0 {
+			stackCmd.Usage()
+			return
+		}
+		size, usage, err := nano.GetStackUsage(*stackReset)
+		if err != nil {
+			fatalln("Couldn't get stack usage:", err)
+		}
+		fmt.Printf("Stack size: %v bytes\n", size)
+		fmt.Println("INS   Handler  UX")
+		for _, u := range usage {
+			fmt.Printf("0x%02x  %7d  %5d\n", u.INS, u.Handler, u.UX)
+		}
+
+	case serveCmd:
+		if len(args) != 0 {
+			serveCmd.Usage()
+			return
+		}
+		l, err := listen(*serveAddr, *serveUnix)
+		if err != nil {
+			fatalln("Couldn't listen:", err)
+		}
+		ctx, stop := signal.NotifyContext(context.Background(), os.Interrupt, syscall.SIGTERM)
+		defer stop()
+		nano.summary = *serveSummary
+		token := *serveToken
+		if token == "" && *serveUnix == "" {
+			if token, err = newToken(); err != nil {
+				fatalln("Couldn't generate token:", err)
+			}
+			fmt.Println("API token:", token)
+		}
+		if err := serve(ctx, nano, l, token); err != nil {
+			fatalln("Couldn't serve:", err)
+		}
+
+	case benchCmd:
+		if len(args) != 0 || *benchSamples < 1 {
+			benchCmd.Usage()
+			return
+		}
+		outputs, err := parseIntList(*benchOutputs, 1, 10000)
+		if err != nil {
+			fatalln("Invalid -outputs:", err)
+		}
+		chunks, err := parseIntList(*benchChunks, minBenchChunkLen, 255)
+		if err != nil {
+			fatalln("Invalid -chunks:", err)
+		}
+		report, err := bench(nano, benchOptions{
+			Samples:   *benchSamples,
+			Outputs:   outputs,
+			ChunkLens: chunks,
+			SignHash:  *benchSignHash,
+		})
+		if err != nil {
+			fatalln("Couldn't complete benchmark:", err)
+		}
+		report.Label = *benchLabel
+		switch {
+		case *emulatorSeed != "":
+			report.Transport = "emulator"
+		case apduTcpServer != "":
+			report.Transport = "tcp:" + apduTcpServer
+		default:
+			report.Transport = "hid"
+		}
+		if err := writeBenchReport(report, *benchOut); err != nil {
+			fatalln("Couldn't write report:", err)
+		}
 	}
 }
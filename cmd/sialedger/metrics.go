@@ -0,0 +1,312 @@
+package main
+
+import (
+	"encoding/json"
+	"errors"
+	"fmt"
+	"io"
+	"os"
+	"sort"
+	"sync"
+	"time"
+)
+
+// The phase of a command that an APDU belongs to. Exchanges that wait for
+// the user are slow by design, so they are measured separately from those
+// that only transfer data.
+const (
+	phaseStream    = "stream"     // sends data that the device acknowledges
+	phaseAwaitUser = "await-user" // waits for the user to approve a request
+	phaseResponse  = "response"   // returns a result without user interaction
+)
+
+// latencyBuckets are the upper bounds of the latency histogram buckets. The
+// final bucket counts every slower exchange.
+var latencyBuckets = []time.Duration{
+	1 * time.Millisecond,
+	2 * time.Millisecond,
+	5 * time.Millisecond,
+	10 * time.Millisecond,
+	20 * time.Millisecond,
+	50 * time.Millisecond,
+	100 * time.Millisecond,
+	200 * time.Millisecond,
+	500 * time.Millisecond,
+	1 * time.Second,
+	2 * time.Second,
+	5 * time.Second,
+	10 * time.Second,
+	30 * time.Second,
+	60 * time.Second,
+}
+
+var insNames = map[byte]string{
+	cmdGetVersion:   "GET_VERSION",
+	cmdGetPublicKey: "GET_PUBLIC_KEY",
+	cmdSignHash:     "SIGN_HASH",
+	cmdCalcTxnHash:  "GET_TXN_HASH",
+	cmdSignTxnBatch: "SIGN_TXN_BATCH",
+	cmdStackUsage:   "GET_STACK_USAGE",
+	cmdSignMessage:  "SIGN_MESSAGE",
+	cmdSetPolicy:    "SET_POLICY",
+	cmdAddTrusted:   "ADD_TRUSTED",
+	cmdClearTmpls:   "CLEAR_TEMPLATES",
+}
+
+func insName(ins byte) string {
+	if name, ok := insNames[ins]; ok {
+		return name
+	}
+	return fmt.Sprintf("0x%02x", ins)
+}
+
+type exchangeKey struct {
+	ins   byte
+	phase string
+}
+
+// ExchangeStats summarizes the exchanges of one INS in one phase.
+type ExchangeStats struct {
+	INS           string        `json:"ins"`
+	Phase         string        `json:"phase"`
+	Count         int           `json:"count"`
+	Errors        int           `json:"errors"`
+	BytesSent     int           `json:"bytesSent"`
+	BytesReceived int           `json:"bytesReceived"`
+	Total         time.Duration `json:"totalNanos"`
+	// BytesPerSecond is the combined transfer rate of the exchanges. It is
+	// only set in a MetricsSummary.
+	BytesPerSecond float64 `json:"bytesPerSecond"`
+	// Buckets[i] counts the exchanges that took at most latencyBuckets[i];
+	// the final entry counts the rest.
+	Buckets []int `json:"buckets"`
+}
+
+type traceEvent struct {
+	Name string         `json:"name"`
+	Cat  string         `json:"cat"`
+	Ph   string         `json:"ph"`
+	TS   int64          `json:"ts"`  // microseconds since the session began
+	Dur  int64          `json:"dur"` // microseconds
+	PID  int            `json:"pid"`
+	TID  int            `json:"tid"`
+	Args map[string]any `json:"args,omitempty"`
+}
+
+// Metrics records the latency and outcome of the APDUs exchanged with a
+// device. It is safe for concurrent use. A nil *Metrics records nothing.
+type Metrics struct {
+	mu        sync.Mutex
+	start     time.Time
+	exchanges map[exchangeKey]*ExchangeStats
+	errors    map[string]int // by status code, or "transport"
+	retries   map[byte]int   // resumed transfers, by INS
+	trace     bool
+	events    []traceEvent
+}
+
+// NewMetrics returns an empty Metrics. If trace is true, every exchange is
+// also recorded as a span for WriteTrace.
+func NewMetrics(trace bool) *Metrics {
+	return &Metrics{
+		start:     time.Now(),
+		exchanges: make(map[exchangeKey]*ExchangeStats),
+		errors:    make(map[string]int),
+		retries:   make(map[byte]int),
+		trace:     trace,
+	}
+}
+
+// errorKey classifies the error returned by Nano.Exchange.
+func errorKey(err error) string {
+	var code ErrCode
+	switch {
+	case err == errUserRejected:
+		return fmt.Sprintf("0x%04x", codeUserRejected)
+	case err == errInvalidParam:
+		return fmt.Sprintf("0x%04x", codeInvalidParam)
+	case errors.As(err, &code):
+		return fmt.Sprintf("0x%04x", uint16(code))
+	default:
+		return "transport"
+	}
+}
+
+// recordExchange records an APDU that was sent at start and completed after
+// d, sending and receiving the specified number of bytes.
+func (m *Metrics) recordExchange(apdu APDU, phase string, start time.Time, d time.Duration, received int, err error) {
+	if m == nil {
+		return
+	}
+	sent := len(apdu.Encode())
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	k := exchangeKey{apdu.INS, phase}
+	s, ok := m.exchanges[k]
+	if !ok {
+		s = &ExchangeStats{
+			INS:     insName(apdu.INS),
+			Phase:   phase,
+			Buckets: make([]int, len(latencyBuckets)+1),
+		}
+		m.exchanges[k] = s
+	}
+	s.Count++
+	s.BytesSent += sent
+	s.BytesReceived += received
+	s.Total += d
+	s.Buckets[sort.Search(len(latencyBuckets), func(i int) bool { return d <= latencyBuckets[i] })]++
+	if err != nil {
+		s.Errors++
+		m.errors[errorKey(err)]++
+	}
+
+	if m.trace {
+		args := map[string]any{
+			"p1":       fmt.Sprintf("0x%02x", apdu.P1),
+			"p2":       fmt.Sprintf("0x%02x", apdu.P2),
+			"sent":     sent,
+			"received": received,
+		}
+		if err != nil {
+			args["error"] = err.Error()
+		}
+		m.events = append(m.events, traceEvent{
+			Name: insName(apdu.INS) + " " + phase,
+			Cat:  "apdu",
+			Ph:   "X",
+			TS:   start.Sub(m.start).Microseconds(),
+			Dur:  d.Microseconds(),
+			PID:  1,
+			TID:  1,
+			Args: args,
+		})
+	}
+}
+
+// recordRetry records that a transfer was resumed after a transport failure.
+func (m *Metrics) recordRetry(ins byte) {
+	if m == nil {
+		return
+	}
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	m.retries[ins]++
+}
+
+// Span records an operation spanning several exchanges, such as signing a
+// transaction, for WriteTrace.
+func (m *Metrics) Span(name string, start time.Time) {
+	if m == nil || !m.trace {
+		return
+	}
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	m.events = append(m.events, traceEvent{
+		Name: name,
+		Cat:  "op",
+		Ph:   "X",
+		TS:   start.Sub(m.start).Microseconds(),
+		Dur:  time.Since(start).Microseconds(),
+		PID:  1,
+		TID:  0,
+	})
+}
+
+// MetricsSummary is a snapshot of a Metrics.
+type MetricsSummary struct {
+	Uptime          time.Duration   `json:"uptimeNanos"`
+	LatencyBuckets  []time.Duration `json:"latencyBucketsNanos"`
+	Exchanges       []ExchangeStats `json:"exchanges"`
+	Errors          map[string]int  `json:"errors"`
+	Retries         map[string]int  `json:"retries"`
+	BytesPerSecond  float64         `json:"bytesPerSecond"`
+	TransferSeconds float64         `json:"transferSeconds"`
+}
+
+// Summary returns a snapshot of the metrics recorded so far. BytesPerSecond
+// only counts the exchanges that do not wait for the user.
+func (m *Metrics) Summary() MetricsSummary {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	sum := MetricsSummary{
+		Uptime:         time.Since(m.start),
+		LatencyBuckets: latencyBuckets,
+		Errors:         make(map[string]int),
+		Retries:        make(map[string]int),
+	}
+	var bytes int
+	var transfer time.Duration
+	for _, s := range m.exchanges {
+		c := *s
+		c.Buckets = append([]int(nil), s.Buckets...)
+		if s.Total > 0 {
+			c.BytesPerSecond = float64(s.BytesSent+s.BytesReceived) / s.Total.Seconds()
+		}
+		sum.Exchanges = append(sum.Exchanges, c)
+		if s.Phase != phaseAwaitUser {
+			bytes += s.BytesSent + s.BytesReceived
+			transfer += s.Total
+		}
+	}
+	sort.Slice(sum.Exchanges, func(i, j int) bool {
+		a, b := sum.Exchanges[i], sum.Exchanges[j]
+		return a.INS < b.INS || (a.INS == b.INS && a.Phase < b.Phase)
+	})
+	for k, v := range m.errors {
+		sum.Errors[k] = v
+	}
+	for ins, v := range m.retries {
+		sum.Retries[insName(ins)] = v
+	}
+	sum.TransferSeconds = transfer.Seconds()
+	if transfer > 0 {
+		sum.BytesPerSecond = float64(bytes) / transfer.Seconds()
+	}
+	return sum
+}
+
+// WriteSummary writes the metrics recorded so far to w as JSON.
+func (m *Metrics) WriteSummary(w io.Writer) error {
+	enc := json.NewEncoder(w)
+	enc.SetIndent("", "  ")
+	return enc.Encode(m.Summary())
+}
+
+// WriteTrace writes the recorded spans to w in the Chrome trace event
+// format, which can be loaded into chrome://tracing or Perfetto.
+func (m *Metrics) WriteTrace(w io.Writer) error {
+	m.mu.Lock()
+	defer m.mu.Unlock()
+	events := m.events
+	if events == nil {
+		events = []traceEvent{}
+	}
+	return json.NewEncoder(w).Encode(struct {
+		TraceEvents     []traceEvent `json:"traceEvents"`
+		DisplayTimeUnit string       `json:"displayTimeUnit"`
+	}{events, "ms"})
+}
+
+// writeMetrics writes the summary of m to summaryPath and its trace to
+// tracePath, skipping either if its path is empty.
+func writeMetrics(m *Metrics, summaryPath, tracePath string) error {
+	write := func(path string, fn func(io.Writer) error) error {
+		if path == "" {
+			return nil
+		}
+		f, err := os.Create(path)
+		if err != nil {
+			return err
+		}
+		defer f.Close()
+		if err := fn(f); err != nil {
+			return err
+		}
+		return f.Close()
+	}
+	if err := write(summaryPath, m.WriteSummary); err != nil {
+		return err
+	}
+	return write(tracePath, m.WriteTrace)
+}
@@ -0,0 +1,453 @@
+package main
+
+import (
+	"bufio"
+	"context"
+	"crypto/rand"
+	"crypto/subtle"
+	"encoding/hex"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"log"
+	"mime"
+	"net"
+	"net/http"
+	"os"
+	"path/filepath"
+	"strconv"
+	"strings"
+	"time"
+
+	"go.sia.tech/core/types"
+)
+
+// A deviceQueue serializes the requests made to a device. The device can only
+// process one command at a time, and a review in progress must not be
+// interrupted, so requests are executed one at a time in the order they
+// arrive.
+type deviceQueue struct {
+	nano *Nano
+	jobs chan func()
+}
+
+func newDeviceQueue(nano *Nano) *deviceQueue {
+	q := &deviceQueue{
+		nano: nano,
+		jobs: make(chan func()),
+	}
+	go func() {
+		for job := range q.jobs {
+			job()
+		}
+	}()
+	return q
+}
+
+// do waits for its turn, then calls fn with the device. If the connection to
+// the device fails, it is reopened, so that the next request can succeed. If
+// ctx is cancelled before fn is called, fn is not called at all.
+func (q *deviceQueue) do(ctx context.Context, fn func(n *Nano) error) error {
+	done := make(chan error, 1)
+	job := func() {
+		if ctx.Err() != nil {
+			done <- ctx.Err()
+			return
+		}
+		err := fn(q.nano)
+		if err != nil && isTransportError(err) && q.nano.reopen != nil {
+			if ex, rerr := q.nano.reopen(); rerr != nil {
+				log.Println("Couldn't reconnect to device:", rerr)
+			} else {
+				q.nano.ex = ex
+				if rerr := q.nano.Negotiate(); rerr != nil {
+					log.Println("Couldn't read device capabilities:", rerr)
+				}
+			}
+		}
+		done <- err
+	}
+	select {
+	case q.jobs <- job:
+	case <-ctx.Done():
+		return ctx.Err()
+	}
+	return <-done
+}
+
+// A signTxnRequest is a transaction to be signed, along with the parameters
+// of the signature. If ChangeIndex is omitted, no change address is used.
+type signTxnRequest struct {
+	Transaction types.Transaction `json:"transaction"`
+	SigIndex    uint16            `json:"sigIndex"`
+	KeyIndex    uint32            `json:"keyIndex"`
+	ChangeIndex *uint32           `json:"changeIndex"`
+	ChangeCount uint8             `json:"changeCount"`
+}
+
+func (req signTxnRequest) change() ChangeRange {
+	if req.ChangeIndex == nil {
+		return NoChange
+	}
+	return ChangeRange{First: *req.ChangeIndex, Count: req.ChangeCount}
+}
+
+// A signTxnResponse holds the signature of a transaction and, if the device
+// can compute it, the transaction's ID.
+type signTxnResponse struct {
+	Signature []byte               `json:"signature"`
+	ID        *types.TransactionID `json:"id,omitempty"`
+}
+
+// A signTxnsResult is a line of the response to /sign/txns.
+type signTxnsResult struct {
+	Index     int                  `json:"index"`
+	Signature []byte               `json:"signature,omitempty"`
+	ID        *types.TransactionID `json:"id,omitempty"`
+	Error     string               `json:"error,omitempty"`
+	Duration  time.Duration        `json:"durationNanos"`
+}
+
+// A signTxnsSummary is the final line of the response to /sign/txns.
+type signTxnsSummary struct {
+	Signed        int           `json:"signed"`
+	Failed        int           `json:"failed"`
+	Elapsed       time.Duration `json:"elapsedNanos"`
+	TxnsPerSecond float64       `json:"txnsPerSecond"`
+}
+
+// A server exposes a device over HTTP. Over TCP, every request must carry
+// the token, and name the server by a loopback name or an IP address, so that
+// a web page cannot make requests on the user's behalf.
+type server struct {
+	q         *deviceQueue
+	metrics   *Metrics
+	token     string // required bearer token, if any
+	checkHost bool   // reject Host headers that could be rebound
+}
+
+func writeJSON(w http.ResponseWriter, v any) {
+	w.Header().Set("Content-Type", "application/json")
+	json.NewEncoder(w).Encode(v)
+}
+
+// writeError reports err with a status code that distinguishes the user's
+// rejection and malformed requests from other failures.
+func writeError(w http.ResponseWriter, err error) {
+	code := http.StatusInternalServerError
+	switch {
+	case err == errUserRejected:
+		code = http.StatusForbidden
+	case err == errInvalidParam:
+		code = http.StatusBadRequest
+	case errors.Is(err, context.Canceled):
+		code = http.StatusServiceUnavailable
+	}
+	http.Error(w, err.Error(), code)
+}
+
+func requireMethod(w http.ResponseWriter, r *http.Request, method string) bool {
+	if r.Method != method {
+		w.Header().Set("Allow", method)
+		http.Error(w, "method not allowed", http.StatusMethodNotAllowed)
+		return false
+	}
+	return true
+}
+
+// handleAddress handles GET /address/[key index].
+func (s *server) handleAddress(w http.ResponseWriter, r *http.Request) {
+	if !requireMethod(w, r, http.MethodGet) {
+		return
+	}
+	index, err := strconv.ParseUint(strings.TrimPrefix(r.URL.Path, "/address/"), 10, 32)
+	if err != nil {
+		http.Error(w, "invalid key index", http.StatusBadRequest)
+		return
+	}
+	var addr types.Address
+	err = s.q.do(r.Context(), func(n *Nano) (err error) {
+		addr, err = n.GetAddress(uint32(index))
+		return
+	})
+	if err != nil {
+		writeError(w, err)
+		return
+	}
+	writeJSON(w, addr)
+}
+
+// handleSignHash handles POST /sign/hash.
+func (s *server) handleSignHash(w http.ResponseWriter, r *http.Request) {
+	if !requireMethod(w, r, http.MethodPost) {
+		return
+	}
+	var req struct {
+		Hash     string `json:"hash"`
+		KeyIndex uint32 `json:"keyIndex"`
+	}
+	var hash [32]byte
+	if err := json.NewDecoder(r.Body).Decode(&req); err != nil {
+		http.Error(w, "couldn't decode request: "+err.Error(), http.StatusBadRequest)
+		return
+	} else if b, err := hex.DecodeString(req.Hash); err != nil || len(b) != len(hash) {
+		http.Error(w, "hash must be 32 hex-encoded bytes", http.StatusBadRequest)
+		return
+	} else {
+		copy(hash[:], b)
+	}
+	var sig [64]byte
+	err := s.q.do(r.Context(), func(n *Nano) (err error) {
+		sig, err = n.SignHash(hash, req.KeyIndex)
+		return
+	})
+	if err != nil {
+		writeError(w, err)
+		return
+	}
+	writeJSON(w, types.Signature(sig))
+}
+
+// signTxn signs a single transaction, returning its ID as well if the device
+// supports computing it.
+func signTxn(n *Nano, req signTxnRequest) (sig [64]byte, id *types.TransactionID, err error) {
+	if n.capabilities().TxnID {
+		var txid types.TransactionID
+		sig, txid, err = n.SignTxnAndID(req.Transaction, req.SigIndex, req.KeyIndex, req.change())
+		if err != nil {
+			return [64]byte{}, nil, err
+		}
+		return sig, &txid, nil
+	}
+	sig, err = n.SignTxn(req.Transaction, req.SigIndex, req.KeyIndex, req.change())
+	return sig, nil, err
+}
+
+// handleSignTxn handles POST /sign/txn.
+func (s *server) handleSignTxn(w http.ResponseWriter, r *http.Request) {
+	if !requireMethod(w, r, http.MethodPost) {
+		return
+	}
+	var req signTxnRequest
+	if err := json.NewDecoder(r.Body).Decode(&req); err != nil {
+		http.Error(w, "couldn't decode request: "+err.Error(), http.StatusBadRequest)
+		return
+	}
+	var sig [64]byte
+	var resp signTxnResponse
+	err := s.q.do(r.Context(), func(n *Nano) (err error) {
+		sig, resp.ID, err = signTxn(n, req)
+		return
+	})
+	if err != nil {
+		writeError(w, err)
+		return
+	}
+	resp.Signature = sig[:]
+	writeJSON(w, resp)
+}
+
+// handleSignTxns handles POST /sign/txns. The request body holds one
+// signTxnRequest per line. Each transaction is reviewed and signed in turn,
+// and a result line is written as soon as it is done, followed by a summary
+// line once the input is exhausted. A transaction that fails does not stop
+// the others.
+func (s *server) handleSignTxns(w http.ResponseWriter, r *http.Request) {
+	if !requireMethod(w, r, http.MethodPost) {
+		return
+	}
+	w.Header().Set("Content-Type", "application/x-ndjson")
+	enc := json.NewEncoder(w)
+	flusher, _ := w.(http.Flusher)
+
+	var sum signTxnsSummary
+	start := time.Now()
+	dec := json.NewDecoder(bufio.NewReader(r.Body))
+	for i := 0; dec.More(); i++ {
+		res := signTxnsResult{Index: i}
+		txnStart := time.Now()
+		var req signTxnRequest
+		if err := dec.Decode(&req); err != nil {
+			// the rest of the input cannot be decoded reliably
+			res.Error = "couldn't decode request: " + err.Error()
+			enc.Encode(res)
+			sum.Failed++
+			break
+		}
+		var sig [64]byte
+		err := s.q.do(r.Context(), func(n *Nano) (err error) {
+			sig, res.ID, err = signTxn(n, req)
+			return
+		})
+		if err != nil {
+			res.Error = err.Error()
+			sum.Failed++
+		} else {
+			res.Signature = sig[:]
+			sum.Signed++
+		}
+		res.Duration = time.Since(txnStart)
+		enc.Encode(res)
+		if flusher != nil {
+			flusher.Flush()
+		}
+		if r.Context().Err() != nil {
+			return
+		}
+	}
+	sum.Elapsed = time.Since(start)
+	if sum.Elapsed > 0 {
+		sum.TxnsPerSecond = float64(sum.Signed) / sum.Elapsed.Seconds()
+	}
+	enc.Encode(sum)
+	log.Printf("Signed %v transactions (%v failed) in %v (%.2f txn/s)", sum.Signed, sum.Failed, sum.Elapsed, sum.TxnsPerSecond)
+}
+
+// handleMetrics handles GET /metrics.
+func (s *server) handleMetrics(w http.ResponseWriter, r *http.Request) {
+	if !requireMethod(w, r, http.MethodGet) {
+		return
+	}
+	writeJSON(w, s.metrics.Summary())
+}
+
+// allowedHost reports whether host names the server in a way that DNS
+// rebinding cannot exploit: as localhost, or by an IP address.
+func allowedHost(host string) bool {
+	if h, _, err := net.SplitHostPort(host); err == nil {
+		host = h
+	}
+	host = strings.TrimSuffix(strings.TrimPrefix(host, "["), "]")
+	return strings.EqualFold(host, "localhost") || net.ParseIP(host) != nil
+}
+
+// guard rejects requests that a web page could have made: those without the
+// token, those addressed to a host name other than localhost, and POSTs whose
+// body is not JSON, which a form cannot send without a CORS preflight.
+func (s *server) guard(next http.Handler) http.Handler {
+	return http.HandlerFunc(func(w http.ResponseWriter, r *http.Request) {
+		if s.checkHost && !allowedHost(r.Host) {
+			http.Error(w, "invalid Host header", http.StatusForbidden)
+			return
+		}
+		if s.token != "" {
+			auth := r.Header.Get("Authorization")
+			if !strings.HasPrefix(auth, "Bearer ") ||
+				subtle.ConstantTimeCompare([]byte(auth[len("Bearer "):]), []byte(s.token)) != 1 {
+				w.Header().Set("WWW-Authenticate", "Bearer")
+				http.Error(w, "missing or invalid token", http.StatusUnauthorized)
+				return
+			}
+		}
+		if r.Method == http.MethodPost {
+			mt, _, err := mime.ParseMediaType(r.Header.Get("Content-Type"))
+			if err != nil || (mt != "application/json" && mt != "application/x-ndjson") {
+				http.Error(w, "Content-Type must be application/json", http.StatusUnsupportedMediaType)
+				return
+			}
+		}
+		next.ServeHTTP(w, r)
+	})
+}
+
+func (s *server) handler() http.Handler {
+	mux := http.NewServeMux()
+	mux.HandleFunc("/address/", s.handleAddress)
+	mux.HandleFunc("/sign/hash", s.handleSignHash)
+	mux.HandleFunc("/sign/txn", s.handleSignTxn)
+	mux.HandleFunc("/sign/txns", s.handleSignTxns)
+	mux.HandleFunc("/metrics", s.handleMetrics)
+	return s.guard(mux)
+}
+
+// newToken returns a random bearer token.
+func newToken() (string, error) {
+	var b [16]byte
+	if _, err := rand.Read(b[:]); err != nil {
+		return "", err
+	}
+	return hex.EncodeToString(b[:]), nil
+}
+
+// listen listens on the specified Unix socket, or on the TCP address if
+// socketPath is empty. A stale socket left by a previous server is removed.
+//
+// The socket is created in a private directory and then moved into place, so
+// that no other user can connect to it before its permissions are set.
+func listen(addr, socketPath string) (net.Listener, error) {
+	if socketPath == "" {
+		return net.Listen("tcp", addr)
+	}
+	if err := os.Remove(socketPath); err != nil && !os.IsNotExist(err) {
+		return nil, err
+	}
+	dir, err := os.MkdirTemp(filepath.Dir(socketPath), ".sialedger-")
+	if err != nil {
+		return nil, err
+	}
+	defer os.RemoveAll(dir)
+	tmpPath := filepath.Join(dir, "sock")
+	l, err := net.Listen("unix", tmpPath)
+	if err != nil {
+		return nil, err
+	}
+	ul := l.(*net.UnixListener)
+	// the socket is removed by closeUnixListener, under its final name
+	ul.SetUnlinkOnClose(false)
+	// only the current user may sign
+	if err := os.Chmod(tmpPath, 0600); err != nil {
+		ul.Close()
+		return nil, err
+	} else if err := os.Rename(tmpPath, socketPath); err != nil {
+		ul.Close()
+		return nil, err
+	}
+	return closeUnixListener{ul, socketPath}, nil
+}
+
+// A closeUnixListener removes its socket when it is closed.
+type closeUnixListener struct {
+	*net.UnixListener
+	path string
+}
+
+func (l closeUnixListener) Addr() net.Addr {
+	return &net.UnixAddr{Name: l.path, Net: "unix"}
+}
+
+func (l closeUnixListener) Close() error {
+	err := l.UnixListener.Close()
+	os.Remove(l.path)
+	return err
+}
+
+// serve exposes nano on l until ctx is cancelled. Over TCP, requests must
+// carry token as a bearer token.
+func serve(ctx context.Context, nano *Nano, l net.Listener, token string) error {
+	if nano.metrics == nil {
+		nano.metrics = NewMetrics(false)
+	}
+	s := &server{
+		q:       newDeviceQueue(nano),
+		metrics: nano.metrics,
+	}
+	if l.Addr().Network() == "tcp" {
+		if token == "" {
+			return errors.New("a token is required to serve over TCP")
+		}
+		s.token = token
+		s.checkHost = true
+	}
+	srv := &http.Server{Handler: s.handler()}
+	go func() {
+		<-ctx.Done()
+		shutdownCtx, cancel := context.WithTimeout(context.Background(), 5*time.Second)
+		defer cancel()
+		srv.Shutdown(shutdownCtx)
+	}()
+	fmt.Println("Listening on", l.Addr())
+	if err := srv.Serve(l); err != http.ErrServerClosed {
+		return err
+	}
+	return nil
+}
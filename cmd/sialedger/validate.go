@@ -0,0 +1,335 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"errors"
+	"fmt"
+
+	"go.sia.tech/core/types"
+)
+
+// The app buffers at most 255 undecoded bytes between packets, so every part
+// of the transaction that it decodes in one step must fit in 256 bytes:
+// otherwise, whether it is accepted depends on where the packets happen to
+// split it.
+const maxDecodeStep = 256
+
+// in the order that the elements appear in the transaction, as in txn.h
+var elemNames = [...]string{
+	"siacoin input",
+	"siacoin output",
+	"file contract",
+	"file contract revision",
+	"storage proof",
+	"siafund input",
+	"siafund output",
+	"miner fee",
+	"arbitrary data",
+	"signature",
+}
+
+const (
+	elemSCInput = iota
+	elemSCOutput
+	elemFC
+	elemFCR
+	elemSP
+	elemSFInput
+	elemSFOutput
+	elemMinerFee
+	elemArbData
+	elemTxnSig
+)
+
+// A txnChecker decodes an encoded transaction the way the app does, recording
+// every reason the app would reject it.
+type txnChecker struct {
+	b        []byte
+	pos      int
+	step     int // start of the current decoding step
+	elemType int
+	index    int
+	sigIndex uint64
+	errs     []error
+}
+
+func (c *txnChecker) errorf(format string, args ...any) {
+	prefix := fmt.Sprintf("%v %v: ", elemNames[c.elemType], c.index)
+	c.errs = append(c.errs, fmt.Errorf(prefix+format, args...))
+}
+
+func (c *txnChecker) readInt() uint64 {
+	if c.pos+8 > len(c.b) {
+		panic(errors.New("transaction encoding is truncated"))
+	}
+	u := binary.LittleEndian.Uint64(c.b[c.pos:])
+	c.pos += 8
+	return u
+}
+
+func (c *txnChecker) seek(n uint64) {
+	if n > uint64(len(c.b)-c.pos) {
+		panic(errors.New("transaction encoding is truncated"))
+	}
+	c.pos += int(n)
+}
+
+// flush ends a decoding step, as flush and consume do in txn.c.
+func (c *txnChecker) flush() {
+	if n := c.pos - c.step; n > maxDecodeStep {
+		c.errorf("%v bytes must be decoded at once, but the device can decode at most %v", n, maxDecodeStep)
+	}
+	c.step = c.pos
+}
+
+func (c *txnChecker) readCurrency(stored bool) {
+	n := c.readInt()
+	if stored && n > 16 {
+		c.errorf("value is longer than 16 bytes")
+	}
+	c.seek(n)
+}
+
+func (c *txnChecker) readUnlockConditions() {
+	c.readInt() // Timelock
+	for n := c.readInt(); n > 0; n-- {
+		c.seek(16)          // Algorithm
+		c.seek(c.readInt()) // Key
+	}
+	c.readInt() // SignaturesRequired
+}
+
+// readSlice reads a nested slice, flushing before it and after each entry.
+func (c *txnChecker) readSlice(entry func(i uint64)) {
+	n := c.readInt()
+	c.flush()
+	for i := uint64(0); i < n; i++ {
+		entry(i)
+		c.flush()
+	}
+}
+
+func (c *txnChecker) readOutputs(storePayouts bool) {
+	c.readSlice(func(i uint64) {
+		c.readCurrency(storePayouts && i < 2) // Value
+		c.seek(32)                            // UnlockHash
+	})
+}
+
+func (c *txnChecker) readFileContract() {
+	c.readInt()          // Filesize
+	c.seek(32)           // FileMerkleRoot
+	c.readInt()          // WindowStart
+	c.readInt()          // WindowEnd
+	c.readCurrency(true) // Payout
+	c.readOutputs(false) // ValidProofOutputs
+	c.readOutputs(false) // MissedProofOutputs
+	c.seek(32)           // UnlockHash
+	c.readInt()          // RevisionNumber
+}
+
+func (c *txnChecker) readFileContractRevision() {
+	c.seek(32) // ParentID
+	c.readUnlockConditions()
+	c.readInt()          // RevisionNumber
+	c.readInt()          // Filesize
+	c.seek(32)           // FileMerkleRoot
+	c.readInt()          // WindowStart
+	c.readInt()          // WindowEnd
+	c.readOutputs(true)  // ValidProofOutputs
+	c.readOutputs(false) // MissedProofOutputs
+	c.seek(32)           // UnlockHash
+}
+
+// readCoveredFields checks the CoveredFields of the signature being computed,
+// as readCoveredFields and txn_set_covered do in txn.c. sliceLens holds the
+// number of elements of each type.
+func (c *txnChecker) readCoveredFields(sliceLens []uint64) {
+	check := uint64(c.index) == c.sigIndex
+	c.seek(1)
+	whole := c.b[c.pos-1] != 0
+	covered := 0
+	for elemType := range elemNames {
+		n := c.readInt()
+		if check && whole && n != 0 {
+			c.errorf("WholeTransaction is set, but %vs are also covered", elemNames[elemType])
+		}
+		for ; n > 0; n-- {
+			index := c.readInt()
+			if !check || whole {
+				continue
+			}
+			covered++
+			if elemType == elemTxnSig && index == c.sigIndex {
+				c.errorf("signature covers itself")
+			} else if elemType < len(sliceLens) && index >= sliceLens[elemType] {
+				c.errorf("covers %v %v, which does not exist", elemNames[elemType], index)
+			}
+		}
+	}
+	if check && !whole && covered == 0 {
+		c.errorf("signature covers no elements")
+	}
+}
+
+// check decodes the whole transaction. It returns the number of elements
+// that the device would display.
+func (c *txnChecker) check() (displayed int) {
+	var sliceLens []uint64
+	for c.elemType = 0; c.elemType < len(elemNames); c.elemType++ {
+		n := c.readInt()
+		c.step = c.pos
+		sliceLens = append(sliceLens, n)
+		c.index = 0
+		switch {
+		case c.elemType == elemArbData && n != 0:
+			c.errs = append(c.errs, errors.New("arbitrary data is not supported"))
+		case c.elemType == elemTxnSig && c.sigIndex >= n:
+			c.errs = append(c.errs, fmt.Errorf("signature %v does not exist", c.sigIndex))
+		}
+		for ; uint64(c.index) < n; c.index++ {
+			switch c.elemType {
+			case elemSCInput:
+				c.seek(32)
+				c.readUnlockConditions()
+			case elemSCOutput:
+				c.readCurrency(true)
+				c.seek(32)
+			case elemFC:
+				c.readFileContract()
+			case elemFCR:
+				c.readFileContractRevision()
+			case elemSP:
+				c.seek(32 + 64)
+				c.readSlice(func(uint64) { c.seek(32) })
+			case elemSFInput:
+				c.seek(32)
+				c.readUnlockConditions()
+				c.seek(32)
+			case elemSFOutput:
+				c.readCurrency(true)
+				c.seek(32)
+				c.readCurrency(false)
+			case elemMinerFee:
+				c.readCurrency(true)
+			case elemArbData:
+				c.seek(c.readInt())
+			case elemTxnSig:
+				c.seek(32)  // ParentID
+				c.readInt() // PublicKeyIndex
+				c.readInt() // Timelock
+				c.readCoveredFields(sliceLens)
+				c.seek(c.readInt()) // Signature
+			}
+			c.flush()
+			switch c.elemType {
+			case elemSCOutput, elemFC, elemFCR, elemSFOutput, elemMinerFee:
+				displayed++
+			}
+		}
+	}
+	if c.pos != len(c.b) {
+		c.errs = append(c.errs, errors.New("transaction encoding has trailing bytes"))
+	}
+	return displayed
+}
+
+// ValidateTxn checks, without contacting the device, whether the app would
+// accept txn for computing the SigHash of the signature at sigIndex, with the
+// specified change addresses. Limits that are zero in caps are not checked.
+// All problems found are reported.
+func ValidateTxn(txn types.Transaction, sigIndex uint16, change ChangeRange, caps Capabilities) (err error) {
+	var buf bytes.Buffer
+	e := types.NewEncoder(&buf)
+	txn.EncodeTo(e)
+	if err := e.Flush(); err != nil {
+		return fmt.Errorf("couldn't encode transaction: %w", err)
+	}
+	defer func() {
+		if r := recover(); r != nil {
+			err = r.(error)
+		}
+	}()
+	c := &txnChecker{b: buf.Bytes(), sigIndex: uint64(sigIndex)}
+	displayed := c.check()
+
+	// The device must have room for one more element after the last one
+	// it displays. Which outputs are sent to change addresses, and are thus
+	// not displayed, is only known to the device, so if there may be change,
+	// the limit is only enforced for the elements that are displayed anyway.
+	if change.First != NoChange.First {
+		displayed -= len(txn.SiacoinOutputs)
+	}
+	if caps.MaxElems > 0 && displayed >= caps.MaxElems {
+		c.errs = append(c.errs, fmt.Errorf("transaction has %v elements to display; the device supports at most %v", displayed, caps.MaxElems-1))
+	}
+	if change.Count > 1 {
+		// the last index must not wrap around, or be the NoChange index
+		if change.First > NoChange.First-uint32(change.Count) {
+			c.errs = append(c.errs, errors.New("change index range is out of bounds"))
+		}
+		// a zero MaxChunkLen means that caps were not negotiated
+		if caps.MaxChunkLen > 0 && !caps.ChangeRange {
+			c.errs = append(c.errs, errors.New("the device does not support change index ranges"))
+		} else if caps.MaxChangeAddrs > 0 && int(change.Count) > caps.MaxChangeAddrs {
+			c.errs = append(c.errs, fmt.Errorf("change range has %v indices; the device supports at most %v", change.Count, caps.MaxChangeAddrs))
+		}
+	}
+	if caps.ElemTypes != 0 {
+		for elemType, n := range []int{
+			len(txn.SiacoinInputs), len(txn.SiacoinOutputs), len(txn.FileContracts),
+			len(txn.FileContractRevisions), len(txn.StorageProofs), len(txn.SiafundInputs),
+			len(txn.SiafundOutputs), len(txn.MinerFees), len(txn.ArbitraryData), len(txn.Signatures),
+		} {
+			if n > 0 && caps.ElemTypes&(1<<elemType) == 0 && elemType != elemArbData {
+				c.errs = append(c.errs, fmt.Errorf("the device does not support %vs", elemNames[elemType]))
+			}
+		}
+	}
+	if int(sigIndex) < len(txn.Signatures) && !txn.Signatures[sigIndex].CoveredFields.WholeTransaction {
+		if _, err := encodeCoveredFields(txn.Signatures[sigIndex].CoveredFields); err != nil {
+			c.errs = append(c.errs, err)
+		} else if caps.MaxCoveredElems > 0 && !caps.PartialCover {
+			c.errs = append(c.errs, errors.New("the device does not support partial signatures"))
+		}
+	}
+	return errors.Join(c.errs...)
+}
+
+// ValidateBatch checks, without contacting the device, whether the app would
+// accept txns as a single batch. Limits that are zero in caps are not
+// checked. All problems found are reported.
+func ValidateBatch(txns []BatchTxn, caps Capabilities) error {
+	var errs []error
+	if caps.MaxBatchTxns > 0 && len(txns) > caps.MaxBatchTxns {
+		errs = append(errs, fmt.Errorf("batch has %v transactions; the device supports at most %v", len(txns), caps.MaxBatchTxns))
+	}
+	type dest struct {
+		sf   bool
+		addr types.Address
+	}
+	dests := make(map[dest]struct{})
+	for i, bt := range txns {
+		txn := bt.Transaction
+		if err := ValidateTxn(txn, bt.SigIndex, SingleChange(bt.ChangeIndex), caps); err != nil {
+			errs = append(errs, fmt.Errorf("transaction %v: %w", i, err))
+		}
+		if int(bt.SigIndex) < len(txn.Signatures) && !txn.Signatures[bt.SigIndex].CoveredFields.WholeTransaction {
+			errs = append(errs, fmt.Errorf("transaction %v: batched transactions must be signed with whole-transaction signatures", i))
+		}
+		if len(txn.FileContracts) > 0 || len(txn.FileContractRevisions) > 0 {
+			errs = append(errs, fmt.Errorf("transaction %v: file contracts cannot be batched", i))
+		}
+		for _, sco := range txn.SiacoinOutputs {
+			dests[dest{false, sco.Address}] = struct{}{}
+		}
+		for _, sfo := range txn.SiafundOutputs {
+			dests[dest{true, sfo.Address}] = struct{}{}
+		}
+	}
+	if caps.MaxBatchDests > 0 && len(dests) > caps.MaxBatchDests {
+		errs = append(errs, fmt.Errorf("batch sends to %v destinations; the device supports at most %v", len(dests), caps.MaxBatchDests))
+	}
+	return errors.Join(errs...)
+}
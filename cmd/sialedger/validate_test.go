@@ -0,0 +1,142 @@
+package main
+
+import (
+	"crypto/ed25519"
+	"encoding/hex"
+	"errors"
+	"testing"
+
+	"go.sia.tech/core/types"
+)
+
+// openTestNano returns an emulated device with a zero seed, skipping the test
+// if sialedger was built without the emulator tag.
+func openTestNano(t *testing.T) *Nano {
+	t.Helper()
+	n, err := OpenEmulator(make([]byte, 32))
+	if err != nil {
+		t.Skip(err)
+	} else if err := n.Negotiate(); err != nil {
+		t.Fatal(err)
+	}
+	return n
+}
+
+func mustDecodeHex(s string) []byte {
+	b, err := hex.DecodeString(s)
+	if err != nil {
+		panic(err)
+	}
+	return b
+}
+
+// testPolicyTxn returns test_policy_transaction from
+// tests/test_set_policy_cmd.py: one siacoin input, siacoin outputs of 1 SC and
+// 2 SC, a miner fee of 1 SC, and a signature covering the whole transaction.
+func testPolicyTxn() types.Transaction {
+	var key types.PublicKey
+	var addrA, addrB types.Address
+	var parentID types.Hash256
+	copy(key[:], mustDecodeHex("4dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f49"))
+	copy(addrA[:], mustDecodeHex("7813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d6245"))
+	copy(addrB[:], mustDecodeHex("6f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df0"))
+	copy(parentID[:], mustDecodeHex("784a77549f25083a69a388a1661e0a6b2ac8c7fc98e2b69edde6bd45d155ad03"))
+	return types.Transaction{
+		SiacoinInputs: []types.SiacoinInput{{
+			UnlockConditions: types.UnlockConditions{
+				PublicKeys: []types.UnlockKey{key.UnlockKey()},
+			},
+		}},
+		SiacoinOutputs: []types.SiacoinOutput{
+			{Value: types.Siacoins(1), Address: addrA},
+			{Value: types.Siacoins(2), Address: addrB},
+		},
+		MinerFees: []types.Currency{types.Siacoins(1)},
+		Signatures: []types.TransactionSignature{{
+			ParentID:      parentID,
+			CoveredFields: types.CoveredFields{WholeTransaction: true},
+			Signature:     make([]byte, 64),
+		}},
+	}
+}
+
+func TestTxnVectors(t *testing.T) {
+	n := openTestNano(t)
+	txn := testPolicyTxn()
+	want := mustDecodeHex("c845fb5076af89801f6a30fe0d1d170039127a707b1f101b26e141aba16c4cc2")
+
+	hash, id, err := n.CalcTxnHashAndID(txn, 0, NoChange)
+	if err != nil {
+		t.Fatal(err)
+	} else if string(hash[:]) != string(want) {
+		t.Errorf("hash is %x, want %x", hash, want)
+	} else if id != txn.ID() {
+		t.Errorf("ID is %v, want %v", id, txn.ID())
+	}
+
+	keys, err := n.GetPublicKeys(0, 1)
+	if err != nil {
+		t.Fatal(err)
+	}
+	sig, err := n.SignTxn(txn, 0, 0, NoChange)
+	if err != nil {
+		t.Fatal(err)
+	} else if !ed25519.Verify(keys[0][:], want, sig[:]) {
+		t.Error("signature does not verify under key 0")
+	}
+}
+
+// TestValidateTxn checks that ValidateTxn accepts exactly the transactions
+// that the device accepts.
+func TestValidateTxn(t *testing.T) {
+	n := openTestNano(t)
+	caps := n.capabilities()
+
+	tooMany := testPolicyTxn()
+	for len(tooMany.SiacoinOutputs)+len(tooMany.MinerFees) < caps.MaxElems {
+		tooMany.SiacoinOutputs = append(tooMany.SiacoinOutputs, tooMany.SiacoinOutputs[0])
+	}
+	mostElems := testPolicyTxn()
+	mostElems.SiacoinOutputs = tooMany.SiacoinOutputs[1:]
+
+	for _, test := range []struct {
+		desc     string
+		modify   func(txn *types.Transaction)
+		sigIndex uint16
+		valid    bool
+	}{
+		{"whole transaction", func(*types.Transaction) {}, 0, true},
+		{"partial signature", func(txn *types.Transaction) {
+			txn.Signatures[0].CoveredFields = types.CoveredFields{SiacoinOutputs: []uint64{0}, MinerFees: []uint64{0}}
+		}, 0, true},
+		{"most elements", func(txn *types.Transaction) { *txn = mostElems }, 0, true},
+		{"too many elements", func(txn *types.Transaction) { *txn = tooMany }, 0, false},
+		{"missing signature", func(*types.Transaction) {}, 1, false},
+		{"arbitrary data", func(txn *types.Transaction) {
+			txn.ArbitraryData = [][]byte{{1, 2, 3}}
+		}, 0, false},
+		{"signature covers itself", func(txn *types.Transaction) {
+			txn.Signatures[0].CoveredFields = types.CoveredFields{SiacoinOutputs: []uint64{0}, Signatures: []uint64{0}}
+		}, 0, false},
+		{"whole transaction with covered elements", func(txn *types.Transaction) {
+			txn.Signatures[0].CoveredFields.MinerFees = []uint64{0}
+		}, 0, false},
+	} {
+		txn := testPolicyTxn()
+		test.modify(&txn)
+		if err := ValidateTxn(txn, test.sigIndex, NoChange, caps); (err == nil) != test.valid {
+			t.Errorf("%v: ValidateTxn returned %v", test.desc, err)
+		}
+		// bypass prepareTxn, which would call ValidateTxn itself
+		et, err := encodeTxn(txn, 0, test.sigIndex, NoChange)
+		if err != nil {
+			t.Fatalf("%v: %v", test.desc, err)
+		}
+		_, err = openTestNano(t).streamTxn(p2DisplayHash, et)
+		if test.valid && err != nil {
+			t.Errorf("%v: device rejected transaction: %v", test.desc, err)
+		} else if !test.valid && !errors.Is(err, errInvalidParam) {
+			t.Errorf("%v: device returned %v, want %v", test.desc, err, errInvalidParam)
+		}
+	}
+}
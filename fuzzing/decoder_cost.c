@@ -0,0 +1,119 @@
+// This file runs the transaction decoder on the host, measuring the work it
+// does. The decoder is built from the app's own sources against the SDK
+// stand-ins used by the Go client's emulator; the few SDK and app functions
+// that it calls are provided here. Hashing is not performed, only counted,
+// so the SigHash computed here is meaningless.
+
+#include "decoder_cost.h"
+
+#include <cx.h>
+#include <os.h>
+#include <string.h>
+
+#include "sia.h"
+#include "txn.h"
+
+try_context_t *G_try_last;
+
+void *emu_pic(const void *addr) {
+    return (void *) addr;
+}
+
+cx_err_t cx_blake2b_init_no_throw(cx_blake2b_t *hash, size_t size) {
+    (void) size;
+    memset(hash, 0, sizeof(cx_blake2b_t));
+    return CX_OK;
+}
+
+cx_err_t cx_hash_no_throw(cx_hash_t *hash,
+                          uint32_t mode,
+                          const uint8_t *in,
+                          size_t len,
+                          uint8_t *out,
+                          size_t out_len) {
+    (void) hash;
+    (void) mode;
+    (void) in;
+    (void) len;
+    if (out != NULL) {
+        memset(out, 0, out_len);
+    }
+    return CX_OK;
+}
+
+void bin2hex(char *dst, const uint8_t *data, uint64_t inlen) {
+    static const char hex[] = "0123456789abcdef";
+    for (uint64_t i = 0; i < inlen; i++) {
+        dst[2 * i + 0] = hex[data[i] >> 4];
+        dst[2 * i + 1] = hex[data[i] & 0x0F];
+    }
+    dst[2 * inlen] = '\0';
+}
+
+// Change addresses are derived from the key index alone, so that an input can
+// send change to a known address: the unlock hash of key index i is 32 bytes
+// of i + 1.
+void deriveSiaPublicKey(uint32_t index, uint8_t publicKey[static 65]) {
+    memset(publicKey, (uint8_t) (index + 1), 65);
+}
+
+void pubkeyToSiaUnlockHash(uint8_t dst[static 32], const uint8_t publicKey[static 65]) {
+    memmove(dst, publicKey, 32);
+}
+
+static txn_state_t txn;
+
+int decode_cost(const uint8_t *data, size_t size, decoder_cost_t *cost) {
+    if (size < DECODE_HEADER_LEN) {
+        return 0;
+    }
+    const uint8_t flags = data[0];
+    const size_t packetLen = (data[1] == 0) ? 255 : data[1];
+    const uint16_t sigIndex = U2LE(data, 2);
+    data += DECODE_HEADER_LEN;
+    size -= DECODE_HEADER_LEN;
+
+    memset(&txn_profile, 0, sizeof(txn_profile));
+    txn_init(&txn, sigIndex, (flags & DECODE_CHANGE) ? 0 : TXN_NO_CHANGE);
+    if (flags & DECODE_CHANGE) {
+        txn_set_change_count(&txn, MAX_CHANGE_ADDRS);
+    }
+    if (flags & DECODE_TXN_ID) {
+        txn_compute_id(&txn);
+    }
+    if (flags & DECODE_HASH_ONLY) {
+        txn_hash_only(&txn);
+    }
+
+    // As in handleCalcTxnHash, decoding stops at the first packet that
+    // finishes or fails.
+    txnDecoderState_e state = TXN_STATE_PARTIAL;
+    size_t off = 0;
+    while (off < size && state == TXN_STATE_PARTIAL) {
+        uint8_t n = (size - off < packetLen) ? size - off : packetLen;
+        if (flags & DECODE_ZERO_RLE) {
+            // As the computer does, never split a run from its count.
+            size_t i = 0;
+            while (i < n) {
+                i += (data[off + i] == 0) ? 2 : 1;
+            }
+            if (i > n && n > 1) {
+                n--;
+            }
+            state = txn_parse_rle(&txn, data + off, n);
+        } else {
+            txn_update(&txn, (uint8_t *) data + off, n);
+            state = txn_parse(&txn);
+        }
+        off += n;
+    }
+
+    const double len = (off > 0) ? off : 1;
+    cost->readBytes = txn_profile.readBytes / len;
+    cost->movedBytes = txn_profile.movedBytes / len;
+    cost->hashedBytes = txn_profile.hashedBytes / len;
+    cost->hashCalls = txn_profile.hashCalls / len;
+    cost->dataLen = off;
+    cost->state = state;
+    return 1;
+}
@@ -0,0 +1,38 @@
+#ifndef DECODER_COST_H
+#define DECODER_COST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// An input begins with a header that selects how the transaction is sent,
+// followed by the transaction data:
+//
+//   byte 0     flags (DECODE_*)
+//   byte 1     packet size; 0 means 255
+//   bytes 2-3  little-endian signature index
+//
+// The data is split into packets of the given size, as the computer would
+// send them, and decoded until the decoder finishes or fails.
+#define DECODE_HEADER_LEN 4
+
+#define DECODE_ZERO_RLE  0x01  // packets are zero-run encoded
+#define DECODE_TXN_ID    0x02  // the transaction ID is computed
+#define DECODE_CHANGE    0x04  // change is sent to key indices 0 to MAX_CHANGE_ADDRS-1
+#define DECODE_HASH_ONLY 0x08  // no elements are kept for display
+
+// decoder_cost_t holds the work done to decode an input, per byte of
+// transaction data received.
+typedef struct {
+    double readBytes;
+    double movedBytes;
+    double hashedBytes;
+    double hashCalls;
+    uint32_t dataLen;  // bytes of transaction data received
+    int state;         // the final txnDecoderState_e
+} decoder_cost_t;
+
+// decode_cost decodes an input, returning the work done. It returns 0 if the
+// input is too short to hold a header.
+int decode_cost(const uint8_t *data, size_t size, decoder_cost_t *cost);
+
+#endif /* DECODER_COST_H */
@@ -0,0 +1,37 @@
+// This file is a libFuzzer target for the transaction decoder. Crashes are
+// found as usual, but the fuzzer is also steered towards inputs that make the
+// decoder do the most work per byte received: each measure of work is divided
+// into logarithmic buckets, and reaching a bucket for the first time counts as
+// new coverage, so inputs that are more expensive than any seen before are
+// kept in the corpus.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder_cost.h"
+
+#define COST_BUCKETS 64
+
+// libFuzzer treats every non-zero byte in this section as a feature.
+__attribute__((used, section("__libfuzzer_extra_counters"))) static uint8_t
+    extraCounters[4][COST_BUCKETS];
+
+// bucket maps a cost per byte to one of COST_BUCKETS buckets, eight per
+// doubling, so that costs up to about 230 per byte are distinguished.
+static int bucket(double perByte) {
+    const int b = (int) (8 * log2(1 + perByte));
+    return (b < COST_BUCKETS) ? b : COST_BUCKETS - 1;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    decoder_cost_t cost;
+    if (!decode_cost(data, size, &cost)) {
+        return 0;
+    }
+    extraCounters[0][bucket(cost.readBytes)] = 1;
+    extraCounters[1][bucket(cost.movedBytes)] = 1;
+    extraCounters[2][bucket(cost.hashedBytes)] = 1;
+    extraCounters[3][bucket(cost.hashCalls)] = 1;
+    return 0;
+}
@@ -0,0 +1,96 @@
+// This file replays a corpus of inputs through the transaction decoder and
+// checks that none of them costs more per byte than the limits below. The
+// corpus holds the most expensive inputs that the fuzzer has found, so a
+// change to the decoder that makes any of them more expensive fails the test.
+//
+// Usage: replay_txn_decoder [file or directory]...
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "decoder_cost.h"
+
+// The limits are per byte of transaction data received, about 20% above the
+// most expensive input in the corpus. Zero-run encoding lets two bytes expand
+// to 255 zero bytes, each of which must be moved, parsed and perhaps hashed,
+// so encoded inputs set most of the limits; an element that is sent a byte at
+// a time is parsed again for every byte, which sets the limit on reads.
+#define MAX_READ_BYTES   310.0
+#define MAX_MOVED_BYTES  760.0
+#define MAX_HASHED_BYTES 310.0
+#define MAX_HASH_CALLS   10.0
+
+#define MAX_INPUT_LEN (64 * 1024)
+
+static bool replayFile(const char *path) {
+    static uint8_t buf[MAX_INPUT_LEN];
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    const size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+
+    decoder_cost_t cost;
+    if (!decode_cost(buf, n, &cost)) {
+        fprintf(stderr, "%s: input is too short\n", path);
+        return false;
+    }
+    const bool ok = cost.readBytes <= MAX_READ_BYTES && cost.movedBytes <= MAX_MOVED_BYTES &&
+                    cost.hashedBytes <= MAX_HASHED_BYTES && cost.hashCalls <= MAX_HASH_CALLS;
+    printf("%-40s %6u bytes  read %7.2f  moved %7.2f  hashed %7.2f  hash calls %5.2f%s\n",
+           path,
+           cost.dataLen,
+           cost.readBytes,
+           cost.movedBytes,
+           cost.hashedBytes,
+           cost.hashCalls,
+           ok ? "" : "  OVER LIMIT");
+    return ok;
+}
+
+static bool replayPath(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return false;
+    } else if (!S_ISDIR(st.st_mode)) {
+        return replayFile(path);
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        perror(path);
+        return false;
+    }
+    bool ok = true;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+        ok = replayPath(child) && ok;
+    }
+    closedir(dir);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s [file or directory]...\n", argv[0]);
+        return 2;
+    }
+    bool ok = true;
+    for (int i = 1; i < argc; i++) {
+        ok = replayPath(argv[i]) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""Count the instructions the app executes in each test scenario.
+
+Each test is run on its own under Speculos, with QEMU logging every
+instruction that it executes. The program counters are mapped to functions
+using the app's ELF, and call stacks are rebuilt from the flow of control.
+For each scenario this writes:
+
+  <scenario>.txt     instructions per function, self and inclusive
+  <scenario>.folded  folded stacks, for flamegraph.pl, inferno or speedscope
+  <scenario>.svg     a flamegraph, if flamegraph.pl or inferno-flamegraph is
+                     installed
+
+along with all.folded, which holds every scenario under its own root, and
+summary.txt. See README.md.
+"""
+
+import argparse
+import bisect
+import os
+import re
+import shutil
+import subprocess
+import sys
+from collections import Counter
+from pathlib import Path
+from typing import Dict, List, Tuple
+
+from elftools.elf.elffile import ELFFile
+from elftools.elf.sections import SymbolTableSection
+
+ROOT = Path(__file__).parent.parent.resolve()
+TESTS = ROOT / "tests"
+DEFAULT_TESTS = ["test_sign_txn_cmd.py", "test_pubkey_cmd.py"]
+
+# The build directory of each device, as used by ragger.
+BUILD_DIRS = {"nanos": "nanos", "nanox": "nanox", "nanosp": "nanos2", "stax": "stax"}
+
+# Code outside the app: the Speculos launcher, which implements the syscalls.
+OS_FRAME = "[os]"
+
+# An executed block, as logged by `-d exec`. Depending on the version of
+# QEMU, the PC is preceded by cs_base or is the only field in the brackets.
+TRACE_RE = re.compile(rb"^Trace (?:\d+: )?\S+ \[(?:[0-9a-f]+/)?([0-9a-f]+)[/\]]")
+
+
+class Symbols:
+    """Maps program counters to the functions of an ELF."""
+
+    def __init__(self, elf_path: Path, offset: int) -> None:
+        funcs: List[Tuple[int, int, str]] = []
+        with open(elf_path, "rb") as f:
+            for section in ELFFile(f).iter_sections():
+                if not isinstance(section, SymbolTableSection):
+                    continue
+                for sym in section.iter_symbols():
+                    if sym["st_info"]["type"] != "STT_FUNC" or sym["st_size"] == 0:
+                        continue
+                    # Thumb function addresses have their low bit set.
+                    start = (sym["st_value"] & ~1) + offset
+                    funcs.append((start, start + sym["st_size"], sym.name))
+        funcs.sort()
+        self.funcs = funcs
+        self.starts = [f[0] for f in funcs]
+        self.cache: Dict[int, Tuple[str, bool]] = {}
+
+    def lookup(self, pc: int) -> Tuple[str, bool]:
+        """Returns the function containing pc, and whether pc is its entry."""
+        hit = self.cache.get(pc)
+        if hit is None:
+            i = bisect.bisect_right(self.starts, pc) - 1
+            if i >= 0 and pc < self.funcs[i][1]:
+                hit = (self.funcs[i][2], pc == self.funcs[i][0])
+            else:
+                hit = (OS_FRAME, False)
+            self.cache[pc] = hit
+        return hit
+
+
+def fold_trace(trace_path: Path, symbols: Symbols) -> Counter:
+    """Counts the instructions executed in each call stack of a trace.
+
+    A jump to the entry of another function is taken to be a call (or a tail
+    call), and a jump into a function already on the stack a return to it;
+    any other jump between functions replaces the innermost frame. Entering
+    code outside the app pushes an OS_FRAME.
+    """
+    stacks: Counter = Counter()
+    stack: List[str] = []
+    key = ""
+    prev = ""
+    with open(trace_path, "rb") as f:
+        for line in f:
+            m = TRACE_RE.match(line)
+            if m is None:
+                continue
+            name, entry = symbols.lookup(int(m.group(1), 16))
+            if name != prev:
+                if not stack:
+                    stack.append(name)
+                elif entry or (name == OS_FRAME and stack[-1] != OS_FRAME):
+                    stack.append(name)
+                elif name in stack:
+                    del stack[len(stack) - stack[::-1].index(name):]
+                else:
+                    stack[-1] = name
+                key = ";".join(stack)
+                prev = name
+            stacks[key] += 1
+    return stacks
+
+
+def function_counts(stacks: Counter) -> Tuple[Counter, Counter]:
+    """Returns the self and inclusive instruction counts of each function."""
+    self_counts: Counter = Counter()
+    incl_counts: Counter = Counter()
+    for key, count in stacks.items():
+        frames = key.split(";")
+        self_counts[frames[-1]] += count
+        for name in set(frames):
+            incl_counts[name] += count
+    return self_counts, incl_counts
+
+
+def write_report(out: Path, scenario: str, stacks: Counter) -> int:
+    total = sum(stacks.values())
+    with open(out / f"{scenario}.folded", "w", encoding="utf-8") as f:
+        for key, count in sorted(stacks.items()):
+            f.write(f"{key} {count}\n")
+
+    self_counts, incl_counts = function_counts(stacks)
+    with open(out / f"{scenario}.txt", "w", encoding="utf-8") as f:
+        f.write(f"{scenario}: {total} instructions\n\n")
+        f.write(f"{'self':>12} {'self%':>6} {'inclusive':>12} {'incl%':>6}  function\n")
+        for name, count in self_counts.most_common():
+            incl = incl_counts[name]
+            f.write(f"{count:12} {100 * count / total:6.2f} "
+                    f"{incl:12} {100 * incl / total:6.2f}  {name}\n")
+
+    renderer = shutil.which("flamegraph.pl") or shutil.which("inferno-flamegraph")
+    if renderer is not None:
+        with open(out / f"{scenario}.folded", "rb") as src, \
+                open(out / f"{scenario}.svg", "wb") as dst:
+            subprocess.run([renderer, "--title", scenario, "--countname", "instructions"],
+                           stdin=src, stdout=dst, check=False)
+    return total
+
+
+def collect_tests(files: List[str], device: str, pytest_args: List[str]) -> List[str]:
+    result = subprocess.run(
+        [sys.executable, "-m", "pytest", "--collect-only", "-q", "--device", device]
+        + pytest_args + files,
+        cwd=TESTS, capture_output=True, text=True, check=False)
+    tests = [line for line in result.stdout.splitlines() if "::" in line]
+    if not tests:
+        sys.exit(f"no tests collected:\n{result.stdout}{result.stderr}")
+    return tests
+
+
+def run_test(test: str, device: str, pytest_args: List[str], trace: Path) -> bool:
+    # Speculos runs the app with qemu-arm-static, which reads its logging
+    # options from the environment. Translating one instruction per block
+    # makes each logged block a single instruction.
+    env = dict(os.environ,
+               QEMU_LOG="exec,nochain",
+               QEMU_LOG_FILENAME=str(trace),
+               QEMU_ONE_INSN_PER_TB="1",
+               QEMU_SINGLESTEP="1")
+    result = subprocess.run(
+        [sys.executable, "-m", "pytest", "-q", "--device", device] + pytest_args + [test],
+        cwd=TESTS, env=env, check=False)
+    return result.returncode == 0
+
+
+def scenario_name(test: str) -> str:
+    return re.sub(r"[^\w.-]+", "_", test.replace(".py::", "-"))
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("tests", nargs="*", default=DEFAULT_TESTS,
+                        help="test files or IDs, relative to tests/ (default: %(default)s)")
+    parser.add_argument("--device", default="nanosp", choices=sorted(BUILD_DIRS))
+    parser.add_argument("--elf", type=Path,
+                        help="the app's ELF (default: build/<device>/bin/app.elf)")
+    parser.add_argument("--load-offset", type=lambda s: int(s, 0), default=0,
+                        help="the difference between the app's run and link addresses")
+    parser.add_argument("--out", type=Path, default=ROOT / "build" / "profile")
+    parser.add_argument("--keep-traces", action="store_true",
+                        help="keep the instruction traces, which are large")
+    parser.add_argument("--trace", type=Path,
+                        help="analyze an existing trace instead of running the tests")
+    parser.add_argument("-k", dest="keyword", help="only run tests matching this expression")
+    args = parser.parse_args()
+
+    elf = args.elf or ROOT / "build" / BUILD_DIRS[args.device] / "bin" / "app.elf"
+    if not elf.is_file():
+        sys.exit(f"{elf} not found: build the app for {args.device} first")
+    symbols = Symbols(elf, args.load_offset)
+    args.out.mkdir(parents=True, exist_ok=True)
+
+    if args.trace is not None:
+        stacks = fold_trace(args.trace, symbols)
+        total = write_report(args.out, args.trace.stem, stacks)
+        print(f"{args.trace.stem}: {total} instructions")
+        return
+
+    pytest_args = ["-k", args.keyword] if args.keyword else []
+    results = []
+    combined: Counter = Counter()
+    for test in collect_tests(args.tests, args.device, pytest_args):
+        scenario = scenario_name(test)
+        trace = args.out / f"{scenario}.trace"
+        trace.unlink(missing_ok=True)
+        passed = run_test(test, args.device, pytest_args, trace)
+        if not trace.is_file():
+            sys.exit(f"{test}: QEMU wrote no trace; check that Speculos runs qemu-arm-static")
+
+        stacks = fold_trace(trace, symbols)
+        if not args.keep_traces:
+            trace.unlink()
+        if all(key == OS_FRAME for key in stacks):
+            print(f"{test}: no instructions fell within {elf.name}; check --load-offset",
+                  file=sys.stderr)
+        total = write_report(args.out, scenario, stacks)
+        for key, count in stacks.items():
+            combined[f"{scenario};{key}"] += count
+        results.append((scenario, total, passed))
+
+    with open(args.out / "all.folded", "w", encoding="utf-8") as f:
+        for key, count in sorted(combined.items()):
+            f.write(f"{key} {count}\n")
+    with open(args.out / "summary.txt", "w", encoding="utf-8") as f:
+        for scenario, total, passed in results:
+            line = f"{total:14} {scenario}{'' if passed else '  (test failed)'}"
+            f.write(line + "\n")
+            print(line)
+
+
+if __name__ == "__main__":
+    main()
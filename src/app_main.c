@@ -28,11 +28,13 @@
 #include "blake2b.h"
 #include "sia.h"
 #include "sia_ux.h"
+#include "stack.h"
 
 // These are global variables declared in ux.h. They can't be defined there
 // because multiple files include ux.h; they need to be defined in exactly one
 // place. See ux.h for their descriptions.
 commandContext global;
+bool uiBusy;
 const internalStorage_t N_storage_real;
 
 void ui_idle(void);
@@ -40,6 +42,12 @@ void ui_menu_about(void);
 
 static void update_blind_sign_ui(void);
 
+void app_quit(void) {
+    clearKeyCache();
+    // exit app here
+    os_sched_exit(-1);
+}
+
 static void toggle_blind_sign(void) {
     const bool new_value = !N_storage.blindSign;
     nvm_write((void *) &N_storage.blindSign, (void *) &new_value, sizeof(bool));
@@ -51,7 +59,7 @@ static char BLIND_SIGNING_MESSAGE[22] = {0};
 
 UX_STEP_NOCB(ux_menu_ready_step, nn, {"Awaiting", "commands"});
 UX_STEP_CB(ux_menu_about_step, pn, ui_menu_about(), {&C_icon_certificate, "About"});
-UX_STEP_VALID(ux_menu_exit_step, pn, os_sched_exit(0), {&C_icon_dashboard, "Quit"});
+UX_STEP_VALID(ux_menu_exit_step, pn, app_quit(), {&C_icon_dashboard, "Quit"});
 
 // flow for the main menu:
 // #1 screen: ready
@@ -79,6 +87,7 @@ UX_FLOW(ux_menu_about_flow,
         FLOW_LOOP);
 
 void ui_idle(void) {
+    uiBusy = false;
     if (G_ux.stack_count == 0) {
         ux_stack_push();
     }
@@ -143,12 +152,8 @@ static void update_blind_sign_ui(void) {
     switches[BLIND_SIGNING_ID].initState = N_storage.blindSign ? ON_STATE : OFF_STATE;
 }
 
-void app_quit(void) {
-    // exit app here
-    os_sched_exit(-1);
-}
-
 void ui_idle(void) {
+    uiBusy = false;
     switches[BLIND_SIGNING_ID].text = "Enable blind signing";
     switches[BLIND_SIGNING_ID].subText = "Recommend only for experienced users";
     switches[BLIND_SIGNING_ID].token = BLIND_SIGNING_TOKEN;
@@ -176,10 +181,18 @@ unsigned int io_reject(void) {
 // The APDU protocol uses a single-byte instruction code (INS) to specify
 // which command should be executed. We'll use this code to dispatch on a
 // table of function pointers.
-#define INS_GET_VERSION    0x01
-#define INS_GET_PUBLIC_KEY 0x02
-#define INS_SIGN_HASH      0x04
-#define INS_GET_TXN_HASH   0x08
+#define INS_GET_VERSION     0x01
+#define INS_GET_PUBLIC_KEY  0x02
+#define INS_SIGN_HASH       0x04
+#define INS_GET_TXN_HASH    0x08
+#define INS_SIGN_TXN_BATCH  0x10
+#define INS_SIGN_MESSAGE    0x12
+#define INS_SET_POLICY      0x13
+#define INS_ADD_TRUSTED     0x14
+#define INS_CLEAR_TEMPLATES 0x15
+#ifdef HAVE_STACK_PROFILE
+#define INS_GET_STACK_USAGE 0x11
+#endif
 
 // This is the function signature for a command handler.
 // Returns 0 on success.
@@ -189,6 +202,14 @@ handler_fn_t handleGetVersion;
 handler_fn_t handleGetPublicKey;
 handler_fn_t handleSignHash;
 handler_fn_t handleCalcTxnHash;
+handler_fn_t handleSignTxnBatch;
+handler_fn_t handleSignMessage;
+handler_fn_t handleSetPolicy;
+handler_fn_t handleAddTrusted;
+handler_fn_t handleClearTemplates;
+#ifdef HAVE_STACK_PROFILE
+handler_fn_t handleGetStackUsage;
+#endif
 
 static handler_fn_t *lookupHandler(uint8_t ins) {
     switch (ins) {
@@ -200,11 +221,64 @@ static handler_fn_t *lookupHandler(uint8_t ins) {
             return handleSignHash;
         case INS_GET_TXN_HASH:
             return handleCalcTxnHash;
+        case INS_SIGN_TXN_BATCH:
+            return handleSignTxnBatch;
+        case INS_SIGN_MESSAGE:
+            return handleSignMessage;
+        case INS_SET_POLICY:
+            return handleSetPolicy;
+        case INS_ADD_TRUSTED:
+            return handleAddTrusted;
+        case INS_CLEAR_TEMPLATES:
+            return handleClearTemplates;
+#ifdef HAVE_STACK_PROFILE
+        case INS_GET_STACK_USAGE:
+            return handleGetStackUsage;
+#endif
         default:
             return NULL;
     }
 }
 
+// contextIns is the INS of the command whose state is held in global.
+static uint8_t contextIns;
+
+// usesContext reports whether a command keeps any state in global.
+static bool usesContext(uint8_t ins) {
+    switch (ins) {
+        case INS_GET_VERSION:
+        case INS_CLEAR_TEMPLATES:
+#ifdef HAVE_STACK_PROFILE
+        case INS_GET_STACK_USAGE:
+#endif
+            return false;
+        default:
+            return true;
+    }
+}
+
+// claimContext prepares global for a command. Only the state of the most
+// recent command is kept there, so a command with a different INS discards
+// it; otherwise, state left behind by one command could be used by another.
+// (An approved batch, for instance, could be signed with a hash left by a
+// later GET_TXN_HASH.) While a review is on screen, only the packets that
+// continue the command under review are accepted.
+static uint16_t claimContext(uint8_t ins, uint8_t p1) {
+    if (!usesContext(ins)) {
+        return 0;
+    } else if (uiBusy) {
+        if (ins != contextIns || (p1 != P1_MORE && p1 != P1_RESUME)) {
+            return SW_IMPROPER_INIT;
+        }
+        return 0;
+    }
+    if (ins != contextIns) {
+        explicit_bzero(&global, sizeof(global));
+        contextIns = ins;
+    }
+    return 0;
+}
+
 // These are the offsets of various parts of a request APDU packet. INS
 // identifies the requested command (see above), and P1 and P2 are parameters
 // to the command.
@@ -250,18 +324,37 @@ void app_main() {
     io_init();
 
     if (!N_storage.initialized) {
-        internalStorage_t storage = {0};
-        storage.initialized = true;
-        nvm_write((void *) &N_storage, (void *) &storage, sizeof(internalStorage_t));
+        // The trusted addresses and templates make the storage too large to
+        // be cleared through a copy on the stack, so only the fields that are
+        // read before they are written are reset.
+        const bool disabled = false;
+        const uint16_t trustedCount = 0;
+        const uint8_t templateCount = 0;
+        const bool initialized = true;
+        nvm_write((void *) &N_storage.blindSign, (void *) &disabled, sizeof(bool));
+        nvm_write((void *) &N_storage.policy.enabled, (void *) &disabled, sizeof(bool));
+        nvm_write((void *) &N_storage.trusted.count, (void *) &trustedCount, sizeof(uint16_t));
+        nvm_write((void *) &N_storage.templates.count, (void *) &templateCount, sizeof(uint8_t));
+        nvm_write((void *) &N_storage.initialized, (void *) &initialized, sizeof(bool));
     }
     update_blind_sign_ui();
     ui_idle();
 
     int input_len = 0;
     command_t cmd = {0};
+#ifdef HAVE_STACK_PROFILE
+    // The UX callbacks run while we wait for the next command, so their stack
+    // use is attributed to the previous command.
+    uint8_t prev_ins = 0;
+    stack_paint();
+#endif
     for (;;) {
         // Read command into G_io_apdu_buffer
-        if ((input_len = io_recv_command()) < 0) {
+        input_len = io_recv_command();
+#ifdef HAVE_STACK_PROFILE
+        stack_record(prev_ins, true);
+#endif
+        if (input_len < 0) {
             PRINTF("Failed to receive");
             io_send_sw(SW_INVALID_PARAM);
             continue;
@@ -281,9 +374,31 @@ void app_main() {
             send_error_code(SW_INS_NOT_SUPPORTED);
             continue;
         }
+        const uint16_t claimErr = claimContext(cmd.ins, cmd.p1);
+        if (claimErr != 0) {
+            send_error_code(claimErr);
+            continue;
+        }
 
+#ifdef HAVE_STACK_PROFILE
+        stack_paint();
+#endif
         const uint16_t e = handlerFn(cmd.p1, cmd.p2, cmd.data, cmd.lc);
+#ifdef HAVE_STACK_PROFILE
+        stack_record(cmd.ins, false);
+        prev_ins = cmd.ins;
+        stack_paint();
+#endif
         if (e != 0) {
+            if (e != SW_OK) {
+                clearKeyCache();
+                // A command that fails while it is being reviewed abandons
+                // the review.
+                if (uiBusy && usesContext(cmd.ins)) {
+                    explicit_bzero(&global, sizeof(global));
+                    ui_idle();
+                }
+            }
             send_error_code(e);
             continue;
         }
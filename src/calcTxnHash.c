@@ -29,8 +29,11 @@
 #include <io.h>
 
 #include "blake2b.h"
+#include "policy.h"
 #include "sia.h"
 #include "sia_ux.h"
+#include "templates.h"
+#include "trusted.h"
 #include "txn.h"
 
 static calcTxnHashContext_t *ctx = &global.calcTxnHashContext;
@@ -39,6 +42,12 @@ static void fmtTxnElem(void);
 static uint16_t display_index(void);
 static unsigned int ui_calcTxnHash_elem_button(void);
 static unsigned int io_seproxyhal_touch_txn_hash_ok(void);
+static unsigned int io_seproxyhal_touch_policy_txn_ok(void);
+static unsigned int ui_summary_button(void);
+static unsigned int show_elements(void);
+
+// the number of summary screens before the destinations
+#define SUMMARY_HEADER_ITEMS 2
 
 UX_STEP_CB(ux_compare_hash_flow_1_step,
            bnnn_paging,
@@ -65,6 +74,65 @@ UX_FLOW(ux_sign_txn_flow,
         &ux_sign_txn_flow_2_step,
         &ux_sign_txn_flow_3_step);
 
+UX_STEP_CB(ux_sign_summary_flow_3_step, pb, show_elements(), {&C_icon_eye, "Review outputs"});
+
+// Flow for signing a summarized transaction:
+// #1 screen: "Sign this txn?"
+// #2 screen: approve
+// #3 screen: review each element
+// #4 screen: reject
+UX_FLOW(ux_sign_summary_flow,
+        &ux_sign_txn_flow_1_step,
+        &ux_sign_txn_flow_2_step,
+        &ux_sign_summary_flow_3_step,
+        &ux_sign_txn_flow_3_step);
+
+UX_STEP_NOCB(ux_policy_txn_flow_1_step,
+             bnnn_paging,
+             {"Sign within policy", global.calcTxnHashContext.fullStr[0]});
+
+UX_STEP_VALID(ux_policy_txn_flow_2_step,
+              pb,
+              io_seproxyhal_touch_policy_txn_ok(),
+              {&C_icon_validate_14, "Approve"});
+
+UX_STEP_VALID(ux_policy_txn_flow_3_step, pb, io_reject(), {&C_icon_crossmark, "Reject"});
+
+// Flow for signing a transaction allowed by the signing policy:
+// #1 screen: the total amount sent, and the signing key
+// #2 screen: approve
+// #3 screen: reject
+UX_FLOW(ux_policy_txn_flow,
+        &ux_policy_txn_flow_1_step,
+        &ux_policy_txn_flow_2_step,
+        &ux_policy_txn_flow_3_step);
+
+UX_STEP_NOCB(ux_template_txn_flow_1_step,
+             bnnn_paging,
+             {"Recurring payout", global.calcTxnHashContext.fullStr[0]});
+
+// Flow for signing a transaction whose outputs match a payout template:
+// #1 screen: the template's label, the miner fee, and the signing key
+// #2 screen: approve
+// #3 screen: reject
+UX_FLOW(ux_template_txn_flow,
+        &ux_template_txn_flow_1_step,
+        &ux_sign_txn_flow_2_step,
+        &ux_sign_txn_flow_3_step);
+
+UX_STEP_NOCB(ux_save_template_flow_1_step,
+             bnnn_paging,
+             {"Sign and save as", global.calcTxnHashContext.fullStr[0]});
+
+// Flow for signing a transaction and saving its outputs as a template:
+// #1 screen: the template's label, and the signing key
+// #2 screen: approve
+// #3 screen: reject
+UX_FLOW(ux_save_template_flow,
+        &ux_save_template_flow_1_step,
+        &ux_sign_txn_flow_2_step,
+        &ux_sign_txn_flow_3_step);
+
 // We use one generic step for each element so we don't have to make
 // separate UX_FLOWs for SC outputs, SF outputs, miner fees, etc
 UX_STEP_CB(ux_show_txn_elem_1_step,
@@ -77,34 +145,138 @@ UX_STEP_CB(ux_show_txn_elem_1_step,
 // confirms that element, they are shown the next element until
 // they finish all the elements and are given the option to approve/reject.
 UX_FLOW(ux_show_txn_elem_flow, &ux_show_txn_elem_1_step);
+
+UX_STEP_CB(ux_partial_warning_1_step,
+           pnn,
+           ui_calcTxnHash_elem_button(),
+           {&C_icon_warning, "Partial", "signature"});
+
+// A partial signature is preceded by a warning, since the elements it does
+// not cover are not shown, and may be changed after it is signed.
+UX_FLOW(ux_partial_warning_flow, &ux_partial_warning_1_step);
+
+UX_STEP_CB(ux_show_summary_1_step,
+           bnnn_paging,
+           ui_summary_button(),
+           {global.calcTxnHashContext.labelStr, global.calcTxnHashContext.fullStr[0]});
+
+// In summary mode, the totals are shown first, followed by the total sent to
+// each destination, all on the same screen.
+UX_FLOW(ux_show_summary_flow, &ux_show_summary_1_step);
+
+// send_result sends the signature or SigHash of the transaction, followed by
+// its ID if it was requested.
+static void send_result(const uint8_t *result, uint8_t len) {
+    uint8_t resp[64 + 32];
+    memmove(resp, result, len);
+#ifndef TARGET_NANOS
+    if (ctx->txn.computeID) {
+        memmove(resp + len, ctx->txn.txnID, sizeof(ctx->txn.txnID));
+        len += sizeof(ctx->txn.txnID);
+    }
+#endif
+    io_send_response_pointer(resp, len, SW_OK);
+}
+
 static unsigned int io_seproxyhal_touch_txn_hash_ok(void) {
     uint8_t signature[64] = {0};
     deriveAndSign(signature, ctx->keyIndex, ctx->txn.sigHash);
-    io_send_response_pointer(signature, sizeof(signature), SW_OK);
+    if (ctx->saveTemplate) {
+        template_store(ctx->templateDigest, ctx->templateLabel);
+    }
+    send_result(signature, sizeof(signature));
+    ui_idle();
+    return 0;
+}
+
+static unsigned int io_seproxyhal_touch_policy_txn_ok(void) {
+    uint8_t signature[64] = {0};
+    deriveAndSign(signature, ctx->keyIndex, ctx->txn.sigHash);
+    policy_record(ctx->policyTotal);
+    send_result(signature, sizeof(signature));
     ui_idle();
     return 0;
 }
 
+// sign_under_policy signs a transaction that the stored policy allows,
+// either immediately or after a single confirmation, instead of displaying
+// each of its elements.
+static void sign_under_policy(void) {
+    // Reset the initialization state.
+    ctx->initialized = false;
+    ctx->finished = false;
+
+    if (!policy_confirm()) {
+        io_seproxyhal_touch_policy_txn_ok();
+        return;
+    }
+    const uint8_t valLen = cur2dec(ctx->fullStr[0], ctx->policyTotal);
+    const uint8_t scLen = formatSC(ctx->fullStr[0], valLen);
+    memmove(ctx->fullStr[0] + scLen, " with key #", 11);
+    bin2dec(ctx->fullStr[0] + scLen + 11, ctx->keyIndex);
+    ux_flow_init(0, ux_policy_txn_flow, NULL);
+}
+
+// sign_template asks for a single confirmation of a transaction whose outputs
+// match a stored payout template, instead of displaying each of its elements.
+// It returns false if no template matches.
+static bool sign_template(void) {
+    uint8_t fee[1 + 16];
+    const char *label = template_match(&ctx->txn, fee);
+    if (label == NULL) {
+        return false;
+    }
+    // Reset the initialization state.
+    ctx->initialized = false;
+    ctx->finished = false;
+
+    uint8_t len = strlen(label);
+    memmove(ctx->fullStr[0], label, len);
+    memmove(ctx->fullStr[0] + len, ", fee ", 6);
+    len += 6;
+    len += formatSC(ctx->fullStr[0] + len, cur2dec(ctx->fullStr[0] + len, fee));
+    memmove(ctx->fullStr[0] + len, " with key #", 11);
+    bin2dec(ctx->fullStr[0] + len + 11, ctx->keyIndex);
+    ux_flow_init(0, ux_template_txn_flow, NULL);
+    return true;
+}
+
+// finish_review displays the final screen, once the whole transaction has
+// been displayed. If a signature was requested, signFlow asks for approval.
+static void finish_review(const ux_flow_step_t *const *signFlow) {
+    if (ctx->saveTemplate) {
+        // The approval screen also names the template being saved.
+        const uint8_t len = strlen(ctx->templateLabel);
+        memmove(ctx->fullStr[0], ctx->templateLabel, len);
+        memmove(ctx->fullStr[0] + len, " with key #", 11);
+        memmove(ctx->fullStr[0] + len + 11 + (bin2dec(ctx->fullStr[0] + len + 11, ctx->keyIndex)),
+                "?",
+                2);
+        ux_flow_init(0, ux_save_template_flow, NULL);
+    } else if (ctx->sign) {
+        // If we're signing the transaction, prepare and display the
+        // approval screen.
+        memmove(ctx->fullStr[0], "with key #", 10);
+        memmove(ctx->fullStr[0] + 10 + (bin2dec(ctx->fullStr[0] + 10, ctx->keyIndex)), "?", 2);
+        ux_flow_init(0, signFlow, NULL);
+    } else {
+        // If we're just computing the hash, send it immediately and
+        // display the comparison screen
+        send_result(ctx->txn.sigHash, sizeof(ctx->txn.sigHash));
+        bin2hex(ctx->fullStr[0], ctx->txn.sigHash, sizeof(ctx->txn.sigHash));
+        ux_flow_init(0, ux_compare_hash_flow, NULL);
+    }
+    // Reset the initialization state.
+    ctx->elementIndex = 0;
+    ctx->initialized = false;
+    ctx->finished = false;
+}
+
 static unsigned int ui_calcTxnHash_elem_button(void) {
     if (ctx->elementIndex >= ctx->txn.elementIndex) {
         // We've finished decoding the transaction, and all elements have
         // been displayed.
-        if (ctx->sign) {
-            // If we're signing the transaction, prepare and display the
-            // approval screen.
-            memmove(ctx->fullStr[0], "with key #", 10);
-            memmove(ctx->fullStr[0] + 10 + (bin2dec(ctx->fullStr[0] + 10, ctx->keyIndex)), "?", 2);
-            ux_flow_init(0, ux_sign_txn_flow, NULL);
-        } else {
-            // If we're just computing the hash, send it immediately and
-            // display the comparison screen
-            io_send_response_pointer(ctx->txn.sigHash, sizeof(ctx->txn.sigHash), SW_OK);
-            bin2hex(ctx->fullStr[0], ctx->txn.sigHash, sizeof(ctx->txn.sigHash));
-            ux_flow_init(0, ux_compare_hash_flow, NULL);
-        }
-        // Reset the initialization state.
-        ctx->elementIndex = 0;
-        ctx->initialized = false;
+        finish_review(ux_sign_txn_flow);
         return 0;
     }
 
@@ -113,6 +285,75 @@ static unsigned int ui_calcTxnHash_elem_button(void) {
     return 0;
 }
 
+// fmtSummaryItem prepares the specified screen of the summary for display.
+// It stores the name of the screen in labelStr, and its value in fullStr.
+static void fmtSummaryItem(uint16_t index) {
+    txn_summary_t *sum = &ctx->totals;
+    switch (index) {
+        case 0: {
+            memmove(ctx->labelStr, "Total Sent", 11);
+            uint8_t len = formatSC(ctx->fullStr[0], cur2dec(ctx->fullStr[0], sum->sc));
+            if (sum->hasSF) {
+                memmove(ctx->fullStr[0] + len, " and ", 5);
+                len += 5;
+                len += cur2dec(ctx->fullStr[0] + len, sum->sf);
+                memmove(ctx->fullStr[0] + len, " SF", 4);
+            }
+            break;
+        }
+        case 1:
+            memmove(ctx->labelStr, "Miner Fees", 11);
+            formatSC(ctx->fullStr[0], cur2dec(ctx->fullStr[0], sum->fee));
+            break;
+        default: {
+            // Each destination is shown with the total sent to it, and by
+            // its label if it is trusted.
+            uint8_t total[1 + 16];
+            const uint16_t first = txn_summary_dest(&ctx->txn, sum, index - SUMMARY_HEADER_ITEMS, total);
+            txn_elem_t *elem = &ctx->txn.elements[first];
+            memmove(ctx->labelStr, "Destination #", 13);
+            bin2dec(ctx->labelStr + 13, index - SUMMARY_HEADER_ITEMS + 1);
+            uint8_t len = cur2dec(ctx->fullStr[0], total);
+            const char *label = NULL;
+            if (elem->elemType == TXN_ELEM_SC_OUTPUT) {
+                len = formatSC(ctx->fullStr[0], len);
+                label = trusted_label(elem->outAddr);
+            } else {
+                memmove(ctx->fullStr[0] + len, " SF", 4);
+                len += 3;
+            }
+            memmove(ctx->fullStr[0] + len, " to ", 4);
+            if (label != NULL) {
+                memmove(ctx->fullStr[0] + len + 4, label, TRUSTED_LABEL_LEN);
+            } else {
+                format_address(ctx->fullStr[0] + len + 4, elem->outAddr);
+            }
+            break;
+        }
+    }
+}
+
+static unsigned int ui_summary_button(void) {
+    ctx->summaryIndex++;
+    if (ctx->summaryIndex == SUMMARY_HEADER_ITEMS + ctx->totals.destCount) {
+        finish_review(ux_sign_summary_flow);
+    } else {
+        fmtSummaryItem(ctx->summaryIndex);
+        ux_flow_init(0, ux_show_summary_flow, NULL);
+    }
+    return 0;
+}
+
+// show_elements displays each element of a summarized transaction, as if
+// summary mode had not been requested.
+static unsigned int show_elements(void) {
+    ctx->elementIndex = 0;
+    ctx->elemPart = 0;
+    fmtTxnElem();
+    ux_flow_init(0, ux_show_txn_elem_flow, NULL);
+    return 0;
+}
+
 // Gets the current index number to be displayed in the UI
 static uint16_t display_index(void) {
     txn_state_t *txn = &ctx->txn;
@@ -140,8 +381,19 @@ static void fmtTxnElem(void) {
             // An element can have multiple screens. For each siacoin output, the
             // user needs to see both the destination address and the amount.
             // These are rendered in separate screens, and elemPart is used to
-            // identify which screen is being viewed.
-            if (ctx->elemPart == 0) {
+            // identify which screen is being viewed. An output sent to a
+            // trusted address is shown on a single screen, by its label.
+            const char *label = trusted_label(txn->elements[ctx->elementIndex].outAddr);
+            if (label != NULL) {
+                const uint8_t valLen =
+                    cur2dec(ctx->fullStr[0], txn->elements[ctx->elementIndex].outVal);
+                const uint8_t scLen = formatSC(ctx->fullStr[0], valLen);
+                memmove(ctx->fullStr[0] + scLen, " to ", 4);
+                memmove(ctx->fullStr[0] + scLen + 4, label, TRUSTED_LABEL_LEN);
+                ctx->elemPart = 0;
+
+                ctx->elementIndex++;
+            } else if (ctx->elemPart == 0) {
                 format_address(ctx->fullStr[0], txn->elements[ctx->elementIndex].outAddr);
                 ctx->elemPart++;
             } else {
@@ -183,6 +435,45 @@ static void fmtTxnElem(void) {
             ctx->elementIndex++;
             break;
         }
+        case TXN_ELEM_FC: {
+            // File contracts only show the payout that funds them.
+            memmove(ctx->labelStr, "File Contract #", 15);
+            bin2dec(ctx->labelStr + 15, display_index());
+
+            memmove(ctx->fullStr[0], "Payout: ", 8);
+            const uint8_t valLen =
+                cur2dec(ctx->fullStr[0] + 8, txn->elements[ctx->elementIndex].outVal);
+            formatSC(ctx->fullStr[0] + 8, valLen);
+
+            ctx->elemPart = 0;
+            ctx->elementIndex++;
+            break;
+        }
+        case TXN_ELEM_FCR: {
+            // Revisions are shown compactly: the new revision number, then
+            // the payouts to the renter and host if the contract succeeds.
+            txn_elem_t *elem = &txn->elements[ctx->elementIndex];
+            memmove(ctx->labelStr, "Revision #", 10);
+            bin2dec(ctx->labelStr + 10, display_index());
+            if (ctx->elemPart == 0) {
+                memmove(ctx->fullStr[0], "Number: ", 8);
+                bin2dec(ctx->fullStr[0] + 8, U8LE(elem->fcr.revisionNumber, 0));
+                ctx->elemPart++;
+            } else if (ctx->elemPart == 1) {
+                memmove(ctx->fullStr[0], "Renter: ", 8);
+                const uint8_t valLen = cur2dec(ctx->fullStr[0] + 8, elem->fcr.renterPayout);
+                formatSC(ctx->fullStr[0] + 8, valLen);
+                ctx->elemPart++;
+            } else {
+                memmove(ctx->fullStr[0], "Host: ", 6);
+                const uint8_t valLen = cur2dec(ctx->fullStr[0] + 6, elem->fcr.hostPayout);
+                formatSC(ctx->fullStr[0] + 6, valLen);
+                ctx->elemPart = 0;
+
+                ctx->elementIndex++;
+            }
+            break;
+        }
         default: {
             // This should never happen.
             io_send_sw(SW_DEVELOPER_ERR);
@@ -196,12 +487,65 @@ static void zero_ctx(void) {
     explicit_bzero(ctx, sizeof(calcTxnHashContext_t));
 }
 
+// send_ack acknowledges a packet of transaction data. The response carries
+// the session token and the number of transaction bytes processed so far,
+// which the computer needs in order to resume the transfer if the connection
+// is interrupted.
+static uint16_t send_ack(void) {
+    uint8_t ack[8];
+    U4LE_ENCODE(ack, 0, ctx->sessionToken);
+    U4LE_ENCODE(ack, 4, ctx->ackedBytes);
+    io_send_response_pointer(ack, sizeof(ack), SW_OK);
+    return 0;
+}
+
+// resume_session handles a request to continue an interrupted transfer. The
+// decoder state is left untouched: the hash state and any decoded elements
+// are preserved, and the computer continues with P1_MORE from the offset in
+// the acknowledgement.
+static uint16_t resume_session(const uint8_t *dataBuffer, uint16_t dataLength) {
+    if (!ctx->initialized) {
+        return SW_IMPROPER_INIT;
+    }
+    if (dataLength != sizeof(ctx->sessionToken) || U4LE(dataBuffer, 0) != ctx->sessionToken) {
+        return SW_INVALID_PARAM;
+    }
+    if (ctx->finished) {
+        // The whole transaction was received, and the user is reviewing it.
+        // The result of the review will be sent in response to this command.
+        return 0;
+    }
+    return send_ack();
+}
+
 // handleCalcTxnHash reads a signature index and a transaction, calculates the
 // SigHash of the transaction, and optionally signs the hash using a specified
 // key. The transaction is displayed piece-wise to the user.
 uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t dataLength) {
-    if ((p1 != P1_FIRST && p1 != P1_MORE) || (p2 != P2_DISPLAY_HASH && p2 != P2_SIGN_HASH)) {
+    if ((p1 != P1_FIRST && p1 != P1_MORE && p1 != P1_RESUME) ||
+        (p2 & ~(P2_SIGN_HASH | P2_ZERO_RLE | P2_PARTIAL_COVER | P2_TXN_ID | P2_CHANGE_RANGE |
+                P2_SUMMARY | P2_NO_REVIEW | P2_SAVE_TEMPLATE)) != 0) {
+        return SW_INVALID_PARAM;
+    }
+    // Only the hash may be computed without a review.
+    if ((p2 & P2_NO_REVIEW) && (p2 & (P2_SIGN_HASH | P2_SUMMARY))) {
+        return SW_INVALID_PARAM;
+    }
+    // A template is only saved from a full review of a signed transaction.
+    if ((p2 & P2_SAVE_TEMPLATE) &&
+        (!(p2 & P2_SIGN_HASH) || (p2 & (P2_PARTIAL_COVER | P2_SUMMARY | P2_NO_REVIEW)))) {
+        return SW_INVALID_PARAM;
+    }
+    // A partial signature can't be summarized, and since the rest of the
+    // transaction may change after it is signed, it requires blind signing.
+    if ((p2 & P2_PARTIAL_COVER) && (p2 & P2_SUMMARY)) {
         return SW_INVALID_PARAM;
+    } else if ((p2 & P2_PARTIAL_COVER) && !N_storage.blindSign) {
+        return SW_USER_REJECTED;
+    }
+
+    if (p1 == P1_RESUME) {
+        return resume_session(dataBuffer, dataLength);
     }
 
     if (p1 == P1_FIRST) {
@@ -220,6 +564,10 @@ uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t
         // If this is the first packet, it will include the key index, sig
         // index, and change index in addition to the transaction data. Use
         // these to initialize the ctx and the transaction decoder.
+        if (dataLength < 10) {
+            zero_ctx();
+            return SW_INVALID_PARAM;
+        }
         ctx->keyIndex = U4LE(dataBuffer, 0);  // NOTE: ignored if !ctx->sign
         dataBuffer += 4;
         dataLength -= 4;
@@ -231,8 +579,58 @@ uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t
         dataLength -= 4;
         txn_init(&ctx->txn, sigIndex, changeIndex);
 
-        // Set ctx->sign according to P2.
+        // If change may be sent to any of several consecutive key indices,
+        // the number of indices follows the change index.
+        if (p2 & P2_CHANGE_RANGE) {
+            if (dataLength < 1 || !txn_set_change_count(&ctx->txn, dataBuffer[0])) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            dataBuffer++;
+            dataLength--;
+        }
+
+        if ((p2 & P2_TXN_ID) && !txn_compute_id(&ctx->txn)) {
+            zero_ctx();
+            return SW_INVALID_PARAM;
+        }
+        if (p2 & P2_NO_REVIEW) {
+            txn_hash_only(&ctx->txn);
+        }
+
+        // If the TxnSig does not cover the whole transaction, the covered
+        // elements are declared before the transaction data.
+        if (p2 & P2_PARTIAL_COVER) {
+            const uint8_t n = (dataLength > 0) ? dataBuffer[0] : 0;
+            if (dataLength < 1 + 2 * n || !txn_set_covered(&ctx->txn, dataBuffer + 1, n)) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            dataBuffer += 1 + 2 * n;
+            dataLength -= 1 + 2 * n;
+        }
+
+        // If the outputs are to be saved as a payout template, its label
+        // ends the header.
+        if (p2 & P2_SAVE_TEMPLATE) {
+            const uint8_t n = template_read_label(ctx->templateLabel, dataBuffer, dataLength);
+            if (n == 0) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            dataBuffer += n;
+            dataLength -= n;
+            ctx->saveTemplate = true;
+        }
+
+        // Set ctx->sign, ctx->zeroRLE, and ctx->summary according to P2.
         ctx->sign = (p2 & P2_SIGN_HASH);
+        ctx->zeroRLE = (p2 & P2_ZERO_RLE);
+        ctx->summary = (p2 & P2_SUMMARY);
+
+        // The session token must accompany any request to resume this
+        // transfer.
+        ctx->sessionToken = cx_rng_u32();
 
         ctx->elemPart = 0;
     } else {
@@ -244,22 +642,73 @@ uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t
         }
     }
 
-    // Add the new data to transaction decoder.
-    txn_update(&ctx->txn, dataBuffer, dataLength);
+    // Add the new data to transaction decoder, expanding it first if it is
+    // compressed.
+    txnDecoderState_e state;
+    if (ctx->zeroRLE) {
+        state = txn_parse_rle(&ctx->txn, dataBuffer, dataLength);
+    } else {
+        txn_update(&ctx->txn, dataBuffer, dataLength);
+        state = txn_parse(&ctx->txn);
+    }
+    ctx->ackedBytes += dataLength;
 
     // Attempt to decode the next element of the transaction. Note that this
     // code is essentially identical to ui_calcTxnHash_elem_button. Sadly,
     // there doesn't seem to be a clean way to avoid this duplication.
-    switch (txn_parse(&ctx->txn)) {
+    switch (state) {
         case TXN_STATE_ERR:
             // don't leave state lingering
             zero_ctx();
             return SW_INVALID_PARAM;
             break;
         case TXN_STATE_PARTIAL:
-            return SW_OK;
+            return send_ack();
             break;
         case TXN_STATE_FINISHED:
+            ctx->finished = true;
+            // Nothing secret is used to compute the hash, so it may be sent
+            // without a review if the computer asked for that.
+            if (ctx->txn.hashOnly) {
+                send_result(ctx->txn.sigHash, sizeof(ctx->txn.sigHash));
+                zero_ctx();
+                break;
+            }
+            // Saving a template always requires a full review, so the
+            // shortcuts below do not apply.
+            if (ctx->saveTemplate) {
+                uint8_t fee[1 + 16];
+                if (!template_digest(&ctx->txn, ctx->templateDigest, fee) ||
+                    !template_has_room(ctx->templateDigest)) {
+                    zero_ctx();
+                    return SW_INVALID_PARAM;
+                }
+            }
+            // Every path below displays the transaction, or signs it and
+            // returns to the main menu.
+            uiBusy = true;
+            if (ctx->sign && !ctx->saveTemplate &&
+                policy_check(&ctx->txn, ctx->keyIndex, ctx->policyTotal)) {
+                // A transaction allowed by the signing policy does not need
+                // to be reviewed in full.
+                sign_under_policy();
+                break;
+            } else if (ctx->sign && !ctx->saveTemplate && sign_template()) {
+                // Nor does one that pays out exactly as a stored template.
+                break;
+            }
+            // If the transaction can be summarized, the summary is shown
+            // instead of each element.
+            if (ctx->summary && txn_summarize(&ctx->txn, &ctx->totals)) {
+                ctx->summaryIndex = 0;
+                fmtSummaryItem(0);
+                ux_flow_init(0, ux_show_summary_flow, NULL);
+                break;
+            }
+            if (ctx->txn.partial) {
+                ux_flow_init(0, ux_partial_warning_flow, NULL);
+                break;
+            }
             fmtTxnElem();
             ux_flow_init(0, ux_show_txn_elem_flow, NULL);
             break;
@@ -9,8 +9,11 @@
 #include <ux.h>
 
 #include "blake2b.h"
+#include "policy.h"
 #include "sia.h"
 #include "sia_ux.h"
+#include "templates.h"
+#include "trusted.h"
 #include "txn.h"
 
 static calcTxnHashContext_t *ctx = &global.calcTxnHashContext;
@@ -19,6 +22,11 @@ static void fmtTxnElem(void);
 static uint16_t display_index(void);
 static bool nav_callback(uint8_t page, nbgl_pageContent_t *content);
 static void confirm_callback(bool confirm);
+static void show_review(uint8_t initPage);
+
+// the token of the button that leaves the summary for a review of each
+// element
+#define SHOW_ELEMENTS_TOKEN FIRST_USER_TOKEN
 
 // Gets the current index number to be displayed in the UI
 static uint16_t display_index(void) {
@@ -48,8 +56,14 @@ static void fmtTxnElem(void) {
             // An element can have multiple screens. For each siacoin output, the
             // user needs to see both the destination address and the amount.
             // These are rendered in separate screens, and elemPart is used to
-            // identify which screen is being viewed.
-            format_address(ctx->fullStr[0], txn->elements[ctx->elementIndex].outAddr);
+            // identify which screen is being viewed. A trusted address is
+            // shown by its label.
+            const char *label = trusted_label(txn->elements[ctx->elementIndex].outAddr);
+            if (label != NULL) {
+                memmove(ctx->fullStr[0], label, TRUSTED_LABEL_LEN);
+            } else {
+                format_address(ctx->fullStr[0], txn->elements[ctx->elementIndex].outAddr);
+            }
             const uint8_t valLen =
                 cur2dec(ctx->fullStr[1], txn->elements[ctx->elementIndex].outVal);
             formatSC(ctx->fullStr[1], valLen);
@@ -75,6 +89,28 @@ static void fmtTxnElem(void) {
             break;
         }
 
+        case TXN_ELEM_FC: {
+            memmove(ctx->labelStr, "File Contract #", 15);
+            bin2dec(ctx->labelStr + 15, display_index());
+
+            const uint8_t valLen =
+                cur2dec(ctx->fullStr[0], txn->elements[ctx->elementIndex].outVal);
+            formatSC(ctx->fullStr[0], valLen);
+            break;
+        }
+
+        case TXN_ELEM_FCR: {
+            // Revisions are shown compactly: the new revision number, and
+            // the payouts to the renter and host if the contract succeeds.
+            txn_elem_t *elem = &txn->elements[ctx->elementIndex];
+            memmove(ctx->labelStr, "Revision #", 10);
+            bin2dec(ctx->labelStr + 10, display_index());
+            bin2dec(ctx->fullStr[0], U8LE(elem->fcr.revisionNumber, 0));
+            formatSC(ctx->fullStr[1], cur2dec(ctx->fullStr[1], elem->fcr.renterPayout));
+            formatSC(ctx->fullStr[2], cur2dec(ctx->fullStr[2], elem->fcr.hostPayout));
+            break;
+        }
+
         default:
             // This should never happen.
             io_send_sw(SW_DEVELOPER_ERR);
@@ -83,7 +119,31 @@ static void fmtTxnElem(void) {
     }
 }
 
+// send_result sends the signature or SigHash of the transaction, followed by
+// its ID if it was requested.
+static void send_result(const uint8_t *result, uint8_t len) {
+    uint8_t resp[64 + 32];
+    memmove(resp, result, len);
+#ifndef TARGET_NANOS
+    if (ctx->txn.computeID) {
+        memmove(resp + len, ctx->txn.txnID, sizeof(ctx->txn.txnID));
+        len += sizeof(ctx->txn.txnID);
+    }
+#endif
+    io_send_response_pointer(resp, len, SW_OK);
+}
+
 static void confirm_callback(bool confirm) {
+    uiBusy = false;
+    if (!confirm && !ctx->finished) {
+        // The transaction is still being received, so no command is waiting
+        // for the result; it is sent in response to the next packet instead.
+        explicit_bzero(ctx, sizeof(calcTxnHashContext_t));
+        ctx->rejected = true;
+        nbgl_useCaseReviewStatus(STATUS_TYPE_TRANSACTION_REJECTED, ui_idle);
+        return;
+    }
+
     ctx->finished = false;
     ctx->initialized = false;
 
@@ -91,10 +151,13 @@ static void confirm_callback(bool confirm) {
         if (ctx->sign) {
             uint8_t signature[64] = {0};
             deriveAndSign(signature, ctx->keyIndex, ctx->txn.sigHash);
-            io_send_response_pointer(signature, sizeof(signature), SW_OK);
+            if (ctx->saveTemplate) {
+                template_store(ctx->templateDigest, ctx->templateLabel);
+            }
+            send_result(signature, sizeof(signature));
             nbgl_useCaseReviewStatus(STATUS_TYPE_TRANSACTION_SIGNED, ui_idle);
         } else {
-            io_send_response_pointer(ctx->txn.sigHash, sizeof(ctx->txn.sigHash), SW_OK);
+            send_result(ctx->txn.sigHash, sizeof(ctx->txn.sigHash));
             nbgl_useCaseStatus("TRANSACTION HASHED", true, ui_idle);
         }
     } else {
@@ -103,44 +166,170 @@ static void confirm_callback(bool confirm) {
     }
 }
 
-static nbgl_layoutTagValue_t pairs[2];
+static nbgl_layoutTagValue_t pairs[3];
+
+// set_final_page displays the page on which the user approves the
+// transaction.
+static void set_final_page(nbgl_pageContent_t *content) {
+    content->type = INFO_LONG_PRESS;
+    content->infoLongPress.icon = &C_stax_app_sia_big;
+    if (ctx->saveTemplate) {
+        // The final page is the only one that uses labelStr.
+        memmove(ctx->labelStr, "Sign and save as ", 17);
+        memmove(ctx->labelStr + 17, ctx->templateLabel, TEMPLATE_LABEL_LEN);
+        content->infoLongPress.text = ctx->labelStr;
+        content->infoLongPress.longPressText = "Hold to sign";
+    } else if (ctx->sign && ctx->txn.partial) {
+        content->infoLongPress.text = "Sign covered elements";
+        content->infoLongPress.longPressText = "Hold to sign";
+    } else if (ctx->sign) {
+        content->infoLongPress.text = "Sign transaction";
+        content->infoLongPress.longPressText = "Hold to sign";
+    } else {
+        content->infoLongPress.text = "Hash transaction";
+        content->infoLongPress.longPressText = "Hold to hash";
+    }
+}
 
-static bool nav_callback(uint8_t page, nbgl_pageContent_t *content) {
-    ctx->elementIndex = page;
-    if (ctx->elementIndex >= ctx->txn.elementIndex) {
-        content->type = INFO_LONG_PRESS;
-        content->infoLongPress.icon = &C_stax_app_sia_big;
-        if (ctx->sign) {
-            content->infoLongPress.text = "Sign transaction";
-            content->infoLongPress.longPressText = "Hold to sign";
-        } else {
-            content->infoLongPress.text = "Hash transaction";
-            content->infoLongPress.longPressText = "Hold to hash";
-        }
+// summary_nav displays the summary: a page of totals, then a page for each
+// destination, then a page offering a review of each element, and finally
+// the approval page.
+static bool summary_nav(uint8_t page, nbgl_pageContent_t *content) {
+    txn_summary_t *sum = &ctx->totals;
+    if (page == sum->destCount + 2) {
+        set_final_page(content);
+        return true;
+    } else if (page == sum->destCount + 1) {
+        content->type = INFO_BUTTON;
+        content->infoButton.text = "Review each output of the transaction";
+        content->infoButton.icon = &C_stax_app_sia_big;
+        content->infoButton.buttonText = "Show outputs";
+        content->infoButton.buttonToken = SHOW_ELEMENTS_TOKEN;
         return true;
     }
 
-    fmtTxnElem();
-
-    if (ctx->txn.elements[ctx->elementIndex].elemType == TXN_ELEM_MINER_FEE) {
-        pairs[0].item = "Miner Fee Amount (SC)";
-        pairs[0].value = ctx->fullStr[0];
-
-        content->tagValueList.nbPairs = 1;
-        content->tagValueList.pairs = &pairs[0];
+    if (page == 0) {
+        uint8_t n = 0;
+        formatSC(ctx->fullStr[0], cur2dec(ctx->fullStr[0], sum->sc));
+        pairs[n].item = "Total Sent (SC)";
+        pairs[n++].value = ctx->fullStr[0];
+        if (sum->hasSF) {
+            cur2dec(ctx->fullStr[1], sum->sf);
+            pairs[n].item = "Total Sent (SF)";
+            pairs[n++].value = ctx->fullStr[1];
+        }
+        formatSC(ctx->fullStr[2], cur2dec(ctx->fullStr[2], sum->fee));
+        pairs[n].item = "Miner Fees (SC)";
+        pairs[n++].value = ctx->fullStr[2];
+        content->tagValueList.nbPairs = n;
+        memmove(ctx->labelStr, "Totals", 7);
     } else {
-        pairs[0].item = "To";
-        pairs[0].value = ctx->fullStr[0];
-        if (ctx->txn.elements[ctx->elementIndex].elemType == TXN_ELEM_SC_OUTPUT) {
+        // Each destination is shown with the total sent to it, and by its
+        // label if it is trusted.
+        uint8_t total[1 + 16];
+        txn_elem_t *elem = &ctx->txn.elements[txn_summary_dest(&ctx->txn, sum, page - 1, total)];
+        memmove(ctx->labelStr, "Destination #", 13);
+        bin2dec(ctx->labelStr + 13, page);
+        const uint8_t valLen = cur2dec(ctx->fullStr[1], total);
+        const char *label = NULL;
+        if (elem->elemType == TXN_ELEM_SC_OUTPUT) {
+            formatSC(ctx->fullStr[1], valLen);
+            label = trusted_label(elem->outAddr);
             pairs[1].item = "Amount (SC)";
         } else {
             pairs[1].item = "Amount (SF)";
         }
+        if (label != NULL) {
+            memmove(ctx->fullStr[0], label, TRUSTED_LABEL_LEN);
+        } else {
+            format_address(ctx->fullStr[0], elem->outAddr);
+        }
+        pairs[0].item = "To";
+        pairs[0].value = ctx->fullStr[0];
         pairs[1].value = ctx->fullStr[1];
-
         content->tagValueList.nbPairs = 2;
-        content->tagValueList.pairs = &pairs[0];
     }
+    content->tagValueList.pairs = &pairs[0];
+
+    content->title = ctx->labelStr;
+    content->type = TAG_VALUE_LIST;
+    content->tagValueList.callback = NULL;
+
+    content->tagValueList.startIndex = 0;
+    content->tagValueList.wrapping = false;
+    content->tagValueList.smallCaseForValue = false;
+    content->tagValueList.nbMaxLinesForValue = 0;
+    return true;
+}
+
+static void summary_button_callback(int token, uint8_t index) {
+    UNUSED(index);
+    if (token == SHOW_ELEMENTS_TOKEN) {
+        ctx->summaryShown = false;
+        show_review(0);
+    }
+}
+
+static bool nav_callback(uint8_t page, nbgl_pageContent_t *content) {
+    if (ctx->summaryShown) {
+        return summary_nav(page, content);
+    }
+    ctx->elementIndex = page;
+    ctx->reviewWaiting = false;
+    if (page == ctx->reviewPages - 1 && !ctx->finished) {
+        // The user has caught up with the transfer. The review is redrawn
+        // from this page once more elements have been decoded.
+        ctx->reviewWaiting = true;
+        content->type = CENTERED_INFO;
+        content->centeredInfo.icon = &C_stax_app_sia_big;
+        content->centeredInfo.text1 = "Receiving transaction";
+        content->centeredInfo.text2 = "The remaining elements will be shown shortly";
+        content->centeredInfo.style = LARGE_CASE_INFO;
+        return true;
+    }
+    if (page == ctx->reviewPages - 1) {
+        set_final_page(content);
+        return true;
+    }
+
+    fmtTxnElem();
+
+    switch (ctx->txn.elements[ctx->elementIndex].elemType) {
+        case TXN_ELEM_MINER_FEE:
+            pairs[0].item = "Miner Fee Amount (SC)";
+            pairs[0].value = ctx->fullStr[0];
+            content->tagValueList.nbPairs = 1;
+            break;
+
+        case TXN_ELEM_FC:
+            pairs[0].item = "Payout (SC)";
+            pairs[0].value = ctx->fullStr[0];
+            content->tagValueList.nbPairs = 1;
+            break;
+
+        case TXN_ELEM_FCR:
+            pairs[0].item = "Revision Number";
+            pairs[0].value = ctx->fullStr[0];
+            pairs[1].item = "Renter Payout (SC)";
+            pairs[1].value = ctx->fullStr[1];
+            pairs[2].item = "Host Payout (SC)";
+            pairs[2].value = ctx->fullStr[2];
+            content->tagValueList.nbPairs = 3;
+            break;
+
+        default:
+            pairs[0].item = "To";
+            pairs[0].value = ctx->fullStr[0];
+            if (ctx->txn.elements[ctx->elementIndex].elemType == TXN_ELEM_SC_OUTPUT) {
+                pairs[1].item = "Amount (SC)";
+            } else {
+                pairs[1].item = "Amount (SF)";
+            }
+            pairs[1].value = ctx->fullStr[1];
+            content->tagValueList.nbPairs = 2;
+            break;
+    }
+    content->tagValueList.pairs = &pairs[0];
 
     content->title = ctx->labelStr;
     content->type = TAG_VALUE_LIST;
@@ -154,30 +343,214 @@ static bool nav_callback(uint8_t page, nbgl_pageContent_t *content) {
     return true;
 }
 
-static void begin_review(void) {
-    nbgl_useCaseRegularReview(0,
-                              ctx->txn.elementIndex + 1,
+// show_review displays the review from initPage, with a page for each element
+// decoded so far followed by a final page. Until the whole transaction has
+// been received, the final page asks the user to wait instead of to sign.
+static void show_review(uint8_t initPage) {
+    ctx->reviewPages = ctx->txn.elementIndex + 1;
+    ctx->reviewWaiting = false;
+    nbgl_useCaseRegularReview(initPage,
+                              ctx->reviewPages,
                               "Cancel",
                               NULL,
                               nav_callback,
                               confirm_callback);
 }
 
+// show_summary displays the summary of a transaction, from which the user
+// may switch to a review of each element.
+static void show_summary(void) {
+    nbgl_useCaseRegularReview(0,
+                              ctx->totals.destCount + 3,
+                              "Cancel",
+                              summary_button_callback,
+                              nav_callback,
+                              confirm_callback);
+}
+
+static void begin_review(void) {
+    if (ctx->summaryShown) {
+        show_summary();
+    } else {
+        show_review(0);
+    }
+}
+
 static void cancel_review(void) {
     confirm_callback(false);
 }
 
+// start_review displays the first page of the review. A partial signature
+// is announced there, since the elements it does not cover are not shown, and
+// may be changed after it is signed.
+static void start_review(void) {
+    ctx->reviewShown = true;
+    uiBusy = true;
+    nbgl_useCaseReviewStart(&C_stax_app_sia_big,
+                            (ctx->sign) ? "Sign Transaction" : "Hash Transaction",
+                            (ctx->txn.partial)
+                                ? "Partial signature: only the elements shown are signed"
+                                : NULL,
+                            "Cancel",
+                            begin_review,
+                            cancel_review);
+}
+
+// update_review brings the review up to date with the elements decoded so
+// far. Redrawing the screen is slow, so the review is only redrawn when the
+// user is waiting for more elements, or when the transfer has finished and
+// the number of pages has changed.
+static void update_review(void) {
+    if (ctx->reviewPages == 0) {
+        // The user has not left the first screen yet; begin_review will use
+        // the elements decoded by then.
+        return;
+    }
+    const uint8_t nbPages = ctx->txn.elementIndex + 1;
+    if ((ctx->reviewWaiting && (nbPages > ctx->reviewPages || ctx->finished)) ||
+        (ctx->finished && nbPages != ctx->reviewPages)) {
+        show_review(ctx->elementIndex);
+    }
+}
+
 static void zero_ctx(void) {
     explicit_bzero(ctx, sizeof(calcTxnHashContext_t));
 }
 
+static void sign_policy_txn(void) {
+    uint8_t signature[64] = {0};
+    deriveAndSign(signature, ctx->keyIndex, ctx->txn.sigHash);
+    policy_record(ctx->policyTotal);
+    send_result(signature, sizeof(signature));
+    zero_ctx();
+}
+
+static void policy_callback(bool confirm) {
+    uiBusy = false;
+    if (confirm) {
+        sign_policy_txn();
+        nbgl_useCaseReviewStatus(STATUS_TYPE_TRANSACTION_SIGNED, ui_idle);
+    } else {
+        zero_ctx();
+        io_send_sw(SW_USER_REJECTED);
+        nbgl_useCaseReviewStatus(STATUS_TYPE_TRANSACTION_REJECTED, ui_idle);
+    }
+}
+
+// sign_under_policy signs a transaction that the stored policy allows,
+// either immediately or after a single confirmation, instead of displaying
+// each of its elements.
+static void sign_under_policy(void) {
+    if (!policy_confirm()) {
+        sign_policy_txn();
+        return;
+    }
+    const uint8_t valLen = cur2dec(ctx->fullStr[0], ctx->policyTotal);
+    const uint8_t scLen = formatSC(ctx->fullStr[0], valLen);
+    memmove(ctx->fullStr[0] + scLen, " with key #", 11);
+    bin2dec(ctx->fullStr[0] + scLen + 11, ctx->keyIndex);
+    uiBusy = true;
+    nbgl_useCaseChoice(&C_stax_app_sia_big,
+                       "Sign within policy?",
+                       ctx->fullStr[0],
+                       "Sign",
+                       "Reject",
+                       policy_callback);
+}
+
+// sign_template asks for a single confirmation of a transaction whose outputs
+// match a stored payout template, instead of displaying each of its elements.
+// It returns false if no template matches.
+static bool sign_template(void) {
+    uint8_t fee[1 + 16];
+    const char *label = template_match(&ctx->txn, fee);
+    if (label == NULL) {
+        return false;
+    }
+    uint8_t len = strlen(label);
+    memmove(ctx->fullStr[0], label, len);
+    memmove(ctx->fullStr[0] + len, ", fee ", 6);
+    len += 6;
+    len += formatSC(ctx->fullStr[0] + len, cur2dec(ctx->fullStr[0] + len, fee));
+    memmove(ctx->fullStr[0] + len, " with key #", 11);
+    bin2dec(ctx->fullStr[0] + len + 11, ctx->keyIndex);
+    uiBusy = true;
+    nbgl_useCaseChoice(&C_stax_app_sia_big,
+                       "Recurring payout?",
+                       ctx->fullStr[0],
+                       "Sign",
+                       "Reject",
+                       confirm_callback);
+    return true;
+}
+
+// send_ack acknowledges a packet of transaction data. The response carries
+// the session token and the number of transaction bytes processed so far,
+// which the computer needs in order to resume the transfer if the connection
+// is interrupted.
+static uint16_t send_ack(void) {
+    uint8_t ack[8];
+    U4LE_ENCODE(ack, 0, ctx->sessionToken);
+    U4LE_ENCODE(ack, 4, ctx->ackedBytes);
+    io_send_response_pointer(ack, sizeof(ack), SW_OK);
+    return 0;
+}
+
+// resume_session handles a request to continue an interrupted transfer. The
+// decoder state is left untouched: the hash state and any decoded elements
+// are preserved, and the computer continues with P1_MORE from the offset in
+// the acknowledgement.
+static uint16_t resume_session(const uint8_t *dataBuffer, uint16_t dataLength) {
+    if (!ctx->initialized) {
+        return SW_IMPROPER_INIT;
+    }
+    if (dataLength != sizeof(ctx->sessionToken) || U4LE(dataBuffer, 0) != ctx->sessionToken) {
+        return SW_INVALID_PARAM;
+    }
+    if (ctx->finished) {
+        // The whole transaction was received, and the user is reviewing it.
+        // The result of the review will be sent in response to this command.
+        return 0;
+    }
+    return send_ack();
+}
+
 // handleCalcTxnHash reads a signature index and a transaction, calculates the
 // SigHash of the transaction, and optionally signs the hash using a specified
 // key. The transaction is displayed piece-wise to the user.
 uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t dataLength) {
-    if ((p1 != P1_FIRST && p1 != P1_MORE) || (p2 != P2_DISPLAY_HASH && p2 != P2_SIGN_HASH)) {
+    if ((p1 != P1_FIRST && p1 != P1_MORE && p1 != P1_RESUME) ||
+        (p2 & ~(P2_SIGN_HASH | P2_ZERO_RLE | P2_PARTIAL_COVER | P2_TXN_ID | P2_CHANGE_RANGE |
+                P2_SUMMARY | P2_NO_REVIEW | P2_SAVE_TEMPLATE)) != 0) {
         return SW_INVALID_PARAM;
     }
+    // Only the hash may be computed without a review.
+    if ((p2 & P2_NO_REVIEW) && (p2 & (P2_SIGN_HASH | P2_SUMMARY))) {
+        return SW_INVALID_PARAM;
+    }
+    // A template is only saved from a full review of a signed transaction.
+    if ((p2 & P2_SAVE_TEMPLATE) &&
+        (!(p2 & P2_SIGN_HASH) || (p2 & (P2_PARTIAL_COVER | P2_SUMMARY | P2_NO_REVIEW)))) {
+        return SW_INVALID_PARAM;
+    }
+    // A partial signature can't be summarized, and since the rest of the
+    // transaction may change after it is signed, it requires blind signing.
+    if ((p2 & P2_PARTIAL_COVER) && (p2 & P2_SUMMARY)) {
+        return SW_INVALID_PARAM;
+    } else if ((p2 & P2_PARTIAL_COVER) && !N_storage.blindSign) {
+        return SW_USER_REJECTED;
+    }
+
+    // If the user rejected the transaction before it was fully received,
+    // the rejection is reported in response to the next packet.
+    if (p1 != P1_FIRST && ctx->rejected) {
+        zero_ctx();
+        return SW_USER_REJECTED;
+    }
+
+    if (p1 == P1_RESUME) {
+        return resume_session(dataBuffer, dataLength);
+    }
 
     if (p1 == P1_FIRST) {
         // If this is the first packet of a transaction, the transaction
@@ -195,6 +568,10 @@ uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t
         // If this is the first packet, it will include the key index, sig
         // index, and change index in addition to the transaction data. Use
         // these to initialize the ctx and the transaction decoder.
+        if (dataLength < 10) {
+            zero_ctx();
+            return SW_INVALID_PARAM;
+        }
         ctx->keyIndex = U4LE(dataBuffer, 0);  // NOTE: ignored if !ctx->sign
         dataBuffer += 4;
         dataLength -= 4;
@@ -206,8 +583,58 @@ uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t
         dataLength -= 4;
         txn_init(&ctx->txn, sigIndex, changeIndex);
 
-        // Set ctx->sign according to P2.
+        // If change may be sent to any of several consecutive key indices,
+        // the number of indices follows the change index.
+        if (p2 & P2_CHANGE_RANGE) {
+            if (dataLength < 1 || !txn_set_change_count(&ctx->txn, dataBuffer[0])) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            dataBuffer++;
+            dataLength--;
+        }
+
+        if ((p2 & P2_TXN_ID) && !txn_compute_id(&ctx->txn)) {
+            zero_ctx();
+            return SW_INVALID_PARAM;
+        }
+        if (p2 & P2_NO_REVIEW) {
+            txn_hash_only(&ctx->txn);
+        }
+
+        // If the TxnSig does not cover the whole transaction, the covered
+        // elements are declared before the transaction data.
+        if (p2 & P2_PARTIAL_COVER) {
+            const uint8_t n = (dataLength > 0) ? dataBuffer[0] : 0;
+            if (dataLength < 1 + 2 * n || !txn_set_covered(&ctx->txn, dataBuffer + 1, n)) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            dataBuffer += 1 + 2 * n;
+            dataLength -= 1 + 2 * n;
+        }
+
+        // If the outputs are to be saved as a payout template, its label
+        // ends the header.
+        if (p2 & P2_SAVE_TEMPLATE) {
+            const uint8_t n = template_read_label(ctx->templateLabel, dataBuffer, dataLength);
+            if (n == 0) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            dataBuffer += n;
+            dataLength -= n;
+            ctx->saveTemplate = true;
+        }
+
+        // Set ctx->sign, ctx->zeroRLE, and ctx->summary according to P2.
         ctx->sign = (p2 & P2_SIGN_HASH);
+        ctx->zeroRLE = (p2 & P2_ZERO_RLE);
+        ctx->summary = (p2 & P2_SUMMARY);
+
+        // The session token must accompany any request to resume this
+        // transfer.
+        ctx->sessionToken = cx_rng_u32();
 
         ctx->elemPart = 0;
     } else {
@@ -219,25 +646,81 @@ uint16_t handleCalcTxnHash(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t
         }
     }
 
-    // Add the new data to transaction decoder.
-    txn_update(&ctx->txn, dataBuffer, dataLength);
+    // Add the new data to transaction decoder, expanding it first if it is
+    // compressed.
+    txnDecoderState_e state;
+    if (ctx->zeroRLE) {
+        state = txn_parse_rle(&ctx->txn, dataBuffer, dataLength);
+    } else {
+        txn_update(&ctx->txn, dataBuffer, dataLength);
+        state = txn_parse(&ctx->txn);
+    }
+    ctx->ackedBytes += dataLength;
 
-    switch (txn_parse(&ctx->txn)) {
+    switch (state) {
         case TXN_STATE_ERR:
             // don't leave state lingering
             zero_ctx();
             return SW_INVALID_PARAM;
             break;
         case TXN_STATE_PARTIAL:
-            return SW_OK;
+            // Start the review as soon as there is something to show, so
+            // that the user can review the transaction while the rest of it
+            // is received, unless the signing policy or a payout template
+            // might allow it without a review. A summary can only be shown
+            // once every element is known.
+            if (!ctx->reviewShown) {
+                if (ctx->txn.elementIndex > 0 && !ctx->summary &&
+                    !(ctx->sign && !ctx->saveTemplate &&
+                      (policy_may_apply(&ctx->txn, ctx->keyIndex) ||
+                       template_may_apply(&ctx->txn)))) {
+                    start_review();
+                }
+            } else {
+                update_review();
+            }
+            return send_ack();
             break;
         case TXN_STATE_FINISHED:
-            nbgl_useCaseReviewStart(&C_stax_app_sia_big,
-                                    (ctx->sign) ? "Sign Transaction" : "Hash Transaction",
-                                    NULL,
-                                    "Cancel",
-                                    begin_review,
-                                    cancel_review);
+            ctx->finished = true;
+            // Nothing secret is used to compute the hash, so it may be sent
+            // without a review if the computer asked for that.
+            if (ctx->txn.hashOnly) {
+                send_result(ctx->txn.sigHash, sizeof(ctx->txn.sigHash));
+                zero_ctx();
+                break;
+            }
+            // Saving a template always requires a full review, so the
+            // shortcuts below do not apply.
+            if (ctx->saveTemplate) {
+                uint8_t fee[1 + 16];
+                if (!template_digest(&ctx->txn, ctx->templateDigest, fee) ||
+                    !template_has_room(ctx->templateDigest)) {
+                    if (ctx->reviewShown) {
+                        ui_idle();
+                    }
+                    zero_ctx();
+                    return SW_INVALID_PARAM;
+                }
+            }
+            if (ctx->reviewShown) {
+                update_review();
+                break;
+            }
+            if (ctx->sign && !ctx->saveTemplate &&
+                policy_check(&ctx->txn, ctx->keyIndex, ctx->policyTotal)) {
+                // A transaction allowed by the signing policy does not need
+                // to be reviewed in full.
+                sign_under_policy();
+                break;
+            } else if (ctx->sign && !ctx->saveTemplate && sign_template()) {
+                // Nor does one that pays out exactly as a stored template.
+                break;
+            }
+            // If the transaction can be summarized, the summary is shown
+            // instead of each element.
+            ctx->summaryShown = ctx->summary && txn_summarize(&ctx->txn, &ctx->totals);
+            start_review();
             break;
     }
 
@@ -32,6 +32,7 @@
 
 // These are APDU parameters that control the behavior of the getPublicKey
 // command.
+#define P1_NO_DISPLAY      0x01  // return public keys without displaying them
 #define P2_DISPLAY_ADDRESS 0x00
 #define P2_DISPLAY_PUBKEY  0x01
 
@@ -71,6 +72,7 @@ UX_FLOW(ux_approve_pk_flow,
 #else
 
 static void review_choice(bool confirm) {
+    uiBusy = false;
     if (confirm) {
         process_pubkey(true);
         if (ctx->genAddr) {
@@ -128,12 +130,33 @@ static unsigned int process_pubkey(bool send) {
     return 0;
 }
 
-uint16_t handleGetPublicKey(uint8_t p1, uint8_t p2, uint8_t* buffer, uint16_t len) {
-    UNUSED(p1);
-    UNUSED(len);
+// sendPublicKeys sends the public keys of count consecutive key indices,
+// starting at index, without displaying them. This lets a wallet scan its
+// addresses without approving each one; since every key is derived from the
+// cached coin node, a handful can be returned per message.
+static uint16_t sendPublicKeys(uint32_t index, uint8_t count) {
+    if (count == 0 || count > MAX_PUBKEY_BATCH || index > UINT32_MAX - (count - 1)) {
+        return SW_INVALID_PARAM;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t publicKey[65] = {0};
+        deriveSiaPublicKey(index + i, publicKey);
+        extractPubkeyBytes(ctx->keys[i], publicKey);
+    }
+    io_send_response_pointer(ctx->keys[0], 32 * count, SW_OK);
+    return 0;
+}
 
+uint16_t handleGetPublicKey(uint8_t p1, uint8_t p2, uint8_t* buffer, uint16_t len) {
     if ((p2 != P2_DISPLAY_ADDRESS) && (p2 != P2_DISPLAY_PUBKEY)) {
         return SW_INVALID_PARAM;
+    } else if (p1 == P1_NO_DISPLAY) {
+        // only public keys may be returned, optionally several at a time
+        if (p2 != P2_DISPLAY_PUBKEY || (len != 4 && len != 5)) {
+            return SW_INVALID_PARAM;
+        }
+        explicit_bzero(ctx, sizeof(getPublicKeyContext_t));
+        return sendPublicKeys(U4LE(buffer, 0), (len == 5) ? buffer[4] : 1);
     }
 
     // Read Key Index
@@ -153,6 +176,7 @@ uint16_t handleGetPublicKey(uint8_t p1, uint8_t p2, uint8_t* buffer, uint16_t le
         memmove(ctx->keyStr + 5 + n, "?", 2);
     }
 
+    uiBusy = true;
 #ifdef HAVE_BAGL
     ux_flow_init(0, ux_approve_pk_flow, NULL);
 #else
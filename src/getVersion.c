@@ -7,16 +7,98 @@
 #include "blake2b.h"
 #include "sia.h"
 #include "sia_ux.h"
+#include "txn.h"
 #include <buffer.h>
 
-// handleGetVersion is the entry point for the getVersion command. It
-// unconditionally sends the app version.
-void handleGetVersion(uint8_t p1 __attribute__((unused)),
-                      uint8_t p2 __attribute__((unused)),
-                      uint8_t *dataBuffer __attribute__((unused)),
-                      uint16_t dataLength __attribute__((unused))) {
+// If P1 is P1_CAPABILITIES, the version is followed by the protocol features
+// and limits of this build, so that the computer can use the fastest protocol
+// the app supports. Older versions of the app ignore P1, so a computer that
+// receives only the version should assume none of these features.
+#define P1_CAPABILITIES 0x01
+
+#define CAP_ZERO_RLE      0x0001  // GET_TXN_HASH accepts zero-run encoded data
+#define CAP_RESUME        0x0002  // GET_TXN_HASH transfers can be resumed
+#define CAP_PARTIAL_COVER 0x0004  // GET_TXN_HASH accepts partial signatures
+#define CAP_TXN_ID        0x0008  // GET_TXN_HASH can return the transaction ID
+#define CAP_BATCH         0x0010  // SIGN_TXN_BATCH is supported
+#define CAP_SIGN_MESSAGE  0x0020  // SIGN_MESSAGE is supported
+#define CAP_POLICY        0x0040  // SET_POLICY is supported
+#define CAP_STACK_PROFILE 0x0080  // GET_STACK_USAGE is supported
+#define CAP_CHANGE_RANGE  0x0100  // GET_TXN_HASH accepts a range of change indices
+#define CAP_TRUSTED_ADDRS 0x0200  // ADD_TRUSTED is supported
+#define CAP_SUMMARY       0x0400  // GET_TXN_HASH can summarize outputs by destination
+#define CAP_NO_REVIEW     0x0800  // GET_TXN_HASH can return the hash without a review
+#define CAP_KEY_BATCH     0x1000  // GET_PUBLIC_KEY can return keys without display
+#define CAP_TEMPLATES     0x2000  // GET_TXN_HASH can save and match payout templates
+
+#define BASE_CAPABILITIES                                                     \
+    (CAP_ZERO_RLE | CAP_RESUME | CAP_PARTIAL_COVER | CAP_TXN_ID | CAP_BATCH | \
+     CAP_SIGN_MESSAGE | CAP_POLICY | CAP_CHANGE_RANGE | CAP_TRUSTED_ADDRS |   \
+     CAP_SUMMARY | CAP_NO_REVIEW | CAP_KEY_BATCH | CAP_TEMPLATES)
+
+#ifdef HAVE_STACK_PROFILE
+#define CAPABILITIES (BASE_CAPABILITIES | CAP_STACK_PROFILE)
+#else
+#define CAPABILITIES BASE_CAPABILITIES
+#endif
+
+// the Nano S lacks the RAM to compute the transaction ID
+#ifdef TARGET_NANOS
+#define DEVICE_CAPABILITIES (CAPABILITIES & ~CAP_TXN_ID)
+#else
+#define DEVICE_CAPABILITIES CAPABILITIES
+#endif
+
+// the maximum number of data bytes in a single APDU
+#define MAX_CHUNK_LEN 255
+
+// the element types that GET_TXN_HASH accepts, as bits indexed by
+// txnElemType_e; arbitrary data must be empty
+#define SUPPORTED_ELEMS                                                           \
+    ((1 << TXN_ELEM_SC_INPUT) | (1 << TXN_ELEM_SC_OUTPUT) | (1 << TXN_ELEM_FC) | \
+     (1 << TXN_ELEM_FCR) | (1 << TXN_ELEM_SP) | (1 << TXN_ELEM_SF_INPUT) |        \
+     (1 << TXN_ELEM_SF_OUTPUT) | (1 << TXN_ELEM_MINER_FEE) | (1 << TXN_ELEM_TXN_SIG))
+
+// handleGetVersion is the entry point for the getVersion command. It sends
+// the app version and, if requested, the capabilities of the app.
+uint16_t handleGetVersion(uint8_t p1,
+                          uint8_t p2 __attribute__((unused)),
+                          uint8_t *dataBuffer __attribute__((unused)),
+                          uint16_t dataLength __attribute__((unused))) {
     static const uint8_t appVersion[3] = {APPVERSION[0] - '0',
                                           APPVERSION[2] - '0',
                                           APPVERSION[4] - '0'};
-    io_send_response_pointer(appVersion, sizeof(appVersion), SW_OK);
+    if (p1 != P1_CAPABILITIES) {
+        io_send_response_pointer(appVersion, sizeof(appVersion), SW_OK);
+        return 0;
+    }
+
+    static const uint8_t capabilities[] = {
+        APPVERSION[0] - '0',
+        APPVERSION[2] - '0',
+        APPVERSION[4] - '0',
+        // little-endian uint32 feature flags
+        DEVICE_CAPABILITIES & 0xFF,
+        (DEVICE_CAPABILITIES >> 8) & 0xFF,
+        0,
+        0,
+        // little-endian uint16 limits
+        MAX_CHUNK_LEN & 0xFF,
+        MAX_CHUNK_LEN >> 8,
+        MAX_ELEMS & 0xFF,
+        MAX_ELEMS >> 8,
+        SUPPORTED_ELEMS & 0xFF,
+        SUPPORTED_ELEMS >> 8,
+        // uint8 limits
+        MAX_COVERED_ELEMS,
+        MAX_BATCH_TXNS,
+        MAX_BATCH_DESTS,
+        MAX_POLICY_DESTS,
+        MAX_CHANGE_ADDRS,
+        MAX_TRUSTED_PENDING,
+        MAX_PUBKEY_BATCH,
+        MAX_TEMPLATES,
+    };
+    io_send_response_pointer(capabilities, sizeof(capabilities), SW_OK);
+    return 0;
 }
@@ -0,0 +1,359 @@
+// This file contains the implementation of the setPolicy command, and the
+// checks that calcTxnHash uses to decide whether a transaction may be signed
+// under the policy.
+//
+// A high-level description of setPolicy is as follows. The computer sends a
+// signing policy: the key it applies to, limits on the amount sent by each
+// transaction and while the app is open, a limit on the miner fee, and a list
+// of allowed destination addresses. The destinations may span several
+// packets. The computer then requests a review, and the user is shown every
+// part of the policy. If they approve, the policy is written to NVM.
+//
+// From then on, when calcTxnHash is asked to sign a transaction with the
+// policy's key, and every output of the transaction is sent to an allowed
+// destination within the limits, the transaction is signed after a single
+// confirmation, or none at all if the policy says so. Any other transaction
+// is reviewed in full, as usual. The policy can be cleared at any time
+// without a review, since doing so only removes permissions.
+//
+// The device has no clock, so the session limit applies to the total signed
+// under the policy since the app was opened. That total is kept in RAM rather
+// than NVM, both to avoid wearing out the flash and because reopening the app
+// requires someone to be present at the device.
+//
+// Keep this description in mind as you read through the implementation.
+
+#include <io.h>
+#include <os.h>
+#include <os_io_seproxyhal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ux.h>
+
+#include "policy.h"
+#include "sia.h"
+#include "sia_ux.h"
+#include "txn.h"
+
+// These are APDU parameters that control the behavior of the setPolicy
+// command. The policy is sent with P1_FIRST, and any further destinations
+// with P1_MORE.
+#define P1_POLICY_REVIEW 0x01  // display the policy for approval
+#define P1_POLICY_CLEAR  0x02  // disable the policy
+
+#define POLICY_FLAG_CONFIRM 0x01  // ask for a single confirmation before signing
+
+// the number of review screens before the destinations
+#define POLICY_HEADER_ITEMS 5
+
+static setPolicyContext_t *ctx = &global.setPolicyContext;
+
+// the total signed under the policy since the app was opened, Sia-encoded
+static uint8_t sessionSpent[1 + 16];
+
+static void zero_ctx(void) {
+    explicit_bzero(ctx, sizeof(setPolicyContext_t));
+}
+
+static const policy_t *stored_policy(void) {
+    return (const policy_t *) &N_storage.policy;
+}
+
+bool policy_may_apply(const txn_state_t *txn, uint32_t keyIndex) {
+    const policy_t *policy = stored_policy();
+    return policy->enabled && policy->keyIndex == keyIndex && !txn->partial;
+}
+
+bool policy_check(const txn_state_t *txn, uint32_t keyIndex, uint8_t total[static 17]) {
+    const policy_t *policy = stored_policy();
+    if (!policy_may_apply(txn, keyIndex)) {
+        return false;
+    }
+
+    uint8_t fee[1 + 16] = {0};
+    memset(total, 0, 1 + 16);
+    for (uint16_t i = 0; i < txn->elementIndex; i++) {
+        const txn_elem_t *elem = &txn->elements[i];
+        switch (elem->elemType) {
+            case TXN_ELEM_SC_OUTPUT: {
+                bool allowed = false;
+                for (uint8_t j = 0; j < policy->destCount && !allowed; j++) {
+                    allowed = !memcmp(policy->dests[j], elem->outAddr, 32);
+                }
+                if (!allowed || !cur_add(total, elem->outVal)) {
+                    return false;
+                }
+                break;
+            }
+            case TXN_ELEM_MINER_FEE:
+                if (!cur_add(fee, elem->outVal)) {
+                    return false;
+                }
+                break;
+            default:
+                // siafund outputs and file contracts always require a full
+                // review
+                return false;
+        }
+    }
+
+    uint8_t spent[1 + 16];
+    memmove(spent, sessionSpent, sizeof(spent));
+    return cur_cmp(total, policy->maxTxn) <= 0 && cur_cmp(fee, policy->maxFee) <= 0 &&
+           cur_add(spent, total) && cur_cmp(spent, policy->maxSession) <= 0;
+}
+
+bool policy_confirm(void) {
+    return stored_policy()->confirm;
+}
+
+void policy_record(const uint8_t *total) {
+    if (!cur_add(sessionSpent, total)) {
+        // policy_check guarantees that this cannot overflow
+        THROW(SW_DEVELOPER_ERR);
+    }
+}
+
+// fmtPolicyItem prepares the specified part of the policy for display. It
+// stores the name of the part in labelStr, and its value in fullStr.
+static void fmtPolicyItem(uint8_t index) {
+    policy_t *policy = &ctx->policy;
+    switch (index) {
+        case 0:
+            memmove(ctx->labelStr, "Signing Key", 12);
+            ctx->fullStr[0] = '#';
+            bin2dec(ctx->fullStr + 1, policy->keyIndex);
+            break;
+        case 1:
+            memmove(ctx->labelStr, "Max Per Transaction", 20);
+            formatSC(ctx->fullStr, cur2dec(ctx->fullStr, policy->maxTxn));
+            break;
+        case 2:
+            memmove(ctx->labelStr, "Max Per Session", 16);
+            formatSC(ctx->fullStr, cur2dec(ctx->fullStr, policy->maxSession));
+            break;
+        case 3:
+            memmove(ctx->labelStr, "Max Miner Fee", 14);
+            formatSC(ctx->fullStr, cur2dec(ctx->fullStr, policy->maxFee));
+            break;
+        case 4:
+            memmove(ctx->labelStr, "Confirmation", 13);
+            if (policy->confirm) {
+                memmove(ctx->fullStr, "Required", 9);
+            } else {
+                memmove(ctx->fullStr, "Not required", 13);
+            }
+            break;
+        default:
+            memmove(ctx->labelStr, "Destination #", 13);
+            bin2dec(ctx->labelStr + 13, index - POLICY_HEADER_ITEMS + 1);
+            format_address(ctx->fullStr, policy->dests[index - POLICY_HEADER_ITEMS]);
+            break;
+    }
+}
+
+static unsigned int io_seproxyhal_touch_policy_ok(void) {
+    // A new policy starts a new session.
+    ctx->policy.enabled = true;
+    nvm_write((void *) &N_storage.policy, &ctx->policy, sizeof(policy_t));
+    explicit_bzero(sessionSpent, sizeof(sessionSpent));
+    zero_ctx();
+    io_send_sw(SW_OK);
+#ifdef HAVE_BAGL
+    ui_idle();
+#else
+    nbgl_useCaseStatus("POLICY SET", true, ui_idle);
+#endif
+    return 0;
+}
+
+static unsigned int io_seproxyhal_touch_policy_reject(void) {
+    zero_ctx();
+    return io_reject();
+}
+
+#ifdef HAVE_BAGL
+static unsigned int ui_policy_item_button(void);
+
+UX_STEP_CB(ux_policy_item_1_step,
+           bnnn_paging,
+           ui_policy_item_button(),
+           {global.setPolicyContext.labelStr, global.setPolicyContext.fullStr});
+
+// Each part of the policy is shown on the same screen, one after another.
+UX_FLOW(ux_policy_item_flow, &ux_policy_item_1_step);
+
+UX_STEP_NOCB(ux_policy_approve_flow_1_step, nn, {"Set signing", "policy?"});
+
+UX_STEP_VALID(ux_policy_approve_flow_2_step,
+              pb,
+              io_seproxyhal_touch_policy_ok(),
+              {&C_icon_validate_14, "Approve"});
+
+UX_STEP_VALID(ux_policy_approve_flow_3_step,
+              pb,
+              io_seproxyhal_touch_policy_reject(),
+              {&C_icon_crossmark, "Reject"});
+
+// Flow for approving the policy:
+// #1 screen: "Set signing policy?"
+// #2 screen: approve
+// #3 screen: reject
+UX_FLOW(ux_policy_approve_flow,
+        &ux_policy_approve_flow_1_step,
+        &ux_policy_approve_flow_2_step,
+        &ux_policy_approve_flow_3_step);
+
+static unsigned int ui_policy_item_button(void) {
+    ctx->displayIndex++;
+    if (ctx->displayIndex == POLICY_HEADER_ITEMS + ctx->policy.destCount) {
+        ux_flow_init(0, ux_policy_approve_flow, NULL);
+    } else {
+        fmtPolicyItem(ctx->displayIndex);
+        ux_flow_init(0, ux_policy_item_flow, NULL);
+    }
+    return 0;
+}
+
+static void begin_review(void) {
+    ctx->displayIndex = 0;
+    fmtPolicyItem(0);
+    ux_flow_init(0, ux_policy_item_flow, NULL);
+}
+
+#else
+
+static nbgl_layoutTagValue_t pair;
+
+static void confirm_callback(bool confirm) {
+    uiBusy = false;
+    if (confirm) {
+        io_seproxyhal_touch_policy_ok();
+    } else {
+        zero_ctx();
+        io_send_sw(SW_USER_REJECTED);
+        nbgl_useCaseStatus("Policy rejected", false, ui_idle);
+    }
+}
+
+static bool nav_callback(uint8_t page, nbgl_pageContent_t *content) {
+    if (page >= POLICY_HEADER_ITEMS + ctx->policy.destCount) {
+        content->type = INFO_LONG_PRESS;
+        content->infoLongPress.icon = &C_stax_app_sia_big;
+        content->infoLongPress.text = "Set signing policy";
+        content->infoLongPress.longPressText = "Hold to approve";
+        return true;
+    }
+
+    fmtPolicyItem(page);
+    pair.item = ctx->labelStr;
+    pair.value = ctx->fullStr;
+
+    content->type = TAG_VALUE_LIST;
+    content->tagValueList.nbPairs = 1;
+    content->tagValueList.pairs = &pair;
+    content->tagValueList.callback = NULL;
+    content->tagValueList.startIndex = 0;
+    content->tagValueList.wrapping = false;
+    content->tagValueList.smallCaseForValue = false;
+    content->tagValueList.nbMaxLinesForValue = 0;
+    return true;
+}
+
+static void begin_review(void) {
+    nbgl_useCaseRegularReview(0,
+                              POLICY_HEADER_ITEMS + ctx->policy.destCount + 1,
+                              "Reject",
+                              NULL,
+                              nav_callback,
+                              confirm_callback);
+}
+
+#endif
+
+// readAmount reads a currency value, encoded as in a policy_t: a length byte,
+// followed by that many big-endian bytes.
+static bool readAmount(uint8_t dst[static 17], uint8_t **buf, uint16_t *len) {
+    if (*len < 1 || (*buf)[0] > 16 || *len < 1 + (*buf)[0]) {
+        return false;
+    }
+    const uint8_t n = 1 + (*buf)[0];
+    memmove(dst, *buf, n);
+    *buf += n;
+    *len -= n;
+    return true;
+}
+
+// addDests appends destination unlock hashes to the policy being set up.
+static bool addDests(uint8_t *buf, uint16_t len) {
+    if (len % 32 != 0 || ctx->policy.destCount + len / 32 > MAX_POLICY_DESTS) {
+        return false;
+    }
+    memmove(ctx->policy.dests[ctx->policy.destCount], buf, len);
+    ctx->policy.destCount += len / 32;
+    return true;
+}
+
+// handleSetPolicy reads a signing policy and, once the user has approved it,
+// stores it in NVM.
+uint16_t handleSetPolicy(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t dataLength) {
+    if (p2 != 0) {
+        return SW_INVALID_PARAM;
+    }
+
+    switch (p1) {
+        case P1_FIRST:
+            // The first packet includes the key index, flags, and limits,
+            // followed by as many destinations as fit.
+            zero_ctx();
+            if (dataLength < 5 || (dataBuffer[4] & ~POLICY_FLAG_CONFIRM) != 0) {
+                return SW_INVALID_PARAM;
+            }
+            ctx->policy.keyIndex = U4LE(dataBuffer, 0);
+            ctx->policy.confirm = (dataBuffer[4] & POLICY_FLAG_CONFIRM) != 0;
+            dataBuffer += 5;
+            dataLength -= 5;
+            if (!readAmount(ctx->policy.maxTxn, &dataBuffer, &dataLength) ||
+                !readAmount(ctx->policy.maxSession, &dataBuffer, &dataLength) ||
+                !readAmount(ctx->policy.maxFee, &dataBuffer, &dataLength) ||
+                !addDests(dataBuffer, dataLength)) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            ctx->initialized = true;
+            return SW_OK;
+
+        case P1_MORE:
+            if (!ctx->initialized) {
+                zero_ctx();
+                return SW_IMPROPER_INIT;
+            } else if (!addDests(dataBuffer, dataLength)) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            return SW_OK;
+
+        case P1_POLICY_REVIEW:
+            // A policy without destinations could never be used.
+            if (!ctx->initialized || ctx->policy.destCount == 0) {
+                zero_ctx();
+                return SW_IMPROPER_INIT;
+            }
+            // No more destinations may be added once the review has begun.
+            ctx->initialized = false;
+            uiBusy = true;
+            begin_review();
+            return 0;
+
+        case P1_POLICY_CLEAR: {
+            const policy_t empty = {0};
+            nvm_write((void *) &N_storage.policy, (void *) &empty, sizeof(policy_t));
+            explicit_bzero(sessionSpent, sizeof(sessionSpent));
+            return SW_OK;
+        }
+
+        default:
+            return SW_INVALID_PARAM;
+    }
+}
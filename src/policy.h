@@ -0,0 +1,27 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "txn.h"
+
+// policy_may_apply reports whether the stored policy could allow a
+// transaction with the given parameters to be signed with keyIndex, before any
+// of its elements are known.
+bool policy_may_apply(const txn_state_t *txn, uint32_t keyIndex);
+
+// policy_check reports whether a fully-decoded transaction may be signed with
+// keyIndex under the stored policy, without a full review. If so, the total
+// amount it sends is written to total.
+bool policy_check(const txn_state_t *txn, uint32_t keyIndex, uint8_t total[static 17]);
+
+// policy_confirm reports whether the policy requires a single confirmation
+// before each signature.
+bool policy_confirm(void);
+
+// policy_record adds total to the amount signed under the policy since the
+// app was opened.
+void policy_record(const uint8_t *total);
+
+#endif /* POLICY_H */
@@ -2,7 +2,6 @@
 
 #include <cx.h>
 #include <ledger_assert.h>
-#include <lib_standard_app/crypto_helpers.h>
 #include <os.h>
 #include <os_seed.h>
 #include <stdbool.h>
@@ -11,28 +10,74 @@
 
 #include "blake2b.h"
 
-static void siaSetPath(uint32_t index, uint32_t path[static 5]) {
-    path[0] = 44 | 0x80000000;
-    path[1] = 93 | 0x80000000;
-    path[2] = index | 0x80000000;
-    path[3] = 0x80000000;
-    path[4] = 0x80000000;
+// Every key is derived from the 44'/93' node, so that node is derived from
+// the seed once and kept for the rest of the session; each key then only
+// costs the three levels below it. The node is wiped by clearKeyCache.
+static struct {
+    bool valid;
+    uint8_t key[32];
+    uint8_t chainCode[32];
+} coinNode;
+
+void clearKeyCache(void) {
+    explicit_bzero(&coinNode, sizeof(coinNode));
+}
+
+// deriveChild replaces the SLIP-10 Ed25519 node (key, chainCode) with its
+// hardened child at index.
+static void deriveChild(uint8_t key[static 32], uint8_t chainCode[static 32], uint32_t index) {
+    uint8_t data[1 + 32 + 4];
+    uint8_t node[64];
+    data[0] = 0;
+    memmove(data + 1, key, 32);
+    U4BE_ENCODE(data, 33, index | 0x80000000);
+    LEDGER_ASSERT(CX_OK == cx_hmac_sha512(chainCode, 32, data, sizeof(data), node, sizeof(node)),
+                  "derive child failed");
+    memmove(key, node, 32);
+    memmove(chainCode, node + 32, 32);
+    explicit_bzero(data, sizeof(data));
+    explicit_bzero(node, sizeof(node));
+}
+
+// derivePrivateKey derives the private key at 44'/93'/index'/0'/0'.
+static void derivePrivateKey(uint32_t index, cx_ecfp_private_key_t *privateKey) {
+    if (!coinNode.valid) {
+        const uint32_t path[2] = {44 | 0x80000000, 93 | 0x80000000};
+        uint8_t rawKey[64];
+        LEDGER_ASSERT(CX_OK == os_derive_bip32_with_seed_no_throw(HDW_ED25519_SLIP10,
+                                                                   CX_CURVE_Ed25519,
+                                                                   path,
+                                                                   2,
+                                                                   rawKey,
+                                                                   coinNode.chainCode,
+                                                                   NULL,
+                                                                   0),
+                      "derive node failed");
+        memmove(coinNode.key, rawKey, 32);
+        explicit_bzero(rawKey, sizeof(rawKey));
+        coinNode.valid = true;
+    }
+
+    uint8_t key[32], chainCode[32];
+    memmove(key, coinNode.key, 32);
+    memmove(chainCode, coinNode.chainCode, 32);
+    deriveChild(key, chainCode, index);
+    deriveChild(key, chainCode, 0);
+    deriveChild(key, chainCode, 0);
+    LEDGER_ASSERT(CX_OK == cx_ecfp_init_private_key_no_throw(CX_CURVE_Ed25519, key, 32, privateKey),
+                  "init key failed");
+    explicit_bzero(key, sizeof(key));
+    explicit_bzero(chainCode, sizeof(chainCode));
 }
 
 void deriveSiaPublicKey(uint32_t index, uint8_t publicKey[static 65]) {
-    uint32_t bip32Path[5];
-    siaSetPath(index, bip32Path);
-
-    LEDGER_ASSERT(CX_OK == bip32_derive_with_seed_get_pubkey_256(HDW_ED25519_SLIP10,
-                                                                 CX_CURVE_Ed25519,
-                                                                 bip32Path,
-                                                                 5,
-                                                                 publicKey,
-                                                                 NULL,
-                                                                 CX_SHA512,
-                                                                 NULL,
-                                                                 0),
-                  "get pubkey failed");
+    cx_ecfp_private_key_t privateKey;
+    cx_ecfp_public_key_t pk;
+    derivePrivateKey(index, &privateKey);
+    const cx_err_t err = cx_ecfp_generate_pair_no_throw(CX_CURVE_Ed25519, &pk, &privateKey, true);
+    explicit_bzero(&privateKey, sizeof(privateKey));
+    LEDGER_ASSERT(CX_OK == err, "get pubkey failed");
+    memmove(publicKey, pk.W, 65);
 }
 
 void extractPubkeyBytes(unsigned char *dst, const uint8_t publicKey[static 65]) {
@@ -45,22 +90,11 @@ void extractPubkeyBytes(unsigned char *dst, const uint8_t publicKey[static 65])
 }
 
 void deriveAndSign(uint8_t *dst, uint32_t index, const uint8_t *hash) {
-    uint32_t bip32Path[5];
-    siaSetPath(index, bip32Path);
-
-    size_t signatureLength = 64;
-    LEDGER_ASSERT(CX_OK == bip32_derive_with_seed_eddsa_sign_hash_256(HDW_ED25519_SLIP10,
-                                                                      CX_CURVE_Ed25519,
-                                                                      bip32Path,
-                                                                      5,
-                                                                      CX_SHA512,
-                                                                      hash,
-                                                                      32,
-                                                                      dst,
-                                                                      &signatureLength,
-                                                                      NULL,
-                                                                      0),
-                  "signing txn failed");
+    cx_ecfp_private_key_t privateKey;
+    derivePrivateKey(index, &privateKey);
+    const cx_err_t err = cx_eddsa_sign_no_throw(&privateKey, CX_SHA512, hash, 32, dst, 64);
+    explicit_bzero(&privateKey, sizeof(privateKey));
+    LEDGER_ASSERT(CX_OK == err, "signing txn failed");
 }
 
 void bin2hex(char *dst, const uint8_t *data, uint64_t inlen) {
@@ -72,7 +106,7 @@ void bin2hex(char *dst, const uint8_t *data, uint64_t inlen) {
     dst[2 * inlen] = '\0';
 }
 
-void pubkeyToSiaAddress(char *dst, const uint8_t publicKey[static 65]) {
+void pubkeyToSiaUnlockHash(uint8_t dst[static 32], const uint8_t publicKey[static 65]) {
     // A Sia address is the Merkle root of a set of unlock conditions.
     // For a "standard" address, the unlock conditions are:
     //
@@ -118,14 +152,19 @@ void pubkeyToSiaAddress(char *dst, const uint8_t publicKey[static 65]) {
     // hash sigsrequired into slot 2
     blake2b(merkleData + 33, 32, sigsrequiredData, sizeof(sigsrequiredData));
     // join hashes into slot 1, finishing Merkle root (unlock hash)
-    blake2b(merkleData + 1, 32, merkleData, 65);
+    blake2b(dst, 32, merkleData, 65);
+}
+
+void pubkeyToSiaAddress(char *dst, const uint8_t publicKey[static 65]) {
+    uint8_t unlockHash[32];
+    pubkeyToSiaUnlockHash(unlockHash, publicKey);
 
     // hash the unlock hash to get a checksum
     uint8_t checksum[6];
-    blake2b(checksum, sizeof(checksum), merkleData + 1, 32);
+    blake2b(checksum, sizeof(checksum), unlockHash, sizeof(unlockHash));
 
     // convert the hash+checksum to hex
-    bin2hex(dst, merkleData + 1, 32);
+    bin2hex(dst, unlockHash, sizeof(unlockHash));
     bin2hex(dst + 64, checksum, sizeof(checksum));
 }
 
@@ -14,10 +14,18 @@
 #define SW_OK                0x9000
 
 // APDU parameters
-#define P1_FIRST        0x00  // 1st packet of multi-packet transfer
-#define P1_MORE         0x80  // nth packet of multi-packet transfer
-#define P2_DISPLAY_HASH 0x00  // display transaction hash
-#define P2_SIGN_HASH    0x01  // sign transaction hash
+#define P1_FIRST         0x00  // 1st packet of multi-packet transfer
+#define P1_MORE          0x80  // nth packet of multi-packet transfer
+#define P1_RESUME        0x40  // resume an interrupted multi-packet transfer
+#define P2_DISPLAY_HASH  0x00  // display transaction hash
+#define P2_SIGN_HASH     0x01  // sign transaction hash
+#define P2_ZERO_RLE      0x02  // transaction data is zero-run encoded
+#define P2_PARTIAL_COVER 0x04  // TxnSig covers only the declared elements
+#define P2_TXN_ID        0x08  // also return the transaction ID
+#define P2_CHANGE_RANGE  0x10  // a range of change indices is declared
+#define P2_SUMMARY       0x20  // review totals per destination instead of each output
+#define P2_NO_REVIEW     0x40  // return the hash without displaying the transaction
+#define P2_SAVE_TEMPLATE 0x80  // save the outputs as a payout template once approved
 
 // bin2hex converts binary to hex and appends a final NUL byte.
 void bin2hex(char *dst, const uint8_t *data, uint64_t inlen);
@@ -34,16 +42,24 @@ int formatSC(char *buf, uint8_t decLen);
 // 32-byte array.
 void extractPubkeyBytes(unsigned char *dst, const uint8_t publicKey[static 65]);
 
+// pubkeyToSiaUnlockHash converts a Ledger pubkey to the 32-byte unlock hash
+// of its standard address.
+void pubkeyToSiaUnlockHash(uint8_t dst[static 32], const uint8_t publicKey[static 65]);
+
 // pubkeyToSiaAddress converts a Ledger pubkey to a Sia wallet address.
 void pubkeyToSiaAddress(char *dst, const uint8_t publicKey[static 65]);
 
 // deriveSiaPublicKey derives an Ed25519 public key from an index and the
 // Ledger seed.
-void deriveSiaPublicKey(uint32_t index, uint8_t publicKey[static 64]);
+void deriveSiaPublicKey(uint32_t index, uint8_t publicKey[static 65]);
 
 // deriveAndSign derives an Ed25519 private key from an index and the
 // Ledger seed, and uses it to produce a 64-byte signature of the provided
 // 32-byte hash. The key is cleared from memory after signing.
 void deriveAndSign(uint8_t *dst, uint32_t index, const uint8_t *hash);
 
+// clearKeyCache wipes the cached 44'/93' node that keys are derived from. It
+// is called whenever a command fails and before the app exits.
+void clearKeyCache(void);
+
 #endif /* SIA_H */
\ No newline at end of file
@@ -15,6 +15,10 @@
 // life of the command. A separate context_t struct should be defined for each
 // command.
 
+// MAX_PUBKEY_BATCH is the number of public keys that getPublicKey can return
+// in a single response without displaying them.
+#define MAX_PUBKEY_BATCH 7
+
 typedef struct {
     uint32_t keyIndex;
     bool genAddr;
@@ -22,10 +26,16 @@ typedef struct {
     char typeStr[40];  // variable-length
     char keyStr[40];   // variable-length
     char fullStr[77];  // variable length
+
+    // public keys returned without display
+    uint8_t keys[MAX_PUBKEY_BATCH][32];
 } getPublicKeyContext_t;
 
 #define SIA_HASH_SIZE 32
 
+// the size of a payout template label, including the final NUL byte
+#define TEMPLATE_LABEL_LEN 16
+
 typedef struct {
     uint32_t keyIndex;
     uint8_t hash[SIA_HASH_SIZE];
@@ -34,9 +44,28 @@ typedef struct {
     char hexHash[SIA_HASH_SIZE * 2];
 } signHashContext_t;
 
+#define MSG_PREVIEW_LEN 32
+
+typedef struct {
+    uint32_t keyIndex;
+    uint32_t msgLen;    // total length of the message
+    uint32_t received;  // bytes of the message received so far
+    cx_blake2b_t blake;
+    uint8_t hash[SIA_HASH_SIZE];
+    uint8_t preview[MSG_PREVIEW_LEN];  // start of the message
+    bool initialized;                  // a message is being received
+
+    // NUL-terminated strings for display
+    char typeStr[40];
+    char previewStr[MSG_PREVIEW_LEN * 2 + 4];  // hex, or text, plus "..."
+    char lenStr[24];
+    char hexHash[SIA_HASH_SIZE * 2 + 1];
+} signMessageContext_t;
+
 typedef struct {
     uint32_t keyIndex;
     bool sign;
+    bool zeroRLE;      // whether the transaction data is zero-run encoded
     uint8_t elemPart;  // screen index of elements
 
     uint16_t elementIndex;
@@ -44,23 +73,192 @@ typedef struct {
     txn_state_t txn;
     // NULL-terminated strings for display
     char labelStr[40];     // variable length
-    char fullStr[2][128];  // variable length
+    char fullStr[3][128];  // variable length
     bool initialized;      // protects against certain attacks
     bool finished;         // whether we have reached the end of the transaction
+
+    uint32_t sessionToken;  // identifies the transfer when resuming
+    uint32_t ackedBytes;    // transaction bytes fully processed so far
+
+    uint8_t policyTotal[1 + 16];  // amount sent, if signing under the policy
+
+    // If the transaction is saved as a payout template, its outputs are
+    // stored under the label once the user approves it.
+    bool saveTemplate;                       // the outputs are to be saved as a template
+    char templateLabel[TEMPLATE_LABEL_LEN];  // NUL-terminated printable ASCII
+    uint8_t templateDigest[32];              // digest of the outputs being saved
+
+    // On NBGL, the review begins as soon as the first element is decoded,
+    // while the rest of the transaction is still being received.
+    bool reviewShown;     // the review has been shown
+    uint8_t reviewPages;  // number of pages being reviewed, or 0 before paging
+    bool reviewWaiting;   // the user has reached the end of the decoded elements
+    bool rejected;        // the user rejected the transaction during the transfer
+
+    // In summary mode, the totals and each destination are reviewed instead
+    // of each element, which the user may still review on request.
+    bool summary;           // summary mode was requested
+    bool summaryShown;      // the summary is being reviewed
+    uint16_t summaryIndex;  // screen index of the summary
+    txn_summary_t totals;
 } calcTxnHashContext_t;
 
+#ifdef TARGET_NANOS
+#define MAX_BATCH_TXNS  4
+#define MAX_BATCH_DESTS 4
+#else
+#define MAX_BATCH_TXNS  16
+#define MAX_BATCH_DESTS 16
+#endif
+
+typedef struct {
+    uint32_t keyIndex;
+    uint8_t sigHash[32];
+} batchTxn_t;
+
+typedef struct {
+    uint8_t elemType;       // TXN_ELEM_SC_OUTPUT or TXN_ELEM_SF_OUTPUT
+    uint8_t addr[32];       // address, Sia-encoded
+    uint8_t total[1 + 16];  // running total, Sia-encoded
+} batchDest_t;
+
+typedef struct {
+    txn_state_t txn;  // decoder for the transaction currently being streamed
+
+    batchTxn_t txns[MAX_BATCH_TXNS];     // hashes of the completed transactions
+    batchDest_t dests[MAX_BATCH_DESTS];  // output totals, per destination
+    uint8_t fee[1 + 16];                 // miner fee total, Sia-encoded
+    uint8_t txnCount;
+    uint8_t destCount;
+
+    uint8_t displayIndex;  // screen index of the summary
+    uint8_t elemPart;      // screen index of the current destination
+    uint32_t sigsSent;     // bitmask of signatures already returned
+
+    // NUL-terminated strings for display; BAGL shows one value at a time
+    char labelStr[40];     // variable length
+#ifdef HAVE_BAGL
+    char fullStr[1][128];  // variable length
+#else
+    char fullStr[2][128];  // variable length
+#endif
+    bool initialized;      // a batch is open
+    bool txnInitialized;   // protects against certain attacks; see calcTxnHash
+    bool approved;         // the user approved the summary
+} signTxnBatchContext_t;
+
+#ifdef TARGET_NANOS
+#define MAX_POLICY_DESTS 4
+#else
+#define MAX_POLICY_DESTS 8
+#endif
+
+// A policy_t allows transactions that stay within its limits to be signed
+// without reviewing each element. Amounts are Sia-encoded, in hastings.
+typedef struct {
+    bool enabled;
+    bool confirm;                         // ask for a single confirmation before signing
+    uint32_t keyIndex;                    // the only key that may sign under the policy
+    uint8_t maxTxn[1 + 16];               // max sent by a single transaction
+    uint8_t maxSession[1 + 16];           // max sent while the app is open
+    uint8_t maxFee[1 + 16];               // max miner fee of a single transaction
+    uint8_t destCount;                    // number of allowed destinations
+    uint8_t dests[MAX_POLICY_DESTS][32];  // allowed unlock hashes
+} policy_t;
+
+typedef struct {
+    policy_t policy;  // the policy being set up
+
+    uint8_t displayIndex;  // screen index of the review
+
+    // NUL-terminated strings for display
+    char labelStr[40];  // variable length
+    char fullStr[128];  // variable length
+    bool initialized;   // a policy is being set up
+} setPolicyContext_t;
+
+#ifdef TARGET_NANOS
+#define MAX_TRUSTED_ADDRS   64
+#define MAX_TRUSTED_PENDING 4
+#else
+#define MAX_TRUSTED_ADDRS   256
+#define MAX_TRUSTED_PENDING 8
+#endif
+
+// the size of a trusted address label, including the final NUL byte
+#define TRUSTED_LABEL_LEN 16
+
+// A trustedAddr_t names an unlock hash that the user has approved, so that
+// outputs sent to it can be shown by name instead of in full.
+typedef struct {
+    uint8_t addr[32];               // unlock hash
+    char label[TRUSTED_LABEL_LEN];  // NUL-terminated printable ASCII
+} trustedAddr_t;
+
+// The trusted addresses are kept sorted by unlock hash, so that each output
+// can be looked up with a binary search.
+typedef struct {
+    uint16_t count;
+    trustedAddr_t entries[MAX_TRUSTED_ADDRS];
+} trustedTable_t;
+
+typedef struct {
+    // the addresses being added, sorted by unlock hash
+    trustedAddr_t pending[MAX_TRUSTED_PENDING];
+    uint8_t pendingCount;
+
+    uint8_t displayIndex;  // screen index of the review
+
+    // NUL-terminated strings for display
+    char labelStr[40];  // variable length
+    char fullStr[128];  // variable length
+    bool initialized;   // addresses are being added
+} addTrustedContext_t;
+
+#ifdef TARGET_NANOS
+#define MAX_TEMPLATES 8
+#else
+#define MAX_TEMPLATES 32
+#endif
+
+// A payoutTemplate_t names a set of outputs that the user has reviewed in
+// full, so that a transaction paying out exactly the same amounts to the same
+// addresses can be signed after a single confirmation.
+typedef struct {
+    uint8_t digest[32];              // digest of the outputs; see template_digest
+    char label[TEMPLATE_LABEL_LEN];  // NUL-terminated printable ASCII
+} payoutTemplate_t;
+
+typedef struct {
+    uint8_t count;
+    payoutTemplate_t entries[MAX_TEMPLATES];
+} templateTable_t;
+
 // To save memory, we store all the context types in a single global union,
 // taking advantage of the fact that only one command is executed at a time.
 typedef union {
     getPublicKeyContext_t getPublicKeyContext;
     signHashContext_t signHashContext;
+    signMessageContext_t signMessageContext;
     calcTxnHashContext_t calcTxnHashContext;
+    signTxnBatchContext_t signTxnBatchContext;
+    setPolicyContext_t setPolicyContext;
+    addTrustedContext_t addTrustedContext;
 } commandContext;
 extern commandContext global;
 
+// uiBusy is set while a command's review is on screen, and cleared once the
+// user has answered it (or by ui_idle). Until then, only the packets that
+// continue the command under review are accepted, so that no other command
+// can change the state in global that the review displays and acts on.
+extern bool uiBusy;
+
 typedef struct internalStorage_t {
     bool blindSign;
     bool initialized;
+    policy_t policy;
+    trustedTable_t trusted;
+    templateTable_t templates;
 } internalStorage_t;
 
 extern const internalStorage_t N_storage_real;
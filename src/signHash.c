@@ -80,6 +80,7 @@ static void cancel_review(void) {
 }
 
 static void confirm_callback(bool confirm) {
+    uiBusy = false;
     if (confirm) {
         io_seproxyhal_touch_hash_ok();
     } else {
@@ -110,6 +111,7 @@ uint16_t handleSignHash(uint8_t p1 __attribute__((unused)),
     // Prepare to display the comparison screen by converting the hash to hex
     bin2hex(ctx->hexHash, ctx->hash, SIA_HASH_SIZE);
 
+    uiBusy = true;
 #ifdef HAVE_BAGL
     ux_flow_init(0, ux_approve_hash_flow, NULL);
 #else
@@ -0,0 +1,234 @@
+// This file contains the implementation of the signMessage command. It is
+// similar to signHash, except that the device computes the hash itself, so
+// the user does not need to trust the computer, and blind signing need not be
+// enabled.
+//
+// A high-level description of signMessage is as follows. The computer streams
+// a message of arbitrary length to the device, in as many packets as
+// necessary, and the handler adds each packet to a BLAKE2B hash as it
+// arrives. The message is not stored; only its first few bytes are kept for
+// display. Once the whole message has been received, the user is shown a
+// preview of the message, its total length, and its hash, and asked to
+// approve or reject signing it. If they approve, the hash is signed with the
+// requested key.
+//
+// To ensure that a signed message can never be mistaken for a signed
+// transaction, the hash is computed over a fixed prefix and the length of the
+// message, followed by the message itself.
+//
+// Keep this description in mind as you read through the implementation.
+
+#include <io.h>
+#include <os.h>
+#include <os_io_seproxyhal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ux.h>
+
+#include "blake2b.h"
+#include "sia.h"
+#include "sia_ux.h"
+
+static signMessageContext_t *ctx = &global.signMessageContext;
+
+static const char messagePrefix[] = "sia/message|";
+
+static void zero_ctx(void) {
+    explicit_bzero(ctx, sizeof(signMessageContext_t));
+}
+
+static unsigned int io_seproxyhal_touch_message_ok(void) {
+    uint8_t signature[64] = {0};
+    deriveAndSign(signature, ctx->keyIndex, ctx->hash);
+    io_send_response_pointer(signature, sizeof(signature), SW_OK);
+    zero_ctx();
+
+#ifdef HAVE_BAGL
+    ui_idle();
+#else
+    nbgl_useCaseStatus("MESSAGE SIGNED", true, ui_idle);
+#endif
+
+    return 0;
+}
+
+static unsigned int io_seproxyhal_touch_message_reject(void) {
+    zero_ctx();
+    return io_reject();
+}
+
+#ifdef HAVE_BAGL
+UX_STEP_NOCB(ux_sign_message_flow_1_step,
+             bnnn_paging,
+             {"Message", global.signMessageContext.previewStr});
+
+UX_STEP_NOCB(ux_sign_message_flow_2_step,
+             bnnn_paging,
+             {"Length", global.signMessageContext.lenStr});
+
+UX_STEP_NOCB(ux_sign_message_flow_3_step,
+             bnnn_paging,
+             {"Hash", global.signMessageContext.hexHash});
+
+UX_STEP_NOCB(ux_sign_message_flow_4_step,
+             nn,
+             {"Sign message", global.signMessageContext.typeStr});
+
+UX_STEP_VALID(ux_sign_message_flow_5_step,
+              pb,
+              io_seproxyhal_touch_message_ok(),
+              {&C_icon_validate_14, "Approve"});
+
+UX_STEP_VALID(ux_sign_message_flow_6_step,
+              pb,
+              io_seproxyhal_touch_message_reject(),
+              {&C_icon_crossmark, "Reject"});
+
+// Flow for the message signing menu:
+// #1 screen: the start of the message
+// #2 screen: the length of the message
+// #3 screen: the hash of the message
+// #4 screen: the signing key
+// #5 screen: approve
+// #6 screen: reject
+UX_FLOW(ux_sign_message_flow,
+        &ux_sign_message_flow_1_step,
+        &ux_sign_message_flow_2_step,
+        &ux_sign_message_flow_3_step,
+        &ux_sign_message_flow_4_step,
+        &ux_sign_message_flow_5_step,
+        &ux_sign_message_flow_6_step);
+#else
+
+static nbgl_layoutTagValue_t pairs[3];
+
+static void confirm_callback(bool confirm) {
+    uiBusy = false;
+    if (confirm) {
+        io_seproxyhal_touch_message_ok();
+    } else {
+        zero_ctx();
+        io_send_sw(SW_USER_REJECTED);
+        nbgl_useCaseStatus("Signing Cancelled", false, ui_idle);
+    }
+}
+
+#endif
+
+// fmtPreview prepares the start of the message for display: as text if it is
+// printable ASCII, or as hex otherwise. An ellipsis is appended if the message
+// is longer than the preview.
+static void fmtPreview(void) {
+    const uint8_t n = (ctx->msgLen < MSG_PREVIEW_LEN) ? ctx->msgLen : MSG_PREVIEW_LEN;
+    bool text = true;
+    for (uint8_t i = 0; i < n; i++) {
+        if (ctx->preview[i] < 0x20 || ctx->preview[i] > 0x7E) {
+            text = false;
+            break;
+        }
+    }
+
+    char *end = ctx->previewStr;
+    if (text) {
+        memmove(end, ctx->preview, n);
+        end += n;
+    } else {
+        bin2hex(end, ctx->preview, n);
+        end += 2 * n;
+    }
+    if (ctx->msgLen > n) {
+        memmove(end, "...", 4);
+    } else {
+        *end = '\0';
+    }
+}
+
+static void begin_review(void) {
+    uiBusy = true;
+    fmtPreview();
+    memmove(ctx->lenStr + bin2dec(ctx->lenStr, ctx->msgLen), " bytes", 7);
+    bin2hex(ctx->hexHash, ctx->hash, sizeof(ctx->hash));
+
+#ifdef HAVE_BAGL
+    memmove(ctx->typeStr, "with key #", 10);
+    memmove(ctx->typeStr + 10 + bin2dec(ctx->typeStr + 10, ctx->keyIndex), "?", 2);
+    ux_flow_init(0, ux_sign_message_flow, NULL);
+#else
+    snprintf(ctx->typeStr, sizeof(ctx->typeStr), "Sign Message with Key %d?", ctx->keyIndex);
+
+    pairs[0].item = "Message";
+    pairs[0].value = ctx->previewStr;
+    pairs[1].item = "Length";
+    pairs[1].value = ctx->lenStr;
+    pairs[2].item = "Hash";
+    pairs[2].value = ctx->hexHash;
+
+    nbgl_layoutTagValueList_t tagValueList = {0};
+    tagValueList.nbPairs = 3;
+    tagValueList.pairs = pairs;
+
+    nbgl_useCaseReview(TYPE_MESSAGE,
+                       &tagValueList,
+                       &C_stax_app_sia_big,
+                       ctx->typeStr,
+                       NULL,
+                       "Sign message",
+                       confirm_callback);
+#endif
+}
+
+// handleSignMessage reads a message, computes its hash as it is received, and
+// then prompts the user to sign the hash.
+uint16_t handleSignMessage(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t dataLength) {
+    if (p2 != 0) {
+        return SW_INVALID_PARAM;
+    }
+
+    if (p1 == P1_FIRST) {
+        // The first packet includes the key index and the total length of
+        // the message, which is hashed before the message itself.
+        zero_ctx();
+        if (dataLength < 8) {
+            return SW_INVALID_PARAM;
+        }
+        ctx->keyIndex = U4LE(dataBuffer, 0);
+        ctx->msgLen = U4LE(dataBuffer, 4);
+        dataBuffer += 8;
+        dataLength -= 8;
+
+        uint8_t len[8] = {0};
+        U4LE_ENCODE(len, 0, ctx->msgLen);
+        blake2b_init(&ctx->blake);
+        blake2b_update(&ctx->blake, (const uint8_t *) messagePrefix, sizeof(messagePrefix) - 1);
+        blake2b_update(&ctx->blake, len, sizeof(len));
+        ctx->initialized = true;
+    } else if (p1 == P1_MORE) {
+        if (!ctx->initialized) {
+            return SW_IMPROPER_INIT;
+        }
+    } else {
+        return SW_INVALID_PARAM;
+    }
+
+    // The computer must not send more than it declared.
+    if (dataLength > ctx->msgLen - ctx->received) {
+        zero_ctx();
+        return SW_INVALID_PARAM;
+    }
+    if (ctx->received < MSG_PREVIEW_LEN) {
+        const uint16_t n = MSG_PREVIEW_LEN - ctx->received;
+        memmove(ctx->preview + ctx->received, dataBuffer, (dataLength < n) ? dataLength : n);
+    }
+    blake2b_update(&ctx->blake, dataBuffer, dataLength);
+    ctx->received += dataLength;
+    if (ctx->received < ctx->msgLen) {
+        return SW_OK;
+    }
+
+    // The whole message has been received; no more data may be added.
+    ctx->initialized = false;
+    blake2b_final(&ctx->blake, ctx->hash, sizeof(ctx->hash));
+    begin_review();
+    return 0;
+}
@@ -0,0 +1,435 @@
+// This file contains the implementation of the signTxnBatch command. It
+// builds on calcTxnHash, so read that first; the transaction decoding is
+// identical, and only the review differs.
+//
+// A high-level description of signTxnBatch is as follows. The computer
+// streams several transactions back to back, each one using the same packet
+// format as calcTxnHash. Instead of displaying each transaction as it is
+// decoded, the handler stores its SigHash and adds its outputs and miner fees
+// to a set of running totals, one per destination address. Once all
+// transactions have been sent, the computer requests a review, and the user
+// is shown the combined totals: how much is being sent to each destination
+// across the whole batch, and the total miner fee. If the user approves, the
+// computer may then request the signature of each transaction in turn. If the
+// user rejects, the entire batch is discarded.
+//
+// Keep this description in mind as you read through the implementation.
+
+#include <io.h>
+#include <os.h>
+#include <os_io_seproxyhal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ux.h>
+
+#include "blake2b.h"
+#include "sia.h"
+#include "sia_ux.h"
+#include "txn.h"
+
+// These are APDU parameters that control the behavior of the signTxnBatch
+// command. Transactions are streamed with P1_FIRST and P1_MORE, exactly as
+// in calcTxnHash.
+#define P1_BATCH_REVIEW 0x01  // display the summary of the batch
+#define P1_BATCH_SIG    0x02  // fetch a signature after the batch is approved
+
+static signTxnBatchContext_t *ctx = &global.signTxnBatchContext;
+
+static void zero_ctx(void) {
+    explicit_bzero(ctx, sizeof(signTxnBatchContext_t));
+}
+
+// fmtBatchAmount writes the total of the specified destination to dst. If
+// dest is NULL, the miner fee total is written instead.
+static void fmtBatchAmount(char *dst, batchDest_t *dest) {
+    if (dest == NULL) {
+        formatSC(dst, cur2dec(dst, ctx->fee));
+    } else if (dest->elemType == TXN_ELEM_SC_OUTPUT) {
+        formatSC(dst, cur2dec(dst, dest->total));
+    } else {
+        const uint8_t valLen = cur2dec(dst, dest->total);
+        memmove(dst + valLen, " SF", 4);
+    }
+}
+
+static void fmtBatchLabel(void) {
+    memmove(ctx->labelStr, "Destination #", 13);
+    bin2dec(ctx->labelStr + 13, ctx->displayIndex + 1);
+}
+
+// keyScreens returns the number of screens that name the signing keys: one,
+// if every transaction is signed with the same key, or else one for each
+// transaction.
+static uint8_t keyScreens(void) {
+    for (uint8_t i = 1; i < ctx->txnCount; i++) {
+        if (ctx->txns[i].keyIndex != ctx->txns[0].keyIndex) {
+            return ctx->txnCount;
+        }
+    }
+    return 1;
+}
+
+// fmtBatchKey prepares the specified key screen, writing its label to
+// labelStr and the key index to dst.
+static void fmtBatchKey(char *dst, uint8_t index) {
+    if (keyScreens() == 1) {
+        memmove(ctx->labelStr, "Signing Key", 12);
+    } else {
+        memmove(ctx->labelStr, "Key of Txn #", 12);
+        bin2dec(ctx->labelStr + 12, index + 1);
+    }
+    memmove(dst, "Key #", 5);
+    bin2dec(dst + 5, ctx->txns[index].keyIndex);
+}
+
+static unsigned int io_seproxyhal_touch_batch_ok(void) {
+    ctx->approved = true;
+    io_send_response_pointer(&ctx->txnCount, sizeof(ctx->txnCount), SW_OK);
+    // Nothing has been signed yet; the signatures are requested separately.
+#ifdef HAVE_BAGL
+    ui_idle();
+#else
+    nbgl_useCaseStatus("BATCH APPROVED", true, ui_idle);
+#endif
+    return 0;
+}
+
+#ifdef HAVE_BAGL
+static unsigned int ui_batch_elem_button(void);
+
+static unsigned int io_batch_reject(void) {
+    zero_ctx();
+    return io_reject();
+}
+
+// We use one generic step for each screen of the summary, just like the
+// per-element screens of calcTxnHash.
+UX_STEP_CB(ux_batch_elem_1_step,
+           bnnn_paging,
+           ui_batch_elem_button(),
+           {global.signTxnBatchContext.labelStr, global.signTxnBatchContext.fullStr[0]});
+
+UX_FLOW(ux_batch_elem_flow, &ux_batch_elem_1_step);
+
+UX_STEP_NOCB(ux_approve_batch_flow_1_step,
+             nn,
+             {"Sign batch", global.signTxnBatchContext.fullStr[0]});
+
+UX_STEP_VALID(ux_approve_batch_flow_2_step,
+              pb,
+              io_seproxyhal_touch_batch_ok(),
+              {&C_icon_validate_14, "Approve"});
+
+UX_STEP_VALID(ux_approve_batch_flow_3_step, pb, io_batch_reject(), {&C_icon_crossmark, "Reject"});
+
+// Flow for the batch approval menu:
+// #1 screen: "Sign batch of N txns?"
+// #2 screen: approve
+// #3 screen: reject
+UX_FLOW(ux_approve_batch_flow,
+        &ux_approve_batch_flow_1_step,
+        &ux_approve_batch_flow_2_step,
+        &ux_approve_batch_flow_3_step);
+
+// fmtBatchElem prepares the next screen of the summary. Each destination has
+// two screens, the address and the total; elemPart identifies which one is
+// being viewed. The miner fee total follows the last destination, and the
+// signing keys follow the fee.
+static void fmtBatchElem(void) {
+    if (ctx->displayIndex > ctx->destCount) {
+        fmtBatchKey(ctx->fullStr[0], ctx->displayIndex - ctx->destCount - 1);
+        ctx->displayIndex++;
+        return;
+    } else if (ctx->displayIndex == ctx->destCount) {
+        memmove(ctx->labelStr, "Total Miner Fee", 16);
+        fmtBatchAmount(ctx->fullStr[0], NULL);
+        ctx->displayIndex++;
+        return;
+    }
+
+    fmtBatchLabel();
+    if (ctx->elemPart == 0) {
+        format_address(ctx->fullStr[0], ctx->dests[ctx->displayIndex].addr);
+        ctx->elemPart++;
+    } else {
+        fmtBatchAmount(ctx->fullStr[0], &ctx->dests[ctx->displayIndex]);
+        ctx->elemPart = 0;
+        ctx->displayIndex++;
+    }
+}
+
+static unsigned int ui_batch_elem_button(void) {
+    if (ctx->displayIndex > ctx->destCount + keyScreens()) {
+        // Every destination, the fee total, and the keys have been
+        // displayed; prepare and display the approval screen.
+        memmove(ctx->fullStr[0], "of ", 3);
+        const int n = bin2dec(ctx->fullStr[0] + 3, ctx->txnCount);
+        memmove(ctx->fullStr[0] + 3 + n, " txns?", 7);
+        ux_flow_init(0, ux_approve_batch_flow, NULL);
+        return 0;
+    }
+
+    fmtBatchElem();
+    ux_flow_init(0, ux_batch_elem_flow, NULL);
+    return 0;
+}
+
+static void begin_summary(void) {
+    ctx->displayIndex = 0;
+    ctx->elemPart = 0;
+    ui_batch_elem_button();
+}
+
+#else
+
+static nbgl_layoutTagValue_t pairs[2];
+
+static void confirm_callback(bool confirm) {
+    uiBusy = false;
+    if (confirm) {
+        io_seproxyhal_touch_batch_ok();
+    } else {
+        zero_ctx();
+        io_send_sw(SW_USER_REJECTED);
+        nbgl_useCaseReviewStatus(STATUS_TYPE_TRANSACTION_REJECTED, ui_idle);
+    }
+}
+
+static bool nav_callback(uint8_t page, nbgl_pageContent_t *content) {
+    ctx->displayIndex = page;
+    if (ctx->displayIndex > ctx->destCount + keyScreens()) {
+        content->type = INFO_LONG_PRESS;
+        content->infoLongPress.icon = &C_stax_app_sia_big;
+        memmove(ctx->fullStr[0], "Sign ", 5);
+        const int n = bin2dec(ctx->fullStr[0] + 5, ctx->txnCount);
+        memmove(ctx->fullStr[0] + 5 + n, " transactions", 14);
+        content->infoLongPress.text = ctx->fullStr[0];
+        content->infoLongPress.longPressText = "Hold to sign";
+        return true;
+    }
+
+    if (ctx->displayIndex > ctx->destCount) {
+        fmtBatchKey(ctx->fullStr[0], ctx->displayIndex - ctx->destCount - 1);
+        pairs[0].item = "Sign with";
+        pairs[0].value = ctx->fullStr[0];
+
+        content->tagValueList.nbPairs = 1;
+    } else if (ctx->displayIndex == ctx->destCount) {
+        memmove(ctx->labelStr, "Total Miner Fee", 16);
+        fmtBatchAmount(ctx->fullStr[0], NULL);
+        pairs[0].item = "Amount (SC)";
+        pairs[0].value = ctx->fullStr[0];
+
+        content->tagValueList.nbPairs = 1;
+    } else {
+        batchDest_t *dest = &ctx->dests[ctx->displayIndex];
+        fmtBatchLabel();
+        format_address(ctx->fullStr[0], dest->addr);
+        fmtBatchAmount(ctx->fullStr[1], dest);
+        pairs[0].item = "To";
+        pairs[0].value = ctx->fullStr[0];
+        if (dest->elemType == TXN_ELEM_SC_OUTPUT) {
+            pairs[1].item = "Total (SC)";
+        } else {
+            pairs[1].item = "Total (SF)";
+        }
+        pairs[1].value = ctx->fullStr[1];
+
+        content->tagValueList.nbPairs = 2;
+    }
+
+    content->title = ctx->labelStr;
+    content->type = TAG_VALUE_LIST;
+    content->tagValueList.pairs = &pairs[0];
+    content->tagValueList.callback = NULL;
+
+    content->tagValueList.startIndex = 0;
+    content->tagValueList.wrapping = false;
+    content->tagValueList.smallCaseForValue = false;
+    content->tagValueList.nbMaxLinesForValue = 0;
+
+    return true;
+}
+
+static void begin_review(void) {
+    // one page per destination, plus the fee total, the keys, and the
+    // approval page
+    nbgl_useCaseRegularReview(0,
+                              ctx->destCount + keyScreens() + 2,
+                              "Cancel",
+                              NULL,
+                              nav_callback,
+                              confirm_callback);
+}
+
+static void cancel_review(void) {
+    confirm_callback(false);
+}
+
+static void begin_summary(void) {
+    const int n = bin2dec(ctx->labelStr, ctx->txnCount);
+    memmove(ctx->labelStr + n, " transactions", 14);
+    nbgl_useCaseReviewStart(&C_stax_app_sia_big,
+                            "Sign Batch",
+                            ctx->labelStr,
+                            "Cancel",
+                            begin_review,
+                            cancel_review);
+}
+
+#endif
+
+// add_txn folds the elements of the most recently decoded transaction into
+// the batch totals and stores its SigHash. It returns false if the totals
+// would overflow, if the batch has too many distinct destinations, or if the
+// transaction contains file contracts, which cannot be summarized this way.
+static bool add_txn(void) {
+    txn_state_t *txn = &ctx->txn;
+    for (uint16_t i = 0; i < txn->elementIndex; i++) {
+        txn_elem_t *elem = &txn->elements[i];
+        if (elem->elemType == TXN_ELEM_FC || elem->elemType == TXN_ELEM_FCR) {
+            return false;
+        } else if (elem->elemType == TXN_ELEM_MINER_FEE) {
+            if (!cur_add(ctx->fee, elem->outVal)) {
+                return false;
+            }
+            continue;
+        }
+
+        // find the destination, adding it if this is the first output to it
+        uint8_t j = 0;
+        while (j < ctx->destCount && (ctx->dests[j].elemType != elem->elemType ||
+                                      memcmp(ctx->dests[j].addr, elem->outAddr, 32) != 0)) {
+            j++;
+        }
+        if (j == ctx->destCount) {
+            if (ctx->destCount == MAX_BATCH_DESTS) {
+                return false;
+            }
+            ctx->dests[j].elemType = elem->elemType;
+            memmove(ctx->dests[j].addr, elem->outAddr, 32);
+            ctx->destCount++;
+        }
+        if (!cur_add(ctx->dests[j].total, elem->outVal)) {
+            return false;
+        }
+    }
+
+    memmove(ctx->txns[ctx->txnCount].sigHash, txn->sigHash, sizeof(txn->sigHash));
+    ctx->txnCount++;
+    return true;
+}
+
+// send_signature signs the requested transaction of an approved batch. Once
+// every signature has been sent, the batch is discarded.
+static uint16_t send_signature(const uint8_t *dataBuffer, uint16_t dataLength) {
+    if (!ctx->approved) {
+        zero_ctx();
+        return SW_IMPROPER_INIT;
+    }
+    if (dataLength != 1 || dataBuffer[0] >= ctx->txnCount) {
+        return SW_INVALID_PARAM;
+    }
+    const uint8_t i = dataBuffer[0];
+
+    uint8_t signature[64] = {0};
+    deriveAndSign(signature, ctx->txns[i].keyIndex, ctx->txns[i].sigHash);
+    io_send_response_pointer(signature, sizeof(signature), SW_OK);
+
+    ctx->sigsSent |= (1UL << i);
+    if (ctx->sigsSent == (1UL << ctx->txnCount) - 1) {
+        zero_ctx();
+#ifndef HAVE_BAGL
+        nbgl_useCaseReviewStatus(STATUS_TYPE_TRANSACTION_SIGNED, ui_idle);
+#endif
+    }
+    return 0;
+}
+
+// handleSignTxnBatch reads a sequence of transactions, calculates the SigHash
+// of each, and, once the user has approved the combined totals, signs each
+// hash using the key specified for its transaction.
+uint16_t handleSignTxnBatch(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t dataLength) {
+    if (p2 != 0) {
+        return SW_INVALID_PARAM;
+    }
+
+    switch (p1) {
+        case P1_FIRST:
+            // As in calcTxnHash, a transaction must not begin while another
+            // is still being decoded; otherwise, an attacker could fool the
+            // user by concatenating two transactions. Likewise, no
+            // transactions may be added once the batch has been reviewed.
+            if (ctx->txnInitialized || ctx->approved) {
+                zero_ctx();
+                return SW_IMPROPER_INIT;
+            }
+            if (!ctx->initialized) {
+                zero_ctx();
+                ctx->initialized = true;
+            }
+            if (ctx->txnCount == MAX_BATCH_TXNS || dataLength < 10) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            ctx->txnInitialized = true;
+
+            // The first packet of each transaction includes the key index,
+            // sig index, and change index, exactly as in calcTxnHash.
+            ctx->txns[ctx->txnCount].keyIndex = U4LE(dataBuffer, 0);
+            uint16_t sigIndex = U2LE(dataBuffer, 4);
+            uint32_t changeIndex = U4LE(dataBuffer, 6);
+            dataBuffer += 10;
+            dataLength -= 10;
+            txn_init(&ctx->txn, sigIndex, changeIndex);
+            break;
+
+        case P1_MORE:
+            if (!ctx->txnInitialized) {
+                zero_ctx();
+                return SW_IMPROPER_INIT;
+            }
+            break;
+
+        case P1_BATCH_REVIEW:
+            // The summary may only be displayed once, after at least one
+            // transaction has been fully decoded.
+            if (!ctx->initialized || ctx->txnInitialized || ctx->approved ||
+                ctx->txnCount == 0) {
+                zero_ctx();
+                return SW_IMPROPER_INIT;
+            }
+            uiBusy = true;
+            begin_summary();
+            return 0;
+
+        case P1_BATCH_SIG:
+            return send_signature(dataBuffer, dataLength);
+
+        default:
+            return SW_INVALID_PARAM;
+    }
+
+    // Add the new data to the transaction decoder.
+    txn_update(&ctx->txn, dataBuffer, dataLength);
+
+    switch (txn_parse(&ctx->txn)) {
+        case TXN_STATE_ERR:
+            // don't leave state lingering
+            zero_ctx();
+            return SW_INVALID_PARAM;
+        case TXN_STATE_PARTIAL:
+            return SW_OK;
+        case TXN_STATE_FINISHED:
+            // Nothing is displayed until the whole batch has been received.
+            ctx->txnInitialized = false;
+            if (!add_txn()) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            return SW_OK;
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+// This file implements the optional stack profiler, enabled by building with
+// STACK_PROFILE=1. Before each command, the unused portion of the stack is
+// painted with a known pattern; afterwards, the first word that no longer
+// holds the pattern marks the deepest point the command reached. The same is
+// done for the UX callbacks (and the SDK event loop) that run while the app
+// waits for the next command. The results are reported by the
+// GET_STACK_USAGE command.
+
+#ifdef HAVE_STACK_PROFILE
+
+#include <io.h>
+#include <os.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sia.h"
+#include "stack.h"
+
+// These are defined by the SDK's linker script. The stack grows down from
+// _estack towards _stack, and the canary occupies the lowest word.
+extern uint32_t _stack;
+extern uint32_t _estack;
+extern uint32_t app_stack_canary;
+
+#define STACK_PAINT_WORD 0xA5A5A5A5
+
+// leave some room below the current frame of stack_paint
+#define STACK_PAINT_MARGIN 16
+
+#define MAX_PROFILED_COMMANDS 16
+
+typedef struct {
+    uint8_t ins;
+    uint16_t handlerMax;  // deepest use by the command handler, in bytes
+    uint16_t uxMax;       // deepest use by UX callbacks, in bytes
+} stackProfile_t;
+
+static stackProfile_t profiles[MAX_PROFILED_COMMANDS];
+static uint8_t numProfiles;
+
+static uint32_t *stack_bottom(void) {
+    uint32_t *bottom = &_stack;
+    if (&app_stack_canary >= bottom && &app_stack_canary < &_estack) {
+        bottom = &app_stack_canary + 1;
+    }
+    return bottom;
+}
+
+void __attribute__((noinline)) stack_paint(void) {
+    volatile uint32_t marker;
+    uint32_t *end = (uint32_t *) &marker - STACK_PAINT_MARGIN;
+    for (uint32_t *p = stack_bottom(); p < end; p++) {
+        *p = STACK_PAINT_WORD;
+    }
+}
+
+static uint16_t stack_used(void) {
+    uint32_t *p = stack_bottom();
+    while (p < &_estack && *p == STACK_PAINT_WORD) {
+        p++;
+    }
+    return (uint16_t) ((uint8_t *) &_estack - (uint8_t *) p);
+}
+
+void stack_record(uint8_t ins, bool ux) {
+    uint8_t i = 0;
+    while (i < numProfiles && profiles[i].ins != ins) {
+        i++;
+    }
+    if (i == numProfiles) {
+        if (numProfiles == MAX_PROFILED_COMMANDS) {
+            return;
+        }
+        profiles[numProfiles].ins = ins;
+        numProfiles++;
+    }
+
+    const uint16_t used = stack_used();
+    uint16_t *max = ux ? &profiles[i].uxMax : &profiles[i].handlerMax;
+    if (used > *max) {
+        *max = used;
+    }
+}
+
+// handleGetStackUsage reports the stack size and the deepest stack use seen
+// so far for each command. If P1 is 0x01, the measurements are then cleared.
+uint16_t handleGetStackUsage(uint8_t p1,
+                             uint8_t p2 __attribute__((unused)),
+                             uint8_t *dataBuffer __attribute__((unused)),
+                             uint16_t dataLength __attribute__((unused))) {
+    if (p1 > 0x01) {
+        return SW_INVALID_PARAM;
+    }
+
+    uint8_t resp[2 + MAX_PROFILED_COMMANDS * 5];
+    uint16_t n = 0;
+    const uint16_t size = (uint8_t *) &_estack - (uint8_t *) stack_bottom();
+    resp[n++] = size & 0xFF;
+    resp[n++] = size >> 8;
+    for (uint8_t i = 0; i < numProfiles; i++) {
+        resp[n++] = profiles[i].ins;
+        resp[n++] = profiles[i].handlerMax & 0xFF;
+        resp[n++] = profiles[i].handlerMax >> 8;
+        resp[n++] = profiles[i].uxMax & 0xFF;
+        resp[n++] = profiles[i].uxMax >> 8;
+    }
+    if (p1 == 0x01) {
+        explicit_bzero(profiles, sizeof(profiles));
+        numProfiles = 0;
+    }
+    io_send_response_pointer(resp, n, SW_OK);
+    return 0;
+}
+
+#endif /* HAVE_STACK_PROFILE */
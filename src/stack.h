@@ -0,0 +1,21 @@
+#ifndef STACK_H
+#define STACK_H
+
+#ifdef HAVE_STACK_PROFILE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// stack_paint fills the unused portion of the stack with a known pattern, so
+// that stack_record can later find the deepest point reached.
+void stack_paint(void);
+
+// stack_record records the deepest stack use since the last call to
+// stack_paint, attributing it to the command with the specified INS. If ux is
+// true, the use is attributed to the UX callbacks that ran after the command
+// returned, rather than to the command handler itself.
+void stack_record(uint8_t ins, bool ux);
+
+#endif /* HAVE_STACK_PROFILE */
+
+#endif /* STACK_H */
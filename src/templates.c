@@ -0,0 +1,150 @@
+// This file contains the payout templates that calcTxnHash uses to shorten
+// the review of recurring payouts, and the clearTemplates command.
+//
+// A payout template is saved by calcTxnHash. When the computer asks for a
+// transaction to be signed and saved as a template, the transaction is
+// reviewed in full, as usual; if the user approves it, a digest of its
+// outputs is stored in NVM under a label chosen by the computer. The digest
+// covers the address and value of each siacoin and siafund output, in order,
+// but not the miner fees or change outputs, which typically vary from one
+// payout to the next.
+//
+// From then on, when calcTxnHash is asked to sign a transaction whose outputs
+// have the digest of a stored template, the user is shown only the template's
+// label and the miner fee, and signs after a single confirmation. Any other
+// transaction is reviewed in full. Transactions with file contracts or
+// revisions, and partially-covered transactions, are never matched. The
+// templates can be cleared at any time without a review, since doing so only
+// removes shortcuts.
+//
+// Keep this description in mind as you read through the implementation.
+
+#include <io.h>
+#include <os.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "blake2b.h"
+#include "sia.h"
+#include "sia_ux.h"
+#include "templates.h"
+#include "txn.h"
+
+static const templateTable_t *stored_table(void) {
+    return (const templateTable_t *) &N_storage.templates;
+}
+
+// findTemplate returns the index of the stored template with the given
+// digest, or -1 if there is none.
+static int findTemplate(const uint8_t *digest) {
+    const templateTable_t *table = stored_table();
+    for (uint8_t i = 0; i < table->count; i++) {
+        if (!memcmp(table->entries[i].digest, digest, 32)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint8_t template_read_label(char *label, const uint8_t *buf, uint16_t len) {
+    if (len < 1 || buf[0] == 0 || buf[0] >= TEMPLATE_LABEL_LEN || len < 1 + buf[0]) {
+        return 0;
+    }
+    const uint8_t labelLen = buf[0];
+    for (uint8_t i = 0; i < labelLen; i++) {
+        if (buf[1 + i] < 0x20 || buf[1 + i] > 0x7E) {
+            return 0;
+        }
+    }
+    memset(label, 0, TEMPLATE_LABEL_LEN);
+    memmove(label, buf + 1, labelLen);
+    return 1 + labelLen;
+}
+
+bool template_may_apply(const txn_state_t *txn) {
+    return stored_table()->count > 0 && !txn->partial;
+}
+
+bool template_digest(const txn_state_t *txn, uint8_t digest[static 32], uint8_t fee[static 17]) {
+    if (txn->partial) {
+        return false;
+    }
+    memset(fee, 0, 1 + 16);
+    bool hasOutputs = false;
+    cx_blake2b_t S;
+    blake2b_init(&S);
+    for (uint16_t i = 0; i < txn->elementIndex; i++) {
+        const txn_elem_t *elem = &txn->elements[i];
+        switch (elem->elemType) {
+            case TXN_ELEM_SC_OUTPUT:
+            case TXN_ELEM_SF_OUTPUT:
+                if (elem->outVal[0] > 16) {
+                    return false;
+                }
+                blake2b_update(&S, &elem->elemType, 1);
+                blake2b_update(&S, elem->outAddr, 32);
+                blake2b_update(&S, elem->outVal, 1 + elem->outVal[0]);
+                hasOutputs = true;
+                break;
+            case TXN_ELEM_MINER_FEE:
+                if (!cur_add(fee, elem->outVal)) {
+                    return false;
+                }
+                break;
+            default:
+                // file contracts and revisions always require a full review
+                return false;
+        }
+    }
+    blake2b_final(&S, digest, 32);
+    return hasOutputs;
+}
+
+const char *template_match(const txn_state_t *txn, uint8_t fee[static 17]) {
+    uint8_t digest[32];
+    if (!template_may_apply(txn) || !template_digest(txn, digest, fee)) {
+        return NULL;
+    }
+    const int index = findTemplate(digest);
+    if (index < 0) {
+        return NULL;
+    }
+    return stored_table()->entries[index].label;
+}
+
+bool template_has_room(const uint8_t digest[static 32]) {
+    return findTemplate(digest) >= 0 || stored_table()->count < MAX_TEMPLATES;
+}
+
+void template_store(const uint8_t digest[static 32], const char *label) {
+    const templateTable_t *table = stored_table();
+    const int index = findTemplate(digest);
+    if (index >= 0) {
+        nvm_write((void *) table->entries[index].label, (void *) label, TEMPLATE_LABEL_LEN);
+        return;
+    }
+    if (table->count >= MAX_TEMPLATES) {
+        return;
+    }
+    payoutTemplate_t entry;
+    memmove(entry.digest, digest, 32);
+    memmove(entry.label, label, TEMPLATE_LABEL_LEN);
+    nvm_write((void *) &table->entries[table->count], &entry, sizeof(payoutTemplate_t));
+    const uint8_t count = table->count + 1;
+    nvm_write((void *) &table->count, (void *) &count, sizeof(count));
+}
+
+// handleClearTemplates removes every payout template from NVM. No review is
+// required.
+uint16_t handleClearTemplates(uint8_t p1,
+                              uint8_t p2,
+                              uint8_t *dataBuffer __attribute__((unused)),
+                              uint16_t dataLength) {
+    if (p1 != 0 || p2 != 0 || dataLength != 0) {
+        return SW_INVALID_PARAM;
+    }
+    const uint8_t count = 0;
+    nvm_write((void *) &N_storage.templates.count, (void *) &count, sizeof(count));
+    return SW_OK;
+}
@@ -0,0 +1,38 @@
+#ifndef TEMPLATES_H
+#define TEMPLATES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "txn.h"
+
+// template_read_label reads a label, sent as a length byte followed by that
+// many bytes of printable ASCII, into label, which must hold
+// TEMPLATE_LABEL_LEN bytes. It returns the number of bytes read, or 0 if the
+// label is invalid.
+uint8_t template_read_label(char *label, const uint8_t *buf, uint16_t len);
+
+// template_may_apply reports whether a stored template could match the
+// transaction, before any of its elements are known.
+bool template_may_apply(const txn_state_t *txn);
+
+// template_digest computes the digest of the outputs of a fully-decoded
+// transaction, and writes the total of its miner fees to fee. It returns false
+// if the transaction cannot be saved as a template.
+bool template_digest(const txn_state_t *txn, uint8_t digest[static 32], uint8_t fee[static 17]);
+
+// template_match returns the label of the stored template whose outputs are
+// those of a fully-decoded transaction, or NULL if there is none. If there is
+// a match, the total of its miner fees is written to fee.
+const char *template_match(const txn_state_t *txn, uint8_t fee[static 17]);
+
+// template_has_room reports whether a template with the given digest can be
+// stored, either because it replaces one already stored or because the table
+// is not full.
+bool template_has_room(const uint8_t digest[static 32]);
+
+// template_store saves the template in NVM. If a template with the same
+// digest is already stored, it is given the new label.
+void template_store(const uint8_t digest[static 32], const char *label);
+
+#endif /* TEMPLATES_H */
@@ -0,0 +1,338 @@
+// This file contains the implementation of the addTrusted command, and the
+// lookup that calcTxnHash uses to display outputs sent to trusted addresses.
+//
+// A high-level description of addTrusted is as follows. The computer sends a
+// few unlock hashes, each with a short label, spanning one or more packets.
+// It then requests a review, and the user is shown every label alongside its
+// address. If they approve, the addresses are merged into the table of
+// trusted addresses in NVM; an address that is already trusted is given the
+// new label. Adding a few addresses at a time keeps each review short, and
+// keeps the pending addresses within the command's RAM.
+//
+// From then on, when calcTxnHash displays a siacoin output sent to a trusted
+// address, it shows the address's label instead of its 76 hex characters.
+// The table is kept sorted by unlock hash, so each output costs a binary
+// search. The table can be cleared at any time without a review, since doing
+// so only removes labels.
+//
+// Keep this description in mind as you read through the implementation.
+
+#include <io.h>
+#include <os.h>
+#include <os_io_seproxyhal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ux.h>
+
+#include "sia.h"
+#include "sia_ux.h"
+#include "trusted.h"
+#include "txn.h"
+
+// These are APDU parameters that control the behavior of the addTrusted
+// command. The addresses are sent with P1_FIRST and P1_MORE.
+#define P1_TRUSTED_REVIEW 0x01  // display the pending addresses for approval
+#define P1_TRUSTED_CLEAR  0x02  // remove every trusted address
+
+static addTrustedContext_t *ctx = &global.addTrustedContext;
+
+static void zero_ctx(void) {
+    explicit_bzero(ctx, sizeof(addTrustedContext_t));
+}
+
+static const trustedTable_t *stored_table(void) {
+    return (const trustedTable_t *) &N_storage.trusted;
+}
+
+// findEntry searches the n sorted entries for addr. It returns true if addr
+// is found, and stores in index the position at which addr is, or would be
+// inserted.
+static bool findEntry(const trustedAddr_t *entries,
+                      uint16_t n,
+                      const uint8_t *addr,
+                      uint16_t *index) {
+    uint16_t lo = 0, hi = n;
+    while (lo < hi) {
+        const uint16_t mid = lo + (hi - lo) / 2;
+        const int c = memcmp(entries[mid].addr, addr, 32);
+        if (c == 0) {
+            *index = mid;
+            return true;
+        } else if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *index = lo;
+    return false;
+}
+
+const char *trusted_label(const uint8_t addr[static 32]) {
+    const trustedTable_t *table = stored_table();
+    uint16_t index;
+    if (!findEntry(table->entries, table->count, addr, &index)) {
+        return NULL;
+    }
+    return table->entries[index].label;
+}
+
+// countNew returns the number of pending addresses that are not yet trusted.
+static uint16_t countNew(void) {
+    const trustedTable_t *table = stored_table();
+    uint16_t n = 0;
+    for (uint8_t i = 0; i < ctx->pendingCount; i++) {
+        uint16_t index;
+        if (!findEntry(table->entries, table->count, ctx->pending[i].addr, &index)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// storePending merges the pending addresses into the table in NVM. Labels of
+// addresses that are already trusted are replaced in place; the remaining
+// addresses are merged in from the end of the table, so that each entry is
+// written at most once.
+static void storePending(void) {
+    const trustedTable_t *table = stored_table();
+    uint8_t added = 0;
+    for (uint8_t i = 0; i < ctx->pendingCount; i++) {
+        uint16_t index;
+        if (findEntry(table->entries, table->count, ctx->pending[i].addr, &index)) {
+            nvm_write((void *) table->entries[index].label,
+                      ctx->pending[i].label,
+                      TRUSTED_LABEL_LEN);
+        } else {
+            ctx->pending[added++] = ctx->pending[i];
+        }
+    }
+
+    const uint16_t count = table->count + added;
+    uint16_t src = table->count;
+    uint16_t dst = count;
+    while (added > 0) {
+        dst--;
+        if (src > 0 && memcmp(table->entries[src - 1].addr, ctx->pending[added - 1].addr, 32) > 0) {
+            // nvm_write cannot copy within NVM, so copy through RAM
+            trustedAddr_t entry = table->entries[src - 1];
+            nvm_write((void *) &table->entries[dst], &entry, sizeof(trustedAddr_t));
+            src--;
+        } else {
+            nvm_write((void *) &table->entries[dst],
+                      &ctx->pending[added - 1],
+                      sizeof(trustedAddr_t));
+            added--;
+        }
+    }
+    nvm_write((void *) &table->count, (void *) &count, sizeof(count));
+}
+
+// fmtTrustedItem prepares the specified pending address for display. It
+// stores its label in labelStr, and the address in fullStr.
+static void fmtTrustedItem(uint8_t index) {
+    memmove(ctx->labelStr, ctx->pending[index].label, TRUSTED_LABEL_LEN);
+    format_address(ctx->fullStr, ctx->pending[index].addr);
+}
+
+static unsigned int io_seproxyhal_touch_trusted_ok(void) {
+    storePending();
+    zero_ctx();
+    io_send_sw(SW_OK);
+#ifdef HAVE_BAGL
+    ui_idle();
+#else
+    nbgl_useCaseStatus("ADDRESSES TRUSTED", true, ui_idle);
+#endif
+    return 0;
+}
+
+static unsigned int io_seproxyhal_touch_trusted_reject(void) {
+    zero_ctx();
+    return io_reject();
+}
+
+#ifdef HAVE_BAGL
+static unsigned int ui_trusted_item_button(void);
+
+UX_STEP_CB(ux_trusted_item_1_step,
+           bnnn_paging,
+           ui_trusted_item_button(),
+           {global.addTrustedContext.labelStr, global.addTrustedContext.fullStr});
+
+// Each address is shown on the same screen, one after another.
+UX_FLOW(ux_trusted_item_flow, &ux_trusted_item_1_step);
+
+UX_STEP_NOCB(ux_trusted_approve_flow_1_step, nn, {"Trust these", "addresses?"});
+
+UX_STEP_VALID(ux_trusted_approve_flow_2_step,
+              pb,
+              io_seproxyhal_touch_trusted_ok(),
+              {&C_icon_validate_14, "Approve"});
+
+UX_STEP_VALID(ux_trusted_approve_flow_3_step,
+              pb,
+              io_seproxyhal_touch_trusted_reject(),
+              {&C_icon_crossmark, "Reject"});
+
+// Flow for approving the addresses:
+// #1 screen: "Trust these addresses?"
+// #2 screen: approve
+// #3 screen: reject
+UX_FLOW(ux_trusted_approve_flow,
+        &ux_trusted_approve_flow_1_step,
+        &ux_trusted_approve_flow_2_step,
+        &ux_trusted_approve_flow_3_step);
+
+static unsigned int ui_trusted_item_button(void) {
+    ctx->displayIndex++;
+    if (ctx->displayIndex == ctx->pendingCount) {
+        ux_flow_init(0, ux_trusted_approve_flow, NULL);
+    } else {
+        fmtTrustedItem(ctx->displayIndex);
+        ux_flow_init(0, ux_trusted_item_flow, NULL);
+    }
+    return 0;
+}
+
+static void begin_review(void) {
+    ctx->displayIndex = 0;
+    fmtTrustedItem(0);
+    ux_flow_init(0, ux_trusted_item_flow, NULL);
+}
+
+#else
+
+static nbgl_layoutTagValue_t pair;
+
+static void confirm_callback(bool confirm) {
+    uiBusy = false;
+    if (confirm) {
+        io_seproxyhal_touch_trusted_ok();
+    } else {
+        zero_ctx();
+        io_send_sw(SW_USER_REJECTED);
+        nbgl_useCaseStatus("Addresses rejected", false, ui_idle);
+    }
+}
+
+static bool nav_callback(uint8_t page, nbgl_pageContent_t *content) {
+    if (page >= ctx->pendingCount) {
+        content->type = INFO_LONG_PRESS;
+        content->infoLongPress.icon = &C_stax_app_sia_big;
+        content->infoLongPress.text = "Trust these addresses";
+        content->infoLongPress.longPressText = "Hold to approve";
+        return true;
+    }
+
+    fmtTrustedItem(page);
+    pair.item = ctx->labelStr;
+    pair.value = ctx->fullStr;
+
+    content->type = TAG_VALUE_LIST;
+    content->tagValueList.nbPairs = 1;
+    content->tagValueList.pairs = &pair;
+    content->tagValueList.callback = NULL;
+    content->tagValueList.startIndex = 0;
+    content->tagValueList.wrapping = false;
+    content->tagValueList.smallCaseForValue = false;
+    content->tagValueList.nbMaxLinesForValue = 0;
+    return true;
+}
+
+static void begin_review(void) {
+    nbgl_useCaseRegularReview(0,
+                              ctx->pendingCount + 1,
+                              "Reject",
+                              NULL,
+                              nav_callback,
+                              confirm_callback);
+}
+
+#endif
+
+// addEntries adds addresses to the pending set, keeping it sorted. Each
+// address is an unlock hash, followed by a length byte and that many bytes of
+// label. An address must not span packets, and must not be sent twice.
+static bool addEntries(uint8_t *buf, uint16_t len) {
+    while (len > 0) {
+        if (len < 33 || buf[32] == 0 || buf[32] >= TRUSTED_LABEL_LEN || len < 33 + buf[32] ||
+            ctx->pendingCount == MAX_TRUSTED_PENDING) {
+            return false;
+        }
+        const uint8_t labelLen = buf[32];
+        for (uint8_t i = 0; i < labelLen; i++) {
+            if (buf[33 + i] < 0x20 || buf[33 + i] > 0x7E) {
+                return false;
+            }
+        }
+        uint16_t index;
+        if (findEntry(ctx->pending, ctx->pendingCount, buf, &index)) {
+            return false;
+        }
+        memmove(&ctx->pending[index + 1],
+                &ctx->pending[index],
+                (ctx->pendingCount - index) * sizeof(trustedAddr_t));
+        explicit_bzero(&ctx->pending[index], sizeof(trustedAddr_t));
+        memmove(ctx->pending[index].addr, buf, 32);
+        memmove(ctx->pending[index].label, buf + 33, labelLen);
+        ctx->pendingCount++;
+
+        buf += 33 + labelLen;
+        len -= 33 + labelLen;
+    }
+    return true;
+}
+
+// handleAddTrusted reads a set of labelled addresses and, once the user has
+// approved them, adds them to the trusted addresses in NVM.
+uint16_t handleAddTrusted(uint8_t p1, uint8_t p2, uint8_t *dataBuffer, uint16_t dataLength) {
+    if (p2 != 0) {
+        return SW_INVALID_PARAM;
+    }
+
+    switch (p1) {
+        case P1_FIRST:
+            zero_ctx();
+            if (!addEntries(dataBuffer, dataLength)) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            ctx->initialized = true;
+            return SW_OK;
+
+        case P1_MORE:
+            if (!ctx->initialized) {
+                zero_ctx();
+                return SW_IMPROPER_INIT;
+            } else if (!addEntries(dataBuffer, dataLength)) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            return SW_OK;
+
+        case P1_TRUSTED_REVIEW:
+            if (!ctx->initialized || ctx->pendingCount == 0) {
+                zero_ctx();
+                return SW_IMPROPER_INIT;
+            } else if (stored_table()->count + countNew() > MAX_TRUSTED_ADDRS) {
+                zero_ctx();
+                return SW_INVALID_PARAM;
+            }
+            // No more addresses may be added once the review has begun.
+            ctx->initialized = false;
+            uiBusy = true;
+            begin_review();
+            return 0;
+
+        case P1_TRUSTED_CLEAR: {
+            const uint16_t count = 0;
+            nvm_write((void *) &N_storage.trusted.count, (void *) &count, sizeof(count));
+            return SW_OK;
+        }
+
+        default:
+            return SW_INVALID_PARAM;
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef TRUSTED_H
+#define TRUSTED_H
+
+#include <stdint.h>
+
+// trusted_label returns the label of the trusted address addr, or NULL if
+// addr is not trusted.
+const char *trusted_label(const uint8_t addr[static 32]);
+
+#endif /* TRUSTED_H */
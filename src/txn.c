@@ -5,6 +5,13 @@
 
 #include "sia.h"  // For SW_DEVELOPER_ERR. Should be removed.
 
+#ifdef HAVE_DECODE_PROFILE
+txn_profile_t txn_profile;
+#define PROFILE(field, n) (txn_profile.field += (n))
+#else
+#define PROFILE(field, n) ((void) 0)
+#endif
+
 static void divWW10(uint64_t u1, uint64_t u0, uint64_t *q, uint64_t *r) {
     const uint64_t s = 60ULL;
     const uint64_t v = 11529215046068469760ULL;
@@ -109,10 +116,60 @@ int cur2dec(char *out, uint8_t *cur) {
     return sizeof(buf) - i - 1;
 }
 
+// cur_expand converts a Sia-encoded currency value to a 16-byte big-endian
+// integer.
+static void cur_expand(uint8_t out[static 16], const uint8_t *cur) {
+    memset(out, 0, 16);
+    memmove(out + 16 - cur[0], cur + 1, cur[0]);
+}
+
+bool cur_add(uint8_t *dst, const uint8_t *src) {
+    if (dst[0] > 16 || src[0] > 16) {
+        return false;
+    }
+    uint8_t a[16];
+    uint8_t b[16];
+    cur_expand(a, dst);
+    cur_expand(b, src);
+
+    // add right-to-left, propagating the carry
+    uint16_t carry = 0;
+    for (int i = 15; i >= 0; i--) {
+        carry += a[i] + b[i];
+        a[i] = carry & 0xFF;
+        carry >>= 8;
+    }
+    if (carry != 0) {
+        return false;
+    }
+
+    // re-encode, omitting leading zeros as the Sia encoding does
+    uint8_t zeros = 0;
+    while (zeros < 16 && a[zeros] == 0) {
+        zeros++;
+    }
+    dst[0] = 16 - zeros;
+    memmove(dst + 1, a + zeros, dst[0]);
+    return true;
+}
+
+int cur_cmp(const uint8_t *a, const uint8_t *b) {
+    if (a[0] > 16 || b[0] > 16) {
+        return (a[0] > 16) - (b[0] > 16);
+    }
+    uint8_t x[16];
+    uint8_t y[16];
+    cur_expand(x, a);
+    cur_expand(y, b);
+    const int c = memcmp(x, y, sizeof(x));
+    return (c > 0) - (c < 0);
+}
+
 static void need_at_least(txn_state_t *txn, uint64_t n) {
     if ((txn->buflen - txn->pos) < n) {
         THROW(TXN_STATE_PARTIAL);
     }
+    PROFILE(readBytes, n);
 }
 
 static void seek(txn_state_t *txn, uint64_t n) {
@@ -120,20 +177,64 @@ static void seek(txn_state_t *txn, uint64_t n) {
     txn->pos += n;
 }
 
-static void advance(txn_state_t *txn) {
-    // if elem is covered, add it to the hash
-    if (txn->elements[txn->elementIndex].elemType != TXN_ELEM_TXN_SIG) {
-        blake2b_update(&txn->blake, txn->buf, txn->pos);
-    } else if (txn->sliceIndex == txn->sigIndex && txn->pos >= 48) {
-        // add just the ParentID, Timelock, and PublicKeyIndex
-        blake2b_update(&txn->blake, txn->buf, 48);
+// covered reports whether the element being decoded is covered by the TxnSig.
+static bool covered(const txn_state_t *txn) {
+    const uint8_t elemType = txn->elements[txn->elementIndex].elemType;
+    if (!txn->partial) {
+        return elemType != TXN_ELEM_TXN_SIG;
     }
+    return txn->coveredPos < txn->coveredLen &&
+           txn->covered[txn->coveredPos] == COVERED_ELEM(elemType, txn->sliceIndex);
+}
 
+// consume removes the decoded bytes from the buffer, first adding n of them to
+// the hash. All of them are added to the ID hash, unless they belong to the
+// TransactionSignatures.
+static void consume(txn_state_t *txn, uint16_t n) {
+    if (n > 0) {
+        blake2b_update(&txn->blake, txn->buf, n);
+        PROFILE(hashedBytes, n);
+        PROFILE(hashCalls, 1);
+    }
+#ifndef TARGET_NANOS
+    if (txn->computeID && txn->pos > 0 &&
+        txn->elements[txn->elementIndex].elemType != TXN_ELEM_TXN_SIG) {
+        blake2b_update(&txn->idBlake, txn->buf, txn->pos);
+        PROFILE(hashedBytes, txn->pos);
+        PROFILE(hashCalls, 1);
+    }
+#endif
     txn->buflen -= txn->pos;
+    PROFILE(movedBytes, txn->buflen);
     memmove(txn->buf, txn->buf + txn->pos, txn->buflen);
     txn->pos = 0;
 }
 
+// flush consumes the decoded part of the current element. Elements that may
+// not fit in the buffer are decoded in stages, flushing each one.
+static void flush(txn_state_t *txn) {
+    if (covered(txn)) {
+        consume(txn, txn->pos);
+    } else if (!txn->partial &&
+               txn->elements[txn->elementIndex].elemType == TXN_ELEM_TXN_SIG &&
+               txn->sliceIndex == txn->sigIndex && txn->pos >= 48) {
+        // add just the ParentID, Timelock, and PublicKeyIndex
+        consume(txn, 48);
+    } else {
+        consume(txn, 0);
+    }
+}
+
+// advance flushes the final part of the current element.
+static void advance(txn_state_t *txn) {
+    const bool wasCovered = txn->partial && covered(txn);
+    flush(txn);
+    if (wasCovered) {
+        txn->coveredPos++;
+    }
+    txn->elemStage = 0;
+}
+
 static uint64_t readInt(txn_state_t *txn) {
     need_at_least(txn, 8);
     uint64_t u = U8LE(txn->buf, txn->pos);
@@ -178,17 +279,37 @@ static void readUnlockConditions(txn_state_t *txn) {
 }
 
 static void readCoveredFields(txn_state_t *txn) {
+    // only the CoveredFields of the TxnSig being computed are checked
+    const bool check = (txn->sliceIndex == txn->sigIndex);
+
     need_at_least(txn, 1);
-    // for now, we require WholeTransaction = true
-    if (txn->buf[txn->pos] != 1) {
+    const uint8_t wholeTransaction = txn->buf[txn->pos];
+    if (check && wholeTransaction != !txn->partial) {
         THROW(TXN_STATE_ERR);
     }
     seek(txn, 1);
-    // all other fields must be empty
-    for (int i = 0; i < 10; i++) {
-        if (readInt(txn) != 0) {
+
+    // If the whole transaction is covered, all other fields must be empty.
+    // Otherwise, they must match the covered elements declared in advance.
+    uint8_t pos = 0;
+    for (uint8_t elemType = TXN_ELEM_SC_INPUT; elemType <= TXN_ELEM_TXN_SIG; elemType++) {
+        uint64_t n = readInt(txn);
+        if (check && !txn->partial && n != 0) {
             THROW(TXN_STATE_ERR);
         }
+        while (n-- > 0) {
+            const uint64_t index = readInt(txn);
+            if (check) {
+                if (pos == txn->coveredLen || index > COVERED_MAX_INDEX ||
+                    txn->covered[pos] != COVERED_ELEM(elemType, index)) {
+                    THROW(TXN_STATE_ERR);
+                }
+                pos++;
+            }
+        }
+    }
+    if (check && pos != txn->coveredLen) {
+        THROW(TXN_STATE_ERR);
     }
 }
 
@@ -198,6 +319,223 @@ static void addReplayProtection(cx_blake2b_t *S) {
     // recompile the app with a different replayPrefix.
     static uint8_t const replayPrefix[] = {1};
     blake2b_update(S, replayPrefix, 1);
+    PROFILE(hashedBytes, 1);
+    PROFILE(hashCalls, 1);
+}
+
+// Each element type is described by a table of its fields, which are decoded
+// by a single loop. A field is a kind, optionally combined with a flag saying
+// where its value should be stored for display.
+enum {
+    FIELD_END = 0,
+    FIELD_HASH,
+    FIELD_INT,
+    FIELD_CURRENCY,
+    FIELD_BYTES,    // length-prefixed
+    FIELD_SEGMENT,  // 64 bytes
+    FIELD_UNLOCK_CONDITIONS,
+    FIELD_COVERED_FIELDS,
+    FIELD_OUTPUTS,  // nested slice of SiacoinOutputs
+    FIELD_HASHES,   // nested slice of hashes
+};
+#define FIELD_KIND(f)  ((f) & 0x0F)
+#define STORE_VAL      0x10  // store in outVal
+#define STORE_ADDR     0x20  // store in outAddr
+#define STORE_REVISION 0x40  // store in fcr.revisionNumber
+#define STORE_PAYOUTS  0x80  // store the first two values in fcr.renterPayout/hostPayout
+
+#define ELEM_DISPLAY 0x01  // shown to the user
+#define ELEM_CHANGE  0x02  // hidden if sent to the change address
+#define ELEM_REPLAY  0x04  // preceded by the replay prefix in the hash
+#define ELEM_EMPTY   0x08  // not supported; the slice must be empty
+
+#define MAX_FIELDS 11
+
+typedef struct {
+    uint8_t flags;
+    uint8_t fields[MAX_FIELDS];  // terminated by FIELD_END
+} elemSchema_t;
+
+static const elemSchema_t schema[] = {
+    [TXN_ELEM_SC_INPUT] = {ELEM_REPLAY,
+                           {
+                               FIELD_HASH,               // ParentID
+                               FIELD_UNLOCK_CONDITIONS,  // UnlockConditions
+                           }},
+    [TXN_ELEM_SC_OUTPUT] = {ELEM_DISPLAY | ELEM_CHANGE,
+                            {
+                                FIELD_CURRENCY | STORE_VAL,  // Value
+                                FIELD_HASH | STORE_ADDR,     // UnlockHash
+                            }},
+    [TXN_ELEM_FC] = {ELEM_DISPLAY,
+                     {
+                         FIELD_INT,                   // Filesize
+                         FIELD_HASH,                  // FileMerkleRoot
+                         FIELD_INT,                   // WindowStart
+                         FIELD_INT,                   // WindowEnd
+                         FIELD_CURRENCY | STORE_VAL,  // Payout
+                         FIELD_OUTPUTS,               // ValidProofOutputs
+                         FIELD_OUTPUTS,               // MissedProofOutputs
+                         FIELD_HASH,                  // UnlockHash
+                         FIELD_INT,                   // RevisionNumber
+                     }},
+    [TXN_ELEM_FCR] = {ELEM_DISPLAY,
+                      {
+                          FIELD_HASH,                     // ParentID
+                          FIELD_UNLOCK_CONDITIONS,        // UnlockConditions
+                          FIELD_INT | STORE_REVISION,     // RevisionNumber
+                          FIELD_INT,                      // Filesize
+                          FIELD_HASH,                     // FileMerkleRoot
+                          FIELD_INT,                      // WindowStart
+                          FIELD_INT,                      // WindowEnd
+                          FIELD_OUTPUTS | STORE_PAYOUTS,  // ValidProofOutputs
+                          FIELD_OUTPUTS,                  // MissedProofOutputs
+                          FIELD_HASH,                     // UnlockHash
+                      }},
+    [TXN_ELEM_SP] = {0,
+                     {
+                         FIELD_HASH,     // ParentID
+                         FIELD_SEGMENT,  // Segment
+                         FIELD_HASHES,   // HashSet
+                     }},
+    [TXN_ELEM_SF_INPUT] = {ELEM_REPLAY,
+                           {
+                               FIELD_HASH,               // ParentID
+                               FIELD_UNLOCK_CONDITIONS,  // UnlockConditions
+                               FIELD_HASH,               // ClaimUnlockHash
+                           }},
+    [TXN_ELEM_SF_OUTPUT] = {ELEM_DISPLAY,
+                            {
+                                FIELD_CURRENCY | STORE_VAL,  // Value
+                                FIELD_HASH | STORE_ADDR,     // UnlockHash
+                                FIELD_CURRENCY,              // ClaimStart
+                            }},
+    [TXN_ELEM_MINER_FEE] = {ELEM_DISPLAY,
+                            {
+                                FIELD_CURRENCY | STORE_VAL,  // Value
+                            }},
+    [TXN_ELEM_ARB_DATA] = {ELEM_EMPTY,
+                           {
+                               FIELD_BYTES,
+                           }},
+    [TXN_ELEM_TXN_SIG] = {0,
+                          {
+                              FIELD_HASH,            // ParentID
+                              FIELD_INT,             // PublicKeyIndex
+                              FIELD_INT,             // Timelock
+                              FIELD_COVERED_FIELDS,  // CoveredFields
+                              FIELD_BYTES,           // Signature
+                          }},
+};
+
+// STAGE_IN_SLICE marks an elemStage at which the length prefix of the nested
+// slice has already been read.
+#define STAGE_IN_SLICE 0x80
+
+// readFields decodes the fields of the current element, starting from
+// elemStage. Nested slices may not fit in the buffer, so the element is
+// flushed before each slice and after each of its entries, and decoding
+// resumes from the most recent flush.
+static void readFields(txn_state_t *txn, const uint8_t *fields) {
+    txn_elem_t *elem = &txn->elements[txn->elementIndex];
+    for (uint8_t i = txn->elemStage & ~STAGE_IN_SLICE; fields[i] != FIELD_END; i++) {
+        const uint8_t field = fields[i];
+        switch (FIELD_KIND(field)) {
+            case FIELD_HASH:
+                readHash(txn, (field & STORE_ADDR) ? (char *) elem->outAddr : NULL);
+                break;
+            case FIELD_INT:
+                if (field & STORE_REVISION) {
+                    need_at_least(txn, 8);
+                    memmove(elem->fcr.revisionNumber, txn->buf + txn->pos, 8);
+                }
+                readInt(txn);
+                break;
+            case FIELD_CURRENCY:
+                readCurrency(txn, (field & STORE_VAL) ? elem->outVal : NULL);
+                break;
+            case FIELD_BYTES:
+                readPrefixedBytes(txn);
+                break;
+            case FIELD_SEGMENT:
+                seek(txn, 64);
+                break;
+            case FIELD_UNLOCK_CONDITIONS:
+                readUnlockConditions(txn);
+                break;
+            case FIELD_COVERED_FIELDS:
+                readCoveredFields(txn);
+                break;
+            case FIELD_OUTPUTS:
+            case FIELD_HASHES:
+                if (txn->elemStage != (i | STAGE_IN_SLICE)) {
+                    txn->subLen = readInt(txn);
+                    txn->subIndex = 0;
+                    flush(txn);
+                    txn->elemStage = i | STAGE_IN_SLICE;
+                }
+                while (txn->subIndex < txn->subLen) {
+                    if (FIELD_KIND(field) == FIELD_HASHES) {
+                        readHash(txn, NULL);
+                    } else {
+                        uint8_t *val = NULL;
+                        if ((field & STORE_PAYOUTS) && txn->subIndex < 2) {
+                            val = (txn->subIndex == 0) ? elem->fcr.renterPayout
+                                                       : elem->fcr.hostPayout;
+                        }
+                        readCurrency(txn, val);  // Value
+                        readHash(txn, NULL);     // UnlockHash
+                    }
+                    flush(txn);
+                    txn->subIndex++;
+                }
+                txn->elemStage = i + 1;
+                break;
+        }
+    }
+}
+
+// deriveChangeAddrs derives the unlock hash of each change key index, keeping
+// them in increasing order.
+static void deriveChangeAddrs(txn_state_t *txn) {
+    uint8_t publicKey[65];
+    for (uint8_t i = 0; i < txn->changeCount; i++) {
+        deriveSiaPublicKey(txn->changeIndex + i, publicKey);
+        uint8_t j = i;
+        pubkeyToSiaUnlockHash(txn->changeAddrs[j], publicKey);
+        // insertion sort
+        while (j > 0 && memcmp(txn->changeAddrs[j - 1], txn->changeAddrs[j], 32) > 0) {
+            uint8_t tmp[32];
+            memmove(tmp, txn->changeAddrs[j], 32);
+            memmove(txn->changeAddrs[j], txn->changeAddrs[j - 1], 32);
+            memmove(txn->changeAddrs[j - 1], tmp, 32);
+            j--;
+        }
+    }
+    txn->changeDerived = true;
+}
+
+// isChange reports whether addr is one of the change addresses, deriving them
+// the first time it is called.
+static bool isChange(txn_state_t *txn, const uint8_t *addr) {
+    if (txn->changeCount == 0) {
+        return false;
+    } else if (!txn->changeDerived) {
+        deriveChangeAddrs(txn);
+    }
+    uint8_t lo = 0, hi = txn->changeCount;
+    while (lo < hi) {
+        const uint8_t mid = (lo + hi) / 2;
+        const int cmp = memcmp(txn->changeAddrs[mid], addr, 32);
+        if (cmp == 0) {
+            return true;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
 }
 
 // throws txnDecoderState_e
@@ -210,16 +548,33 @@ static void __txn_next_elem(txn_state_t *txn) {
     // element type
     while (txn->sliceIndex == txn->sliceLen) {
         if (txn->elements[txn->elementIndex].elemType == TXN_ELEM_TXN_SIG) {
+            // every covered element must have been present
+            if (txn->coveredPos != txn->coveredLen) {
+                THROW(TXN_STATE_ERR);
+            }
             // store final hash
             blake2b_final(&txn->blake, txn->sigHash, sizeof(txn->sigHash));
+#ifndef TARGET_NANOS
+            if (txn->computeID) {
+                blake2b_final(&txn->idBlake, txn->txnID, sizeof(txn->txnID));
+            }
+#endif
             THROW(TXN_STATE_FINISHED);
         }
         // too many elements
         txn->sliceLen = readInt(txn);
         txn->sliceIndex = 0;
         txn->elements[txn->elementIndex].elemType++;
-        advance(txn);
-
+        // slice lengths are only covered when the whole transaction is
+        consume(txn,
+                (!txn->partial && txn->elements[txn->elementIndex].elemType != TXN_ELEM_TXN_SIG)
+                    ? txn->pos
+                    : 0);
+
+        const uint8_t flags = schema[txn->elements[txn->elementIndex].elemType].flags;
+        if ((flags & ELEM_EMPTY) && txn->sliceLen != 0) {
+            THROW(TXN_STATE_ERR);
+        }
         // if we've reached the TransactionSignatures, check that sigIndex is
         // a valid index
         if ((txn->elements[txn->elementIndex].elemType == TXN_ELEM_TXN_SIG) &&
@@ -228,86 +583,30 @@ static void __txn_next_elem(txn_state_t *txn) {
         }
     }
 
-    switch (txn->elements[txn->elementIndex].elemType) {
-        // these elements should be displayed
-        case TXN_ELEM_SC_OUTPUT:
-            readCurrency(txn, txn->elements[txn->elementIndex].outVal);        // Value
-            readHash(txn, (char *) txn->elements[txn->elementIndex].outAddr);  // UnlockHash
-            advance(txn);
-            if (!memcmp(txn->elements[txn->elementIndex].outAddr,
-                        txn->changeAddr,
-                        sizeof(txn->elements[txn->elementIndex].outAddr))) {
-                // do not display the change address or increment displayIndex
-                return;
-            }
-
-            txn->sliceIndex++;
-            txn->elements[txn->elementIndex + 1].elemType =
-                txn->elements[txn->elementIndex].elemType;
-            txn->elementIndex++;
-            return;
-
-        case TXN_ELEM_SF_OUTPUT:
-            readCurrency(txn, txn->elements[txn->elementIndex].outVal);        // Value
-            readHash(txn, (char *) txn->elements[txn->elementIndex].outAddr);  // UnlockHash
-            readCurrency(txn, NULL);                                           // ClaimStart
-            advance(txn);
-
-            txn->sliceIndex++;
-            txn->elements[txn->elementIndex + 1].elemType =
-                txn->elements[txn->elementIndex].elemType;
-            txn->elementIndex++;
-            return;
-
-        case TXN_ELEM_MINER_FEE:
-            readCurrency(txn, txn->elements[txn->elementIndex].outVal);  // Value
-            memmove(txn->elements[txn->elementIndex].outAddr, "[Miner Fee]", 12);
-            advance(txn);
-
-            txn->sliceIndex++;
-            txn->elements[txn->elementIndex + 1].elemType =
-                txn->elements[txn->elementIndex].elemType;
-            txn->elementIndex++;
-            return;
-
-        // these elements should be decoded, but not displayed
-        case TXN_ELEM_SC_INPUT:
-            readHash(txn, NULL);        // ParentID
-            readUnlockConditions(txn);  // UnlockConditions
-            addReplayProtection(&txn->blake);
-            advance(txn);
-            txn->sliceIndex++;
-            return;
-
-        case TXN_ELEM_SF_INPUT:
-            readHash(txn, NULL);        // ParentID
-            readUnlockConditions(txn);  // UnlockConditions
-            readHash(txn, NULL);        // ClaimUnlockHash
-            addReplayProtection(&txn->blake);
-            advance(txn);
-            txn->sliceIndex++;
-            return;
-
-        case TXN_ELEM_TXN_SIG:
-            readHash(txn, NULL);     // ParentID
-            readInt(txn);            // PublicKeyIndex
-            readInt(txn);            // Timelock
-            readCoveredFields(txn);  // CoveredFields
-            readPrefixedBytes(txn);  // Signature
-            advance(txn);
-            txn->sliceIndex++;
-            return;
-
-        // these elements should not be present
-        case TXN_ELEM_FC:
-        case TXN_ELEM_FCR:
-        case TXN_ELEM_SP:
-        case TXN_ELEM_ARB_DATA:
-            if (txn->sliceLen != 0) {
-                THROW(TXN_STATE_ERR);
-            }
-            return;
+    txn_elem_t *elem = &txn->elements[txn->elementIndex];
+    const elemSchema_t *s = &schema[elem->elemType];
+    readFields(txn, s->fields);
+    // advance moves on to the next covered element, so check this one first
+    const bool isCovered = covered(txn);
+    // inputs are never decoded in stages, so the prefix still precedes them
+    // in the hash
+    if ((s->flags & ELEM_REPLAY) && isCovered) {
+        addReplayProtection(&txn->blake);
     }
+    advance(txn);
+    txn->sliceIndex++;
+
+    if (!(s->flags & ELEM_DISPLAY) || txn->hashOnly) {
+        return;
+    } else if (txn->partial && !isCovered) {
+        // a partial signature does not sign the element, so it is not shown
+        return;
+    } else if ((s->flags & ELEM_CHANGE) && isChange(txn, elem->outAddr)) {
+        // do not display the change address or increment displayIndex
+        return;
+    }
+    txn->elements[txn->elementIndex + 1].elemType = elem->elemType;
+    txn->elementIndex++;
 }
 
 txnDecoderState_e txn_parse(txn_state_t *txn) {
@@ -348,14 +647,57 @@ void txn_init(txn_state_t *txn, uint16_t sigIndex, uint32_t changeIndex) {
     txn->elementIndex = 0;
     txn->elements[txn->elementIndex].elemType = -1;  // first increment brings it to SC_INPUT
 
-    uint8_t publicKey[65] = {0};
-    deriveSiaPublicKey(changeIndex, publicKey);
-    pubkeyToSiaAddress((char *) &txn->changeAddr, publicKey);
+    // the change addresses are derived by isChange, if they are needed
+    txn->changeIndex = changeIndex;
+    txn->changeCount = (changeIndex == TXN_NO_CHANGE) ? 0 : 1;
 
     // initialize hash state
     blake2b_init(&txn->blake);
 }
 
+bool txn_set_change_count(txn_state_t *txn, uint8_t n) {
+    if (txn->changeCount == 0 || n == 0 || n > MAX_CHANGE_ADDRS ||
+        txn->changeIndex > TXN_NO_CHANGE - n) {
+        return false;
+    }
+    txn->changeCount = n;
+    return true;
+}
+
+bool txn_set_covered(txn_state_t *txn, const uint8_t *covered, uint8_t n) {
+    if (n == 0 || n > MAX_COVERED_ELEMS) {
+        return false;
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        const uint16_t elem = U2LE(covered, 2 * i);
+        // elements must be valid, in increasing order, and must not include
+        // the TxnSig being computed
+        if ((elem >> 12) > TXN_ELEM_TXN_SIG || (i > 0 && elem <= txn->covered[i - 1]) ||
+            elem == COVERED_ELEM(TXN_ELEM_TXN_SIG, txn->sigIndex)) {
+            return false;
+        }
+        txn->covered[i] = elem;
+    }
+    txn->coveredLen = n;
+    txn->partial = true;
+    return true;
+}
+
+bool txn_compute_id(txn_state_t *txn) {
+#ifdef TARGET_NANOS
+    UNUSED(txn);
+    return false;
+#else
+    blake2b_init(&txn->idBlake);
+    txn->computeID = true;
+    return true;
+#endif
+}
+
+void txn_hash_only(txn_state_t *txn) {
+    txn->hashOnly = true;
+}
+
 void txn_update(txn_state_t *txn, uint8_t *in, uint8_t inlen) {
     // the buffer should never overflow; any elements should always be drained
     // before the next read.
@@ -366,12 +708,107 @@ void txn_update(txn_state_t *txn, uint8_t *in, uint8_t inlen) {
     // append to the buffer
     memmove(txn->buf + txn->buflen, in, inlen);
     txn->buflen += inlen;
+    PROFILE(movedBytes, inlen);
 
     // reset the seek position; if we previously threw TXN_STATE_PARTIAL, now
     // we can try decoding again from the beginning.
     txn->pos = 0;
 }
 
+txnDecoderState_e txn_parse_rle(txn_state_t *txn, const uint8_t *in, uint8_t inlen) {
+    txnDecoderState_e state = TXN_STATE_PARTIAL;
+    uint16_t i = 0;   // offset within in
+    uint8_t run = 0;  // zeros remaining in the current run
+    while (i < inlen || run > 0) {
+        // Expand directly into the buffer, at most 255 bytes at a time: like
+        // txn_update, this relies on txn_parse leaving at least that much
+        // room, and ensures that its overflow check remains meaningful.
+        uint8_t *out = txn->buf + txn->buflen;
+        uint16_t n = 0;
+        while (n < 255 && (i < inlen || run > 0)) {
+            if (run > 0) {
+                out[n++] = 0;
+                run--;
+            } else if (in[i] == 0) {
+                // a run must have a count, and the count must be non-zero
+                if (i + 1 == inlen || in[i + 1] == 0) {
+                    return TXN_STATE_ERR;
+                }
+                run = in[i + 1];
+                i += 2;
+            } else {
+                out[n++] = in[i++];
+            }
+        }
+        txn->buflen += n;
+        txn->pos = 0;
+        PROFILE(movedBytes, n);
+
+        state = txn_parse(txn);
+        if (state != TXN_STATE_PARTIAL) {
+            return state;
+        }
+    }
+    return state;
+}
+
+// sameDest reports whether two outputs are of the same type and sent to the
+// same address.
+static bool sameDest(const txn_elem_t *a, const txn_elem_t *b) {
+    return a->elemType == b->elemType && !memcmp(a->outAddr, b->outAddr, 32);
+}
+
+bool txn_summarize(const txn_state_t *txn, txn_summary_t *sum) {
+    memset(sum, 0, sizeof(txn_summary_t));
+    for (uint16_t i = 0; i < txn->elementIndex; i++) {
+        const txn_elem_t *elem = &txn->elements[i];
+        uint8_t *total;
+        switch (elem->elemType) {
+            case TXN_ELEM_SC_OUTPUT:
+                total = sum->sc;
+                break;
+            case TXN_ELEM_SF_OUTPUT:
+                total = sum->sf;
+                sum->hasSF = true;
+                break;
+            case TXN_ELEM_MINER_FEE:
+                if (!cur_add(sum->fee, elem->outVal)) {
+                    return false;
+                }
+                continue;
+            default:
+                return false;
+        }
+        // Each destination's total is at most the total of its type, so
+        // only the latter needs to be checked for overflow.
+        if (!cur_add(total, elem->outVal)) {
+            return false;
+        }
+        uint16_t d = 0;
+        while (d < sum->destCount && !sameDest(&txn->elements[sum->destElems[d]], elem)) {
+            d++;
+        }
+        if (d == sum->destCount) {
+            sum->destElems[sum->destCount++] = i;
+        }
+    }
+    return true;
+}
+
+uint16_t txn_summary_dest(const txn_state_t *txn,
+                          const txn_summary_t *sum,
+                          uint16_t n,
+                          uint8_t total[static 17]) {
+    memset(total, 0, 1 + 16);
+    const uint16_t first = sum->destElems[n];
+    for (uint16_t j = first; j < txn->elementIndex; j++) {
+        if (sameDest(&txn->elements[j], &txn->elements[first])) {
+            cur_add(total, txn->elements[j].outVal);
+        }
+    }
+    return first;
+}
+
 void format_address(char *dst, uint8_t *src) {
     bin2hex(dst, src, 32);
     uint8_t checksum[6];
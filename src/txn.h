@@ -1,6 +1,7 @@
 #ifndef TXN_H
 #define TXN_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "blake2b.h"
@@ -17,6 +18,19 @@
 #define U8LE(buf, off) \
     (((uint64_t)(U4LE(buf, off + 4)) << 32) | ((uint64_t)(U4LE(buf, off)) & 0xFFFFFFFF))
 
+#ifdef HAVE_DECODE_PROFILE
+// txn_profile counts the work done by every decoder since it was last
+// cleared, so that the fuzzer can search for inputs that are expensive to
+// decode (see fuzzing/).
+typedef struct {
+    uint32_t readBytes;    // bytes examined, counting again any that are re-decoded
+    uint32_t movedBytes;   // bytes moved or expanded within the buffer
+    uint32_t hashedBytes;  // bytes added to the SigHash or ID
+    uint32_t hashCalls;    // calls made to add them
+} txn_profile_t;
+extern txn_profile_t txn_profile;
+#endif
+
 // txnDecoderState_e indicates a transaction decoder status
 typedef enum {
     TXN_STATE_ERR = 1,   // invalid transaction (NOTE: it's illegal to THROW(0))
@@ -41,10 +55,41 @@ typedef enum {
 typedef struct {
     uint8_t elemType;  // type of element (txnElemType_e)
 
-    uint8_t outVal[1 + 16];  // currency value, Sia-encoded
-    uint8_t outAddr[32];     // address, Sia-encoded
+    union {
+        struct {
+            uint8_t outVal[1 + 16];  // currency value, Sia-encoded
+            uint8_t outAddr[32];     // address, Sia-encoded
+        };
+        // File contract revisions are summarized by their revision number and
+        // the payouts to the renter and host if the contract succeeds.
+        struct {
+            uint8_t revisionNumber[8];     // little-endian
+            uint8_t renterPayout[1 + 16];  // currency value, Sia-encoded
+            uint8_t hostPayout[1 + 16];    // currency value, Sia-encoded
+        } fcr;
+    };
 } txn_elem_t;
 
+// MAX_COVERED_ELEMS is the maximum number of elements that may be covered by
+// a signature that does not cover the whole transaction.
+#define MAX_COVERED_ELEMS 8
+
+// MAX_CHANGE_ADDRS is the maximum number of consecutive key indices whose
+// addresses may be treated as change addresses.
+#ifdef TARGET_NANOS
+#define MAX_CHANGE_ADDRS 2
+#else
+#define MAX_CHANGE_ADDRS 8
+#endif
+
+// TXN_NO_CHANGE is the change index that indicates that the transaction has
+// no change outputs.
+#define TXN_NO_CHANGE 0xFFFFFFFF
+
+// COVERED_ELEM identifies a covered element by its type and index.
+#define COVERED_ELEM(type, index) ((uint16_t) (((type) << 12) | (index)))
+#define COVERED_MAX_INDEX         0x0FFF
+
 // txn_state_t is a helper object for computing the SigHash of a streamed
 // transaction.
 typedef struct {
@@ -58,16 +103,84 @@ typedef struct {
     uint64_t sliceLen;    // most-recently-seen slice length prefix
     uint16_t sliceIndex;  // offset within current element slice
 
-    uint16_t sigIndex;       // index of TxnSig being computed
-    uint8_t changeAddr[77];  // change address
-    cx_blake2b_t blake;      // hash state
-    uint8_t sigHash[32];     // buffer to hold final hash
+    uint8_t elemStage;  // progress within an element decoded in stages
+    uint64_t subLen;    // length of a slice nested within the current element
+    uint64_t subIndex;  // offset within the nested slice
+
+    uint16_t sigIndex;    // index of TxnSig being computed
+    cx_blake2b_t blake;   // hash state
+    uint8_t sigHash[32];  // buffer to hold final hash
+
+    // Siacoin outputs sent to a change address are not displayed. The change
+    // addresses are derived from a range of key indices when the first
+    // siacoin output is decoded, since deriving them is slow, and kept
+    // sorted so that each output can be looked up quickly.
+    uint32_t changeIndex;  // first change key index
+    uint8_t changeCount;   // number of change key indices
+    bool changeDerived;    // whether changeAddrs has been filled
+    uint8_t changeAddrs[MAX_CHANGE_ADDRS][32];  // sorted unlock hashes
+
+    // If the TxnSig does not cover the whole transaction, the covered
+    // elements are declared in advance, so that they can be hashed as they
+    // are decoded; the declaration is checked against the TxnSig's
+    // CoveredFields once they are reached.
+    bool partial;
+    uint8_t coveredLen;                   // number of covered elements
+    uint8_t coveredPos;                   // next covered element to decode
+    uint16_t covered[MAX_COVERED_ELEMS];  // see COVERED_ELEM
+
+    // The transaction ID is the hash of every element except the
+    // TransactionSignatures, without the replay prefix. It is only computed
+    // on request, and never on the Nano S, which lacks the RAM for a second
+    // hash state.
+    bool computeID;
+#ifndef TARGET_NANOS
+    cx_blake2b_t idBlake;  // ID hash state
+    uint8_t txnID[32];     // buffer to hold final ID
+#endif
+
+    // A transaction that is only hashed is never displayed, so none of its
+    // elements are kept, and the change addresses are never derived.
+    bool hashOnly;
 } txn_state_t;
 
+// txn_summary_t holds the totals of a transaction's outputs, for reviewing
+// them by destination rather than one by one.
+typedef struct {
+    uint8_t sc[1 + 16];            // total sent by siacoin outputs, Sia-encoded
+    uint8_t sf[1 + 16];            // total sent by siafund outputs, Sia-encoded
+    uint8_t fee[1 + 16];           // total miner fee, Sia-encoded
+    bool hasSF;                    // whether there are any siafund outputs
+    uint16_t destCount;            // number of distinct destinations
+    uint8_t destElems[MAX_ELEMS];  // first element sent to each destination
+} txn_summary_t;
+
 // txn_init initializes a transaction decoder, preparing it to calculate the
-// requested SigHash.
+// requested SigHash. Siacoin outputs sent to the address of changeIndex are
+// not displayed, unless changeIndex is TXN_NO_CHANGE.
 void txn_init(txn_state_t *txn, uint16_t sigIndex, uint32_t changeIndex);
 
+// txn_set_change_count declares that the addresses of the n key indices
+// starting at the change index are all change addresses. It must be called
+// before any data is added. It returns false if the range is invalid.
+bool txn_set_change_count(txn_state_t *txn, uint8_t n);
+
+// txn_set_covered declares that the TxnSig covers only the n elements in
+// covered, given as little-endian COVERED_ELEM values in increasing order. It
+// must be called before any data is added. It returns false if the
+// declaration is invalid.
+bool txn_set_covered(txn_state_t *txn, const uint8_t *covered, uint8_t n);
+
+// txn_compute_id requests that the transaction ID be calculated alongside the
+// SigHash. It must be called before any data is added. It returns false if
+// the device cannot compute the ID.
+bool txn_compute_id(txn_state_t *txn);
+
+// txn_hash_only declares that the transaction will not be displayed, so its
+// elements need not be kept; the number of elements is then unlimited. It
+// must be called before any data is added.
+void txn_hash_only(txn_state_t *txn);
+
 // txn_update adds data to a transaction decoder.
 void txn_update(txn_state_t *txn, uint8_t *in, uint8_t inlen);
 
@@ -78,6 +191,29 @@ void txn_update(txn_state_t *txn, uint8_t *in, uint8_t inlen);
 // decoded, it returns TXN_STATE_FINISHED.
 txnDecoderState_e txn_parse(txn_state_t *txn);
 
+// txn_parse_rle is like txn_update followed by txn_parse, except that the
+// input is zero-run encoded: a zero byte is followed by a count n, and the pair
+// expands to n zero bytes; all other bytes are copied verbatim. The input is
+// expanded and decoded incrementally, so a short chunk may expand to far more
+// than fits in the decoder's buffer. A run must not be split across chunks.
+txnDecoderState_e txn_parse_rle(txn_state_t *txn, const uint8_t *in, uint8_t inlen);
+
+// txn_summarize totals the displayed elements of a fully-decoded
+// transaction. Outputs sent to the same address are combined. It returns
+// false if the transaction cannot be summarized: if it contains file
+// contracts or revisions, which are not outputs, or if a total does not fit in
+// 128 bits. The first element sent to each destination is recorded, so that
+// each destination's page is found without another search.
+bool txn_summarize(const txn_state_t *txn, txn_summary_t *sum);
+
+// txn_summary_dest finds the nth distinct destination of a summarized
+// transaction, in order of appearance. It returns the index of the first
+// element sent to it, and stores the total sent to it in total.
+uint16_t txn_summary_dest(const txn_state_t *txn,
+                          const txn_summary_t *sum,
+                          uint16_t n,
+                          uint8_t total[static 17]);
+
 // txn takes the Sia-encoded address in src and converts it to a hex encoded
 // readable address in dst
 void format_address(char *dst, uint8_t *src);
@@ -87,4 +223,14 @@ void format_address(char *dst, uint8_t *src);
 // is too large, it throws TXN_STATE_ERR.
 int cur2dec(char *out, uint8_t *cur);
 
+// cur_add adds the Sia-encoded currency value src to dst, storing the sum in
+// dst. It returns false if the sum does not fit in 128 bits, in which case dst
+// is left unmodified.
+bool cur_add(uint8_t *dst, const uint8_t *src);
+
+// cur_cmp compares the Sia-encoded currency values a and b, returning -1, 0,
+// or 1 if a is less than, equal to, or greater than b. Values larger than 128
+// bits compare greater than any other value.
+int cur_cmp(const uint8_t *a, const uint8_t *b);
+
 #endif /* TXN_H */
\ No newline at end of file
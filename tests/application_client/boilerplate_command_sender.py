@@ -1,5 +1,5 @@
 from enum import IntEnum
-from typing import Generator, List, Optional
+from typing import Generator, List, Optional, Sequence
 from contextlib import contextmanager
 
 from ragger.backend.interface import BackendInterface, RAPDU
@@ -14,6 +14,9 @@ class P1(IntEnum):
     # Parameter 1 for first APDU number.
     P1_START = 0x00
     P1_MORE = 0x80
+    P1_RESUME = 0x40
+
+    P1_NO_DISPLAY = 0x01
 
 
 class P2(IntEnum):
@@ -27,6 +30,12 @@ class P2(IntEnum):
 
     P2_DISPLAY_HASH = 0x00
     P2_SIGN_HASH = 0x01
+    P2_ZERO_RLE = 0x02
+    P2_PARTIAL_COVER = 0x04
+    P2_TXN_ID = 0x08
+    P2_SUMMARY = 0x20
+    P2_NO_REVIEW = 0x40
+    P2_SAVE_TEMPLATE = 0x80
 
 
 class InsType(IntEnum):
@@ -34,11 +43,17 @@ class InsType(IntEnum):
     GET_PUBLIC_KEY = 0x02
     SIGN_HASH = 0x04
     GET_TXN_HASH = 0x08
+    SIGN_TXN_BATCH = 0x10
+    SIGN_MESSAGE = 0x12
+    SET_POLICY = 0x13
+    ADD_TRUSTED = 0x14
+    CLEAR_TEMPLATES = 0x15
 
 
 class Errors(IntEnum):
     SW_OK = 0x9000
-    SW_INVALID_PARAM = 0x681
+    SW_INVALID_PARAM = 0x6B01
+    SW_IMPROPER_INIT = 0x6B02
 
     SW_DENY = 0x6985
     SW_WRONG_P1P2 = 0x6A86
@@ -60,6 +75,43 @@ def split_message(message: bytes, max_size: int) -> List[bytes]:
     return [message[x : x + max_size] for x in range(0, len(message), max_size)]
 
 
+def zero_rle(data: bytes) -> bytes:
+    # Replace each run of 1 to 255 zero bytes with a zero byte followed by
+    # the length of the run.
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        if data[i] != 0:
+            out.append(data[i])
+            i += 1
+            continue
+        run = 0
+        while i < len(data) and data[i] == 0 and run < 255:
+            run += 1
+            i += 1
+        out += bytes([0, run])
+    return bytes(out)
+
+
+def split_zero_rle(message: bytes, max_size: int) -> List[bytes]:
+    # Like split_message, but never splits a run across two messages.
+    chunks = []
+    off = 0
+    while off < len(message):
+        end = min(off + max_size, len(message))
+        i = off
+        while i < end:
+            if message[i] != 0:
+                i += 1
+            elif i + 1 < end:
+                i += 2
+            else:
+                break
+        chunks.append(message[off:i])
+        off = i
+    return chunks
+
+
 class BoilerplateCommandSender:
     def __init__(self, backend: BackendInterface) -> None:
         self.backend = backend
@@ -78,6 +130,11 @@ class BoilerplateCommandSender:
             cla=CLA, ins=InsType.GET_VERSION, p1=P1.P1_START, p2=P2.P2_LAST, data=b""
         )
 
+    def get_capabilities(self) -> RAPDU:
+        return self.backend.exchange(
+            cla=CLA, ins=InsType.GET_VERSION, p1=0x01, p2=P2.P2_LAST, data=b""
+        )
+
     @contextmanager
     def get_address_with_confirmation(self, index: int) -> Generator[None, None, None]:
         with self.backend.exchange_async(
@@ -89,6 +146,15 @@ class BoilerplateCommandSender:
         ) as response:
             yield response
 
+    def get_public_keys(self, index: int, count: int) -> RAPDU:
+        return self.backend.exchange(
+            cla=CLA,
+            ins=InsType.GET_PUBLIC_KEY,
+            p1=P1.P1_NO_DISPLAY,
+            p2=P2.P2_DISPLAY_PUBKEY,
+            data=index.to_bytes(4, "little", signed=False) + bytes([count]),
+        )
+
     @contextmanager
     def get_public_key_with_confirmation(
         self, index: int
@@ -122,21 +188,35 @@ class BoilerplateCommandSender:
         sig_index: int,
         change_index: int,
         transaction: bytes,
+        p2: int = P2.P2_SIGN_HASH,
+        covered: Sequence[int] = (),
+        label: bytes = b"",
     ) -> Generator[None, None, None]:
         p1 = P1.P1_START
-        messages = split_message(
+        message = (
             key_index.to_bytes(4, "little", signed=False)
             + sig_index.to_bytes(2, "little", signed=False)
             + change_index.to_bytes(4, "little", signed=False)
-            + transaction,
-            MAX_APDU_LEN,
         )
+        # A partial signature lists the elements it covers, each as its type
+        # in the top 4 bits and its index in the low 12 bits.
+        if p2 & P2.P2_PARTIAL_COVER:
+            message += bytes([len(covered)])
+            for elem in covered:
+                message += elem.to_bytes(2, "little", signed=False)
+        # A template's label ends the header.
+        if p2 & P2.P2_SAVE_TEMPLATE:
+            message += bytes([len(label)]) + label
+        if p2 & P2.P2_ZERO_RLE:
+            messages = split_zero_rle(message + zero_rle(transaction), MAX_APDU_LEN)
+        else:
+            messages = split_message(message + transaction, MAX_APDU_LEN)
         for i in range(len(messages) - 1):
             with self.backend.exchange_async(
                 cla=CLA,
                 ins=InsType.GET_TXN_HASH,
                 p1=p1,
-                p2=P2.P2_SIGN_HASH,
+                p2=p2,
                 data=messages[i],
             ) as response:
                 pass
@@ -146,10 +226,128 @@ class BoilerplateCommandSender:
             cla=CLA,
             ins=InsType.GET_TXN_HASH,
             p1=p1,
-            p2=P2.P2_SIGN_HASH,
+            p2=p2,
             data=messages[-1],
         ) as response:
             yield response
 
+    def calc_tx_hash_no_review(
+        self,
+        sig_index: int,
+        change_index: int,
+        transaction: bytes,
+        p2: int = P2.P2_NO_REVIEW,
+    ) -> RAPDU:
+        p1 = P1.P1_START
+        messages = split_message(
+            (0).to_bytes(4, "little", signed=False)
+            + sig_index.to_bytes(2, "little", signed=False)
+            + change_index.to_bytes(4, "little", signed=False)
+            + transaction,
+            MAX_APDU_LEN,
+        )
+        for message in messages:
+            response = self.backend.exchange(
+                cla=CLA,
+                ins=InsType.GET_TXN_HASH,
+                p1=p1,
+                p2=p2,
+                data=message,
+            )
+            p1 = P1.P1_MORE
+        return response
+
+    def add_batch_txn(
+        self,
+        key_index: int,
+        sig_index: int,
+        change_index: int,
+        transaction: bytes,
+    ) -> RAPDU:
+        p1 = P1.P1_START
+        messages = split_message(
+            key_index.to_bytes(4, "little", signed=False)
+            + sig_index.to_bytes(2, "little", signed=False)
+            + change_index.to_bytes(4, "little", signed=False)
+            + transaction,
+            MAX_APDU_LEN,
+        )
+        for message in messages:
+            response = self.backend.exchange(
+                cla=CLA,
+                ins=InsType.SIGN_TXN_BATCH,
+                p1=p1,
+                p2=P2.P2_LAST,
+                data=message,
+            )
+            p1 = P1.P1_MORE
+        return response
+
+    @contextmanager
+    def review_batch(self) -> Generator[None, None, None]:
+        with self.backend.exchange_async(
+            cla=CLA, ins=InsType.SIGN_TXN_BATCH, p1=0x01, p2=P2.P2_LAST, data=b""
+        ) as response:
+            yield response
+
+    def get_batch_signature(self, index: int) -> RAPDU:
+        return self.backend.exchange(
+            cla=CLA, ins=InsType.SIGN_TXN_BATCH, p1=0x02, p2=P2.P2_LAST, data=bytes([index])
+        )
+
+    def set_policy(
+        self,
+        key_index: int,
+        flags: int,
+        max_txn: int,
+        max_session: int,
+        max_fee: int,
+        dests: List[bytes],
+    ) -> RAPDU:
+        def amount(hastings: int) -> bytes:
+            n = (hastings.bit_length() + 7) // 8
+            return bytes([n]) + hastings.to_bytes(n, "big", signed=False)
+
+        return self.backend.exchange(
+            cla=CLA,
+            ins=InsType.SET_POLICY,
+            p1=P1.P1_START,
+            p2=P2.P2_LAST,
+            data=key_index.to_bytes(4, "little", signed=False)
+            + bytes([flags])
+            + amount(max_txn)
+            + amount(max_session)
+            + amount(max_fee)
+            + b"".join(dests),
+        )
+
+    @contextmanager
+    def review_policy(self) -> Generator[None, None, None]:
+        with self.backend.exchange_async(
+            cla=CLA, ins=InsType.SET_POLICY, p1=0x01, p2=P2.P2_LAST, data=b""
+        ) as response:
+            yield response
+
+    def add_trusted(self, addr: bytes, label: str) -> RAPDU:
+        return self.backend.exchange(
+            cla=CLA,
+            ins=InsType.ADD_TRUSTED,
+            p1=P1.P1_START,
+            p2=P2.P2_LAST,
+            data=addr + bytes([len(label)]) + label.encode("ascii"),
+        )
+
+    @contextmanager
+    def review_trusted(self) -> Generator[None, None, None]:
+        with self.backend.exchange_async(
+            cla=CLA, ins=InsType.ADD_TRUSTED, p1=0x01, p2=P2.P2_LAST, data=b""
+        ) as response:
+            yield response
+
+    def clear_templates(self) -> RAPDU:
+        return self.backend.exchange(
+            cla=CLA, ins=InsType.CLEAR_TEMPLATES, p1=P1.P1_START, p2=P2.P2_LAST, data=b""
+        )
+
     def get_async_response(self) -> Optional[RAPDU]:
         return self.backend.last_async_response
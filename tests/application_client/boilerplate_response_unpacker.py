@@ -1,5 +1,5 @@
 from typing import Tuple
-from struct import unpack
+from struct import unpack, unpack_from
 
 # remainder, data_len, data
 def pop_sized_buf_from_buffer(buffer: bytes, size: int) -> Tuple[bytes, bytes]:
@@ -28,6 +28,28 @@ def unpack_get_version_response(response: bytes) -> Tuple[int, int, int]:
     return (major, minor, patch)
 
 
+# Unpack from response:
+# response = MAJOR (1)
+#            MINOR (1)
+#            PATCH (1)
+#            flags (4)
+#            max_chunk_len (2)
+#            max_elems (2)
+#            elem_types (2)
+#            max_covered_elems (1)
+#            max_batch_txns (1)
+#            max_batch_dests (1)
+#            max_policy_dests (1)
+#            max_change_addrs (1)
+#            max_trusted_pending (1)
+#            max_pubkey_batch (1)
+def unpack_get_capabilities_response(response: bytes) -> Tuple[Tuple[int, int, int], int, Tuple[int, ...]]:
+    # later versions may append further uint8 limits
+    assert len(response) >= 17
+    major, minor, patch, flags, *limits = unpack_from("<BBBIHHHBBBB", response)
+    return (major, minor, patch), flags, tuple(limits) + tuple(response[17:])
+
+
 # Unpack from response:
 # response = format_id (1)
 #            app_name_raw_len (1)
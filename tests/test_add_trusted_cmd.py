@@ -0,0 +1,102 @@
+import base64
+from ragger.backend import RaisePolicy
+from ragger.navigator import NavInsID
+from application_client.boilerplate_command_sender import (
+    BoilerplateCommandSender,
+    CLA,
+    InsType,
+    P1,
+    Errors,
+)
+from test_sign_txn_cmd import accept_instructions, test_transaction
+
+
+# Ensure the app refuses to review addresses that were never sent
+def test_add_trusted_improper_init(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    rapdu = backend.exchange(cla=CLA, ins=InsType.ADD_TRUSTED, p1=0x01, p2=0, data=b"")
+    assert rapdu.status == Errors.SW_IMPROPER_INIT
+
+
+# Ensure the app rejects labels that cannot be displayed
+def test_add_trusted_invalid_label(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    for label in [b"", b"x" * 16, b"new\nline"]:
+        data = bytes(32) + len(label).to_bytes(1, "little") + label
+        rapdu = backend.exchange(cla=CLA, ins=InsType.ADD_TRUSTED, p1=P1.P1_START, p2=0, data=data)
+        assert rapdu.status == Errors.SW_INVALID_PARAM
+
+
+# Trusted address accepted test
+# The test will trust the first destination of test_transaction, then sign
+# test_transaction; its first siacoin output is shown on a single screen, by
+# its label
+def test_add_trusted_sign_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+
+    addr = bytes.fromhex("7813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d6245")
+    rapdu = client.add_trusted(addr, "Bob")
+    assert rapdu.status == Errors.SW_OK
+
+    with client.review_trusted():
+        if firmware.device.startswith("nano"):
+            if firmware.device == "nanos":
+                instructions = 4 * [NavInsID.RIGHT_CLICK]
+            else:
+                instructions = [NavInsID.RIGHT_CLICK]
+            instructions.extend([
+                NavInsID.BOTH_CLICK,
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+        else:
+            instructions = [
+                NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+                NavInsID.USE_CASE_REVIEW_CONFIRM,
+            ]
+        navigator.navigate(instructions)
+    assert client.get_async_response().status == Errors.SW_OK
+
+    with client.sign_tx(
+        key_index=0, sig_index=0, change_index=4294967295, transaction=test_transaction
+    ):
+        if firmware.device.startswith("nano"):
+            # the trusted siacoin output, then the rest as in test_sign_tx_accept
+            instructions = [NavInsID.BOTH_CLICK]
+            if firmware.device == "nanos":
+                instructions.extend(4 * [NavInsID.RIGHT_CLICK])
+                instructions.extend([
+                    NavInsID.BOTH_CLICK,
+                    NavInsID.BOTH_CLICK,
+                ])
+                for i in range(2):
+                    instructions.extend(4 * [NavInsID.RIGHT_CLICK])
+                    instructions.extend([
+                        NavInsID.BOTH_CLICK,
+                        NavInsID.RIGHT_CLICK,
+                        NavInsID.BOTH_CLICK,
+                    ])
+            else:
+                for i in range(3):
+                    instructions.extend([
+                        NavInsID.RIGHT_CLICK,
+                        NavInsID.BOTH_CLICK,
+                        NavInsID.BOTH_CLICK,
+                    ])
+            instructions.extend([
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+        else:
+            instructions = accept_instructions(firmware)
+        navigator.navigate(instructions)
+
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+    )
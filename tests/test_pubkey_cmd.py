@@ -41,6 +41,26 @@ def test_get_public_key_confirm_accepted(firmware, backend, navigator, test_name
     assert response.data[:32].hex() == ref_public_key[2:]
 
 
+# Test will ask for several consecutive public keys without displaying them
+def test_get_public_keys_no_display(backend):
+    client = BoilerplateCommandSender(backend)
+    index, count = 5, 3
+
+    response = client.get_public_keys(index=index, count=count)
+    assert response.status == Errors.SW_OK
+    assert len(response.data) == 32 * count
+    for i in range(count):
+        ref_public_key, _ = calculate_public_key_and_chaincode(
+            CurveChoice.Ed25519Slip, path="44'/93'/%d'/0'/0'" % (index + i)
+        )
+        assert response.data[32 * i : 32 * (i + 1)].hex() == ref_public_key[2:]
+
+    # Too many keys for one response
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    response = client.get_public_keys(index=index, count=8)
+    assert response.status == Errors.SW_INVALID_PARAM
+
+
 # Test will ask to generate a public key that will be rejected on screen
 def test_get_public_key_confirm_refused(firmware, backend, navigator, test_name):
     client = BoilerplateCommandSender(backend)
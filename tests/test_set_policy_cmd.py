@@ -0,0 +1,100 @@
+import base64
+from ragger.backend import RaisePolicy
+from ragger.navigator import NavInsID
+from application_client.boilerplate_command_sender import (
+    BoilerplateCommandSender,
+    CLA,
+    InsType,
+    P1,
+    Errors,
+)
+
+SC = 10**24
+
+# The destinations of test_transaction
+policy_dests = [
+    bytes.fromhex("7813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d6245"),
+    bytes.fromhex("6f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df0"),
+]
+
+# The siacoin input of test_transaction, siacoin outputs of 1 SC and 2 SC to
+# the policy destinations, a miner fee of 1 SC, and a signature covering the
+# whole transaction
+test_policy_transaction = bytes.fromhex(
+    "01000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000006564323535313900000000000000000020000000000000004dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f49000000000000000002000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450b0000000000000001a784379d99db420000006f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df00000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000000a00000000000000d3c21bcecceda100000000000000000000000100000000000000784a77549f25083a69a388a1661e0a6b2ac8c7fc98e2b69edde6bd45d155ad0300000000000000000000000000000000010000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000400000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+)
+
+
+# Ensure the app refuses to review a policy that was never sent
+def test_set_policy_improper_init(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    rapdu = backend.exchange(cla=CLA, ins=InsType.SET_POLICY, p1=0x01, p2=0, data=b"")
+    assert rapdu.status == Errors.SW_IMPROPER_INIT
+
+
+# Ensure the app rejects a destination split across messages
+def test_set_policy_partial_destination(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    data = (0).to_bytes(4, "little") + b"\x00" + b"\x01\x01" * 3 + bytes(31)
+    rapdu = backend.exchange(cla=CLA, ins=InsType.SET_POLICY, p1=P1.P1_START, p2=0, data=data)
+    assert rapdu.status == Errors.SW_INVALID_PARAM
+
+
+# Policy signature accepted test
+# The test will approve a policy requiring a confirmation, then ask for the
+# signature of a transaction it allows, which is confirmed on a single screen
+# instead of being reviewed in full
+def test_set_policy_sign_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+
+    rapdu = client.set_policy(
+        key_index=0,
+        flags=0x01,  # require a confirmation
+        max_txn=10 * SC,
+        max_session=10 * SC,
+        max_fee=SC,
+        dests=policy_dests,
+    )
+    assert rapdu.status == Errors.SW_OK
+
+    with client.review_policy():
+        if firmware.device.startswith("nano"):
+            # the key, the three limits, and the confirmation flag
+            instructions = 5 * [NavInsID.BOTH_CLICK]
+            for i in range(2):
+                if firmware.device == "nanos":
+                    instructions.extend(4 * [NavInsID.RIGHT_CLICK])
+                else:
+                    instructions.append(NavInsID.RIGHT_CLICK)
+                instructions.append(NavInsID.BOTH_CLICK)
+            instructions.extend([
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+        else:
+            instructions = 7 * [NavInsID.USE_CASE_VIEW_DETAILS_NEXT]
+            instructions.append(NavInsID.USE_CASE_REVIEW_CONFIRM)
+        navigator.navigate(instructions)
+    assert client.get_async_response().status == Errors.SW_OK
+
+    with client.sign_tx(
+        key_index=0, sig_index=0, change_index=4294967295, transaction=test_policy_transaction
+    ):
+        if firmware.device.startswith("nano"):
+            instructions = [
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ]
+        else:
+            instructions = [NavInsID.USE_CASE_CHOICE_CONFIRM]
+        navigator.navigate(instructions)
+
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "Y14se1PCQChLysC8Bbc7wola0Z29QSIjVd7VTftOKjposQn6PYStUCuQYgle/JxjlU/Xnl5pveX65gaJlaGeAA=="
+    )
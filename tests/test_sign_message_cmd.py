@@ -0,0 +1,19 @@
+from ragger.backend import RaisePolicy
+from application_client.boilerplate_command_sender import CLA, InsType, P1, Errors
+
+
+# Ensure the app rejects message data sent before the first packet
+def test_sign_message_improper_init(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    rapdu = backend.exchange(cla=CLA, ins=InsType.SIGN_MESSAGE, p1=P1.P1_MORE, p2=0, data=b"hello")
+    assert rapdu.status == Errors.SW_IMPROPER_INIT
+
+
+# Ensure the app rejects a message longer than its declared length
+def test_sign_message_too_long(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    data = (0).to_bytes(4, "little") + (4).to_bytes(4, "little") + b"hello"
+    rapdu = backend.exchange(cla=CLA, ins=InsType.SIGN_MESSAGE, p1=P1.P1_START, p2=0, data=data)
+    assert rapdu.status == Errors.SW_INVALID_PARAM
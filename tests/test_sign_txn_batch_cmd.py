@@ -0,0 +1,76 @@
+import base64
+from application_client.boilerplate_command_sender import BoilerplateCommandSender, Errors
+from ragger.backend import RaisePolicy
+from ragger.navigator import NavInsID
+from test_sign_txn_cmd import test_transaction
+
+
+# Batch signature accepted test
+# The test will send the same transaction twice, signed by different keys,
+# and approve the summary of the batch on screen
+def test_sign_batch_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+
+    for key_index in range(2):
+        rapdu = client.add_batch_txn(
+            key_index=key_index, sig_index=0, change_index=4294967295, transaction=test_transaction
+        )
+        assert rapdu.status == Errors.SW_OK
+
+    with client.review_batch():
+        if firmware.device.startswith("nano"):
+            instructions = []
+            if firmware.device == "nanos":
+                # two siacoin destinations, then two siafund destinations
+                for i in range(2):
+                    instructions.extend(4 * [NavInsID.RIGHT_CLICK])
+                    instructions.extend([
+                        NavInsID.BOTH_CLICK,
+                        NavInsID.BOTH_CLICK,
+                    ])
+                for i in range(2):
+                    instructions.extend(4 * [NavInsID.RIGHT_CLICK])
+                    instructions.extend([
+                        NavInsID.BOTH_CLICK,
+                        NavInsID.RIGHT_CLICK,
+                        NavInsID.BOTH_CLICK,
+                    ])
+            else:
+                for i in range(4):
+                    instructions.extend([
+                        NavInsID.RIGHT_CLICK,
+                        NavInsID.BOTH_CLICK,
+                        NavInsID.BOTH_CLICK,
+                    ])
+
+            # the miner fee total, and the key of each transaction
+            instructions.extend(3 * [NavInsID.BOTH_CLICK])
+            instructions.extend([
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+            navigator.navigate(instructions)
+        else:
+            # four destinations, the miner fee total, and two keys
+            instructions = [NavInsID.SWIPE_CENTER_TO_LEFT]
+            instructions.extend(7 * [NavInsID.USE_CASE_VIEW_DETAILS_NEXT])
+            instructions.append(NavInsID.USE_CASE_REVIEW_CONFIRM)
+            navigator.navigate(instructions)
+
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == bytes([2])
+
+    rapdu = client.get_batch_signature(0)
+    assert rapdu.status == Errors.SW_OK
+    assert rapdu.data == base64.b64decode(
+        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+    )
+    rapdu = client.get_batch_signature(1)
+    assert rapdu.status == Errors.SW_OK
+    assert rapdu.data == base64.b64decode(
+        "RnpAdErc1fNjljckncMDzcOG1iR5ZqTP6sTnDKap814r5vN/NohbRGw1oPl6jheO8Zqm3409TwEkgrBPBToZCQ=="
+    )
+
@@ -1,14 +1,20 @@
 import base64
 from application_client.boilerplate_command_sender import (
     BoilerplateCommandSender,
+    CLA,
     Errors,
+    InsType,
+    MAX_APDU_LEN,
+    P1,
+    P2,
+    split_message,
 )
 from application_client.boilerplate_response_unpacker import (
     unpack_get_public_key_response,
     unpack_sign_tx_response,
 )
 from ragger.backend import RaisePolicy
-from ragger.navigator import NavInsID
+from ragger.navigator import NavIns, NavInsID
 from utils import ROOT_SCREENSHOT_PATH
 
 # In this tests we check the behavior of the device when asked to sign a transaction
@@ -79,6 +85,57 @@ def test_sign_tx_refused(firmware, backend, navigator, test_name):
     assert len(response.data) == 0
 
 
+# accept_instructions returns the navigation that reviews and approves the
+# test transaction
+def accept_instructions(firmware):
+    if not firmware.device.startswith("nano"):
+        return [
+            NavInsID.SWIPE_CENTER_TO_LEFT,
+            NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+            NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+            NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+            NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+            NavInsID.USE_CASE_REVIEW_CONFIRM,
+        ]
+
+    instructions = []
+    if firmware.device == "nanos":
+        for i in range(2):
+            instructions.extend(4 * [NavInsID.RIGHT_CLICK])
+            instructions.extend([
+                NavInsID.BOTH_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+        for i in range(2):
+            instructions.extend(4 * [NavInsID.RIGHT_CLICK])
+            instructions.extend([
+                NavInsID.BOTH_CLICK,
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+    else:
+        instructions.extend([
+            NavInsID.RIGHT_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.RIGHT_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.RIGHT_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.RIGHT_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.BOTH_CLICK,
+        ])
+
+    instructions.extend([
+        NavInsID.RIGHT_CLICK,
+        NavInsID.BOTH_CLICK,
+    ])
+    return instructions
+
+
 # Transaction signature accepted test
 # The test will ask for a transaction signature that will be accepted on screen
 def test_sign_tx_accept(firmware, backend, navigator, test_name):
@@ -88,57 +145,339 @@ def test_sign_tx_accept(firmware, backend, navigator, test_name):
     backend.raise_policy = RaisePolicy.RAISE_NOTHING
 
     with client.sign_tx(key_index=0, sig_index=0, change_index=4294967295, transaction=test_transaction):
+        navigator.navigate_and_compare(ROOT_SCREENSHOT_PATH, test_name, accept_instructions(firmware))
+
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+    )
+
+
+# Zero-run encoded transaction accepted test
+# The test will send the transaction zero-run encoded, which must not change
+# the review or the signature of test_sign_tx_accept
+def test_sign_tx_zero_rle_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+
+    with client.sign_tx(
+        key_index=0,
+        sig_index=0,
+        change_index=4294967295,
+        transaction=test_transaction,
+        p2=P2.P2_SIGN_HASH | P2.P2_ZERO_RLE,
+    ):
+        navigator.navigate_and_compare(
+            ROOT_SCREENSHOT_PATH, "test_sign_tx_accept", accept_instructions(firmware)
+        )
+
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+    )
+
+
+# Transaction resumed and accepted test
+# The test will send the first packet of the transaction, resume the transfer
+# as if the connection had dropped, and send the rest from the acknowledged
+# offset. The review is identical to test_sign_tx_accept.
+def test_sign_tx_resume_accept(firmware, backend, navigator):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    header = (
+        (0).to_bytes(4, "little")
+        + (0).to_bytes(2, "little")
+        + (4294967295).to_bytes(4, "little")
+    )
+    rapdu = backend.exchange(
+        cla=CLA,
+        ins=InsType.GET_TXN_HASH,
+        p1=P1.P1_START,
+        p2=P2.P2_SIGN_HASH,
+        data=header + test_transaction[:245],
+    )
+    assert rapdu.status == Errors.SW_OK
+    token = rapdu.data[:4]
+
+    rapdu = backend.exchange(
+        cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_RESUME, p2=P2.P2_SIGN_HASH, data=token
+    )
+    assert rapdu.status == Errors.SW_OK
+    assert rapdu.data[:4] == token
+    offset = int.from_bytes(rapdu.data[4:8], "little")
+    assert offset == 245
+
+    messages = split_message(test_transaction[offset:], MAX_APDU_LEN)
+    for message in messages[:-1]:
+        rapdu = backend.exchange(
+            cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_MORE, p2=P2.P2_SIGN_HASH, data=message
+        )
+        assert rapdu.status == Errors.SW_OK
+    with backend.exchange_async(
+        cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_MORE, p2=P2.P2_SIGN_HASH, data=messages[-1]
+    ):
+        navigator.navigate_and_compare(
+            ROOT_SCREENSHOT_PATH, "test_sign_tx_accept", accept_instructions(firmware)
+        )
+
+    response = backend.last_async_response
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+    )
+
+
+# The siacoin input of test_transaction, a file contract with a payout of 1 SC,
+# a revision of another contract to revision number 2 paying 1 SC to the
+# renter and 2 SC to the host, a miner fee of 1 SC, and a signature covering
+# the whole transaction
+test_contract_transaction = bytes.fromhex(
+    "01000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000006564323535313900000000000000000020000000000000004dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f49000000000000000000000000000000000100000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000006400000000000000c8000000000000000a00000000000000d3c21bcecceda100000001000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d624501000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000001111111111111111111111111111111111111111111111111111111111111111000000000000000001000000000000006564323535313900000000000000000020000000000000004dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f4900000000000000000200000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000006400000000000000c80000000000000002000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450b0000000000000001a784379d99db420000006f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df002000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450b0000000000000001a784379d99db420000006f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df0000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000000a00000000000000d3c21bcecceda100000000000000000000000100000000000000784a77549f25083a69a388a1661e0a6b2ac8c7fc98e2b69edde6bd45d155ad0300000000000000000000000000000000010000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000400000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+)
+
+# The siacoin input of test_transaction, siacoin outputs of 1 SC and 2 SC to
+# the addresses of test_transaction, a miner fee of 1 SC, and a signature
+# covering only the first siacoin output and the miner fee
+test_partial_transaction = bytes.fromhex(
+    "01000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000006564323535313900000000000000000020000000000000004dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f49000000000000000002000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450b0000000000000001a784379d99db420000006f4710e9acbc9a20987222d4e79f56baf3b5642059e2f3922ac8e6b1f4812df00000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000000a00000000000000d3c21bcecceda100000000000000000000000100000000000000784a77549f25083a69a388a1661e0a6b2ac8c7fc98e2b69edde6bd45d155ad030000000000000000000000000000000000000000000000000001000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000100000000000000000000000000000000000000000000000000000000000000400000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+)
+
+
+# The siacoin input of test_transaction, siacoin outputs of 1 SC and 2 SC to
+# the first address of test_transaction, a miner fee of 1 SC, and a signature
+# covering the whole transaction
+test_summary_transaction = bytes.fromhex(
+    "01000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000006564323535313900000000000000000020000000000000004dd481abf56b5f96d82b13823ce81f8d8f0d0eb3ac2d656366ca2a822e526f49000000000000000002000000000000000a00000000000000d3c21bcecceda10000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450b0000000000000001a784379d99db420000007813b59b2da28959e13466b8701f40133ceda7677edfc7c17829c3b5c58d62450000000000000000000000000000000000000000000000000000000000000000000000000000000001000000000000000a00000000000000d3c21bcecceda100000000000000000000000100000000000000784a77549f25083a69a388a1661e0a6b2ac8c7fc98e2b69edde6bd45d155ad0300000000000000000000000000000000010000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000400000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+)
+
+# File contract transaction accepted test
+# The test will ask for the signature of a transaction that forms a file
+# contract and revises another, each shown on its own screens
+def test_sign_tx_contract_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+
+    with client.sign_tx(
+        key_index=0, sig_index=0, change_index=4294967295, transaction=test_contract_transaction
+    ):
         if firmware.device.startswith("nano"):
-            instructions = []
+            # the contract, the revision number and payouts, and the miner fee
+            instructions = 5 * [NavInsID.BOTH_CLICK]
+            instructions.extend([
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+        else:
+            instructions = [
+                NavInsID.SWIPE_CENTER_TO_LEFT,
+                NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+                NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+                NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+                NavInsID.USE_CASE_REVIEW_CONFIRM,
+            ]
+        navigator.navigate(instructions)
+
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "9SpSN7AJ/wkMWrUfz2G3CEIIW+qOlJlPsyOgqY+eXDFkQyt2d8jTluWGLzha6Q0Tfdpx8U7tlY9rhS4hEKBCAA=="
+    )
+
+
+# Partial signature accepted test
+# The test will enable blind signing, then ask for a signature covering only
+# some elements of a transaction; only those elements are shown, after a
+# warning
+def test_sign_tx_partial_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+
+    if firmware.device.startswith("nano"):
+        navigator.navigate([
+            NavInsID.RIGHT_CLICK,
+            NavInsID.BOTH_CLICK,
+            NavInsID.RIGHT_CLICK,
+            NavInsID.RIGHT_CLICK,
+            NavInsID.BOTH_CLICK,
+        ], screen_change_before_first_instruction=False)
+    else:
+        navigator.navigate([
+            NavInsID.USE_CASE_HOME_SETTINGS,
+            NavIns(NavInsID.TOUCH, (350,115)),
+            NavInsID.USE_CASE_SETTINGS_MULTI_PAGE_EXIT,
+        ], screen_change_before_first_instruction=False)
+
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    with client.sign_tx(
+        key_index=0,
+        sig_index=0,
+        change_index=4294967295,
+        transaction=test_partial_transaction,
+        p2=P2.P2_SIGN_HASH | P2.P2_PARTIAL_COVER,
+        covered=[0x1000, 0x7000],  # siacoin output 0 and miner fee 0
+    ):
+        if firmware.device.startswith("nano"):
+            # the warning, then the siacoin output and the miner fee
+            instructions = [NavInsID.BOTH_CLICK]
             if firmware.device == "nanos":
-                for i in range(2):
-                    instructions.extend(4 * [NavInsID.RIGHT_CLICK])
-                    instructions.extend([
-                        NavInsID.BOTH_CLICK,
-                        NavInsID.BOTH_CLICK,
-                    ])
-                for i in range(2):
-                    instructions.extend(4 * [NavInsID.RIGHT_CLICK])
-                    instructions.extend([
-                        NavInsID.BOTH_CLICK,
-                        NavInsID.RIGHT_CLICK,
-                        NavInsID.BOTH_CLICK,
-                    ])
+                instructions.extend(4 * [NavInsID.RIGHT_CLICK])
             else:
-                instructions.extend([
-                    NavInsID.RIGHT_CLICK,
-                    NavInsID.BOTH_CLICK,
-                    NavInsID.BOTH_CLICK,
-                    NavInsID.RIGHT_CLICK,
-                    NavInsID.BOTH_CLICK,
-                    NavInsID.BOTH_CLICK,
-                    NavInsID.RIGHT_CLICK,
-                    NavInsID.BOTH_CLICK,
-                    NavInsID.BOTH_CLICK,
-                    NavInsID.RIGHT_CLICK,
-                    NavInsID.BOTH_CLICK,
-                    NavInsID.BOTH_CLICK,
-                ])
-
+                instructions.append(NavInsID.RIGHT_CLICK)
             instructions.extend([
+                NavInsID.BOTH_CLICK,
+                NavInsID.BOTH_CLICK,
+                NavInsID.BOTH_CLICK,
                 NavInsID.RIGHT_CLICK,
                 NavInsID.BOTH_CLICK,
             ])
-            navigator.navigate_and_compare(ROOT_SCREENSHOT_PATH, test_name, instructions)
         else:
             instructions = [
                 NavInsID.SWIPE_CENTER_TO_LEFT,
                 NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
                 NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
+                NavInsID.USE_CASE_REVIEW_CONFIRM,
+            ]
+        navigator.navigate(instructions)
+
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "94MuZAZ3woKE8rLQZ23UTTdlze8v+fXbU6u3rWF3U+9KPl6MDXfFz0hcC/iTfzbKC0wp3UWgRv6TxO7VQVubBQ=="
+    )
+
+
+# Ensure the app refuses a partial signature unless blind signing is enabled,
+# and never summarizes one
+def test_sign_tx_partial_rejected(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    data = (
+        (0).to_bytes(4, "little")
+        + (0).to_bytes(2, "little")
+        + (4294967295).to_bytes(4, "little")
+        + bytes([2, 0x00, 0x10, 0x00, 0x70])
+        + test_partial_transaction[:64]
+    )
+    p2 = P2.P2_SIGN_HASH | P2.P2_PARTIAL_COVER
+    rapdu = backend.exchange(cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_START, p2=p2, data=data)
+    assert rapdu.status == Errors.SW_DENY
+
+    rapdu = backend.exchange(
+        cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_START, p2=p2 | P2.P2_SUMMARY, data=data
+    )
+    assert rapdu.status == Errors.SW_INVALID_PARAM
+
+
+# Summarized transaction accepted test
+# The test will ask for a summary of a transaction paying one destination
+# twice: the totals, then the total sent to the destination, are reviewed
+# instead of each output
+def test_sign_tx_summary_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+
+    with client.sign_tx(
+        key_index=0,
+        sig_index=0,
+        change_index=4294967295,
+        transaction=test_summary_transaction,
+        p2=P2.P2_SIGN_HASH | P2.P2_SUMMARY,
+    ):
+        if firmware.device.startswith("nano"):
+            # the total sent, the miner fees, and the destination, whose total
+            # is on its own page before the address
+            instructions = 2 * [NavInsID.BOTH_CLICK]
+            if firmware.device == "nanos":
+                instructions.extend(5 * [NavInsID.RIGHT_CLICK])
+            else:
+                instructions.append(NavInsID.RIGHT_CLICK)
+            instructions.extend([
+                NavInsID.BOTH_CLICK,
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ])
+        else:
+            # the totals, the destination, and the offer to show each output
+            instructions = [
+                NavInsID.SWIPE_CENTER_TO_LEFT,
+                NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
                 NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
                 NavInsID.USE_CASE_VIEW_DETAILS_NEXT,
                 NavInsID.USE_CASE_REVIEW_CONFIRM,
             ]
-            navigator.navigate_and_compare(ROOT_SCREENSHOT_PATH, test_name, instructions)
-
+        navigator.navigate(instructions)
 
     response = client.get_async_response()
     assert response.status == Errors.SW_OK
     assert response.data == base64.b64decode(
-        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+        "n8iL3ROZB6OWuQZyZtxBwjgwTgXIAIBsBKfQ1TqtRrrDouNUMzYoX3A8MaOcEJ0wD/NSiewnp6keJuQITNw+AA=="
+    )
+
+
+# Ensure the app rejects an empty range of change indices
+def test_sign_tx_empty_change_range(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    data = (
+        (0).to_bytes(4, "little")
+        + (0).to_bytes(2, "little")
+        + (4).to_bytes(4, "little")
+        + b"\x00"  # change count
+        + test_transaction[:64]
+    )
+    rapdu = backend.exchange(cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_START, p2=0x10, data=data)
+    assert rapdu.status == Errors.SW_INVALID_PARAM
+
+
+# Ensure the transaction hash can be computed without a review
+def test_tx_hash_no_review(firmware, backend):
+    client = BoilerplateCommandSender(backend)
+    rapdu = client.calc_tx_hash_no_review(
+        sig_index=0, change_index=4294967295, transaction=test_transaction
+    )
+    assert rapdu.status == Errors.SW_OK
+    assert rapdu.data == bytes.fromhex("593a3f87598ef76c9a7d0f7119c01f0a2328761402283dd5ea9f85fc61fb5b55")
+
+    # The Nano S cannot compute the transaction ID
+    if firmware.device == "nanos":
+        backend.raise_policy = RaisePolicy.RAISE_NOTHING
+        rapdu = client.calc_tx_hash_no_review(
+            sig_index=0,
+            change_index=4294967295,
+            transaction=test_transaction[:64],
+            p2=P2.P2_NO_REVIEW | P2.P2_TXN_ID,
+        )
+        assert rapdu.status == Errors.SW_INVALID_PARAM
+        return
+
+    rapdu = client.calc_tx_hash_no_review(
+        sig_index=0,
+        change_index=4294967295,
+        transaction=test_transaction,
+        p2=P2.P2_NO_REVIEW | P2.P2_TXN_ID,
+    )
+    assert rapdu.status == Errors.SW_OK
+    assert rapdu.data == bytes.fromhex(
+        "593a3f87598ef76c9a7d0f7119c01f0a2328761402283dd5ea9f85fc61fb5b55"
+        "de4a5169ed38e82e99ba5623335f4cf7e0c3dfc4cb9a624a916c28aaf8ffebf0"
+    )
+
+
+# Ensure the app refuses to sign without a review
+def test_sign_tx_no_review(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    data = (
+        (0).to_bytes(4, "little")
+        + (0).to_bytes(2, "little")
+        + (4).to_bytes(4, "little")
+        + test_transaction[:64]
     )
+    p2 = P2.P2_NO_REVIEW | P2.P2_SIGN_HASH
+    rapdu = backend.exchange(cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_START, p2=p2, data=data)
+    assert rapdu.status == Errors.SW_INVALID_PARAM
@@ -0,0 +1,105 @@
+import base64
+from ragger.backend import RaisePolicy
+from ragger.navigator import NavInsID
+from application_client.boilerplate_command_sender import (
+    BoilerplateCommandSender,
+    CLA,
+    Errors,
+    InsType,
+    P1,
+    P2,
+)
+from test_sign_txn_cmd import accept_instructions, test_transaction
+
+
+def txn_header(label: bytes) -> bytes:
+    return (
+        (0).to_bytes(4, "little")
+        + (0).to_bytes(2, "little")
+        + (4).to_bytes(4, "little")
+        + len(label).to_bytes(1, "little")
+        + label
+    )
+
+
+# Ensure the templates can be cleared without a review
+def test_clear_templates(backend):
+    client = BoilerplateCommandSender(backend)
+    rapdu = client.clear_templates()
+    assert rapdu.status == Errors.SW_OK
+
+
+# Ensure a template can only be saved from a full review of a signed transaction
+def test_save_template_invalid_flags(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    for p2 in [
+        P2.P2_SAVE_TEMPLATE,
+        P2.P2_SAVE_TEMPLATE | P2.P2_SIGN_HASH | P2.P2_NO_REVIEW,
+        P2.P2_SAVE_TEMPLATE | P2.P2_SIGN_HASH | 0x20,  # summary
+    ]:
+        rapdu = backend.exchange(
+            cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_START, p2=p2, data=txn_header(b"rent")
+        )
+        assert rapdu.status == Errors.SW_INVALID_PARAM
+
+
+# Ensure the app rejects template labels that cannot be displayed
+def test_save_template_invalid_label(backend):
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+    p2 = P2.P2_SAVE_TEMPLATE | P2.P2_SIGN_HASH
+    for label in [b"", b"x" * 16, b"new\nline"]:
+        rapdu = backend.exchange(
+            cla=CLA, ins=InsType.GET_TXN_HASH, p1=P1.P1_START, p2=p2, data=txn_header(label)
+        )
+        assert rapdu.status == Errors.SW_INVALID_PARAM
+
+
+# Template accepted test
+# The test will sign test_transaction after a full review, saving its outputs
+# as a template, then sign it again; the second time, only the template's
+# label is shown, as a recurring payout
+def test_save_template_sign_accept(firmware, backend, navigator):
+    client = BoilerplateCommandSender(backend)
+    # Disable raising when trying to unpack an error APDU
+    backend.raise_policy = RaisePolicy.RAISE_NOTHING
+
+    with client.sign_tx(
+        key_index=0,
+        sig_index=0,
+        change_index=4294967295,
+        transaction=test_transaction,
+        p2=P2.P2_SIGN_HASH | P2.P2_SAVE_TEMPLATE,
+        label=b"Rent",
+    ):
+        navigator.navigate(accept_instructions(firmware))
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+    )
+
+    with client.sign_tx(
+        key_index=0, sig_index=0, change_index=4294967295, transaction=test_transaction
+    ):
+        if firmware.device == "nanos":
+            # the label, fee and key span two pages
+            instructions = [
+                NavInsID.RIGHT_CLICK,
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ]
+        elif firmware.device.startswith("nano"):
+            instructions = [
+                NavInsID.RIGHT_CLICK,
+                NavInsID.BOTH_CLICK,
+            ]
+        else:
+            instructions = [NavInsID.USE_CASE_CHOICE_CONFIRM]
+        navigator.navigate(instructions)
+    response = client.get_async_response()
+    assert response.status == Errors.SW_OK
+    assert response.data == base64.b64decode(
+        "mr7i3aLQDoyHIM1ZXV+OTd34EM3bSpemN3tmV2ilH3x/yEVUtoZTVBMpuW8BMQ9vV21QIgxUGpzBfZccEY0bAg=="
+    )
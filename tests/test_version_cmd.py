@@ -1,5 +1,5 @@
 from application_client.boilerplate_command_sender import BoilerplateCommandSender
-from application_client.boilerplate_response_unpacker import unpack_get_version_response
+from application_client.boilerplate_response_unpacker import unpack_get_version_response, unpack_get_capabilities_response
 
 # Taken from the Makefile, to update every time the Makefile version is bumped
 MAJOR = 1
@@ -14,3 +14,16 @@ def test_version(backend):
     rapdu = client.get_version()
     # Use an helper to parse the response, assert the values
     assert unpack_get_version_response(rapdu.data) == (MAJOR, MINOR, PATCH)
+
+
+# In this test we check that the capabilities start with the app version, and
+# that the limits are usable
+def test_capabilities(backend):
+    client = BoilerplateCommandSender(backend)
+    rapdu = client.get_capabilities()
+    version, flags, limits = unpack_get_capabilities_response(rapdu.data)
+    assert version == (MAJOR, MINOR, PATCH)
+    assert flags & 0x01  # zero-run encoding
+    max_chunk_len, max_elems = limits[0], limits[1]
+    assert max_chunk_len == 255
+    assert max_elems > 0